@@ -1,113 +1,182 @@
 
-// ================== ENUM ==================
-enum HeaterState {
-  IDLE,
-  HEATING,
-  STABILIZING,
-  TARGET_REACHED,
-  OVERHEAT
-};
+// ================== BUILD OPTIONS ==================
+// Uncomment to time every loop stage (see common/Profiler.h); send "profile"
+// over serial to get a TLM_PROFILE report. Leave commented out for release builds.
+// #define HEATER_PROFILING
+
+#include <Arduino.h>
+#include "../common/Scheduler.h"
+#include "../common/Tmp36Sensor.h"
+#include "../common/HeaterController.h"
+#include "../common/Telemetry.h"
+#include "../common/LowPower.h"
+#include "../common/SettingsStore.h"
+#include "../common/HistoryLog.h"
+#include "../common/Watchdog.h"
+#include "../common/HeaterConsole.h"
+
+// ================== LOGGING MODE ==================
+// Binary telemetry frames by default (decode with tools/telemetry_decode.py).
+// Uncomment for the human-readable Serial Monitor output instead.
+// #define TEXT_TELEMETRY
+#ifdef TEXT_TELEMETRY
+const bool textTelemetry = true;
+const unsigned long serialBaud = 9600;
+#else
+const bool textTelemetry = false;
+const unsigned long serialBaud = 115200;
+#endif
 
 // ================== PIN CONFIG ==================
 const int TMP36_PIN = A0;
 const int HEATER_PIN = 8;
 
-// ================== THRESHOLDS ==================
-const float targetTemp = 30.0;
-const float overheatTemp = 40.0;
-const unsigned long stabilizingTime = 5000; // 5 seconds
+// ================== SAMPLING CLOCK ==================
+// Timer1 starts the ADC conversions: exactly this many oversampled TMP36
+// samples per second, independent of the task timing (see common/SampleClock.h)
+const uint16_t sampleRate = 100;  // Hz
+
+// ================== TASK TIMING ==================
+// The control path (sample -> FSM -> heater) runs far faster than logging,
+// so an overheat is seen within one control period instead of one second.
+const unsigned long controlPeriod = 50;      // ms between control passes
+const unsigned long controlDeadline = 10;    // ms a control task may start late
+const unsigned long telemetryPeriod = 1000;  // ms between log lines
+const unsigned long telemetryDeadline = 100;
+const unsigned long serialPeriod = 2;        // ms between TX queue drains
+const unsigned long storagePeriod = 4;       // ms between EEPROM byte writes (one takes 3.3 ms)
+const unsigned long historyPeriod = HISTORY_SAMPLE_PERIOD;  // ms between history samples
+
+// ================== HISTORY LOG ==================
+// Last few minutes of temperature and state changes; copied to EEPROM on
+// OVERHEAT (after the settings slots). Dump with "log" / "log saved".
+HistoryLog<> history;
+
+struct HistoryTransitions {
+  static void record(uint8_t zone, HeaterState from, HeaterState to) { history.transition(zone, from, to); }
+};
+
+// ================== CONTROLLER CONFIG ==================
+// Thresholds in Q8.8 fixed point, converted by the compiler (see FixedPoint.h).
+// They are the defaults: a valid record saved in EEPROM overrides them.
+struct Project1Config : HeaterConfigDefaults {
+  static constexpr TempQ8 targetTemp = celsiusQ8(30.0);
+  static constexpr TempQ8 hysteresis = celsiusQ8(2.0);
+  static constexpr TempQ8 overheatTemp = celsiusQ8(40.0);
+  static constexpr TempQ8 startTemp = targetTemp;                            // Heat as soon as we are below target
+  static constexpr TempQ8 overheatReleaseTemp = targetTemp - celsiusQ8(5.0); // Manual reset stand-in
+  static constexpr unsigned long stabilizingTime = 30000;                    // Upper bound; usually settles sooner
+  static constexpr unsigned long maxSampleAge = 150;                         // Heater off if no sample for this long
+  static constexpr unsigned long overheatLookahead = 15000;                  // Heater -> sensor lag; cut early within it
+  static constexpr uint8_t heaterPin = HEATER_PIN;
+  static constexpr int8_t ledPin = -1;                                       // No warning LED on this board
+  static constexpr bool logTransitions = textTelemetry;                      // Text mode only
+  static constexpr ControlMode controlMode = BANG_BANG;                      // Or PID, see PidControl.h
+  static constexpr unsigned long controlPeriod = ::controlPeriod;
+  typedef HistoryTransitions TransitionLog;
+  // A 5-tap median drops up to two bad conversions in a row, then a 1/4
+  // EMA (~200 ms) smooths the rest; OVERHEAT still trips on the median
+  typedef FilterChain<MedianFilter<5>, EmaFilter<2> > SampleFilter;
+};
 
 // ================== STATE VARIABLES ==================
-HeaterState currentState = IDLE;
-unsigned long stateStartTime = 0;
+typedef HeaterController<Tmp36Sensor<TMP36_PIN, sampleRate>, Project1Config> Controller;
+Controller controller;
+TelemetryLink<> telemetry;
+SettingsStore<> settingsStore;
+Scheduler<7> scheduler;
+// Serial commands (see common/HeaterConsole.h); replies as text or TLM_TEXT frames
+#ifdef TEXT_TELEMETRY
+typedef SerialConsoleOut ConsoleOut;
+ConsoleOut consoleOut(Serial);
+#else
+typedef TelemetryTextPrint<TelemetryLink<> > ConsoleOut;
+ConsoleOut consoleOut(telemetry);
+#endif
+HeaterConsole<Controller, SettingsStore<>, HistoryLog<>, Scheduler<7>, ConsoleOut> console(controller, settingsStore, history,
+                                                                                        scheduler, consoleOut);
+// Feeds the watchdog while every task checks in (see common/Watchdog.h)
+WatchdogSupervisor<Scheduler<7>, Controller> supervisor(scheduler, controller);
 
 // ================== FUNCTION DECLARATIONS ==================
-float readTemperature();
-void changeState(HeaterState newState);
-
-// ================== FUNCTIONS ==================
+void sampleTask();
+void fsmTask();
+void heaterTask();
+void telemetryTask();
+void serialTask();
+void storageTask();
+void historyTask();
+
+// ================== TASKS ==================
+
+void sampleTask() { PROFILE_SCOPE(PROF_SAMPLE); controller.sample(); }
+void fsmTask() { PROFILE_SCOPE(PROF_FSM); controller.evaluate(); }
+void heaterTask() { PROFILE_SCOPE(PROF_ACTUATE); controller.actuate(); }
+
+// Logs the latest reading
+void telemetryTask() {
+  PROFILE_SCOPE(PROF_TELEMETRY);
+#ifdef TEXT_TELEMETRY
+  Serial.print(F("Temperature: "));
+  printTemp(Serial, controller.temperature());
+  Serial.println();
+  Serial.print(F("Worst sensor-to-heater latency (us): "));
+  Serial.println(controller.worstLatencyMicros());
+#else
+  sendStatusRecord(telemetry, controller);
+#endif
+}
 
-// Reads the temperature from TMP36 sensor in °C
-float readTemperature() {
-  int analogValue = analogRead(TMP36_PIN);
-  float voltage = analogValue * (5.0 / 1023.0);
-  return (voltage - 0.5) * 100; // TMP36 formula
+// Takes console commands and feeds queued telemetry frames to the UART,
+// without ever blocking
+void serialTask() {
+  PROFILE_SCOPE(PROF_SERIAL);
+  console.service(Serial);
+  profileServiceReport(telemetry);
+  telemetry.drain(Serial);
 }
 
-// Changes the heater's state and logs the change
-void changeState(HeaterState newState) {
-  currentState = newState;
-  stateStartTime = millis();
-  Serial.print("State changed to: ");
-  switch (newState) {
-    case IDLE: Serial.println("IDLE"); break;
-    case HEATING: Serial.println("HEATING"); break;
-    case STABILIZING: Serial.println("STABILIZING"); break;
-    case TARGET_REACHED: Serial.println("TARGET_REACHED"); break;
-    case OVERHEAT: Serial.println("OVERHEAT"); break;
-  }
+// Writes queued settings and the OVERHEAT history copy to EEPROM a byte
+// at a time; whichever finds the EEPROM idle goes first
+void storageTask() {
+  settingsStore.service();
+  history.service();
 }
 
+void historyTask() { history.sample(controller.temperature()); }
+
 // ================== ARDUINO SETUP ==================
 void setup() {
-  Serial.begin(9600);
-  pinMode(HEATER_PIN, OUTPUT);
-  digitalWrite(HEATER_PIN, LOW);
-  changeState(IDLE);
+  // Heaters off before anything else runs; keeps the last run's reset record
+  watchdogBoot(Project1Config::heaterPin, 1);
+  Serial.begin(serialBaud);
+  // Thresholds from EEPROM if a valid record is there, else the Config defaults
+  HeaterSettings settings = defaultSettings<Project1Config>();
+  settingsStore.load(settings);
+  controller.begin(settings);
+  printResetRecord(consoleOut, watchdogLastReset);  // Why the board (re)started
+
+  // Added in pipeline order so one pass runs sample -> FSM -> heater
+  scheduler.add(sampleTask, controlPeriod, controlDeadline);
+  scheduler.add(fsmTask, controlPeriod, controlDeadline);
+  scheduler.add(heaterTask, controlPeriod, controlDeadline);
+  scheduler.add(telemetryTask, telemetryPeriod, telemetryDeadline);
+  scheduler.add(serialTask, serialPeriod, serialPeriod);
+  scheduler.add(storageTask, storagePeriod, storagePeriod);
+  scheduler.add(historyTask, historyPeriod, historyPeriod);
+
+  // Only the ADC (TMP36), Timer1 (its trigger), Timer0 and the UART stay clocked
+  lowPowerBegin(LOW_POWER_KEEP_ADC | LOW_POWER_KEEP_TIMER1);
+  supervisor.begin();
 }
 
 // ================== ARDUINO LOOP ==================
 void loop() {
-  float temperature = readTemperature();
-  Serial.print("Temperature: ");
-  Serial.println(temperature);
-
-  switch (currentState) {
-    case IDLE:
-      digitalWrite(HEATER_PIN, LOW);
-      if (temperature < targetTemp) {
-        changeState(HEATING);
-      }
-      break;
-
-    case HEATING:
-      digitalWrite(HEATER_PIN, HIGH);
-      if (temperature >= targetTemp) {
-        changeState(STABILIZING);
-      }
-      if (temperature > overheatTemp) {
-        changeState(OVERHEAT);
-      }
-      break;
-
-    case STABILIZING:
-      digitalWrite(HEATER_PIN, LOW);
-      if (millis() - stateStartTime >= stabilizingTime) {
-        changeState(TARGET_REACHED);
-      }
-      if (temperature > overheatTemp) {
-        changeState(OVERHEAT);
-      }
-      break;
-
-    case TARGET_REACHED:
-      digitalWrite(HEATER_PIN, LOW);
-      if (temperature < targetTemp - 2) { // hysteresis
-        changeState(HEATING);
-      }
-      if (temperature > overheatTemp) {
-        changeState(OVERHEAT);
-      }
-      break;
-
-    case OVERHEAT:
-      digitalWrite(HEATER_PIN, LOW);
-      // Manual reset to IDLE (in real system: button press)
-      if (temperature < targetTemp - 5) {
-        changeState(IDLE);
-      }
-      break;
+  scheduler.run();
+  // Feeds the watchdog unless a task missed its deadline
+  supervisor.check();
+  // Idle sleep until the next interrupt; the ADC and the millis() tick wake it
+  if (!scheduler.due()) {
+    lowPowerIdle();
   }
-
-  delay(1000); // read every second
 }
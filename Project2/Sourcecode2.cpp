@@ -1,189 +1,338 @@
+// ====== BUILD OPTIONS ======
+// Uncomment to time every loop stage (see common/Profiler.h); send "profile"
+// over serial to get a TLM_PROFILE report. Leave commented out for release builds.
+// #define HEATER_PROFILING
+
+// Uncomment to read DS18B20s on a 1-Wire bus instead of the LM75s
+// (see common/Ds18b20Sensor.h); there is no thermostat line then.
+// #define DS18B20_SENSOR
+
+// Uncomment to run this board as one node of a fleet on an RS-485 bus
+// (Modbus RTU, see common/ModbusNode.h). The UART then carries nothing
+// but Modbus: no telemetry and no console.
+// #define MODBUS_NODE
+#if defined(MODBUS_NODE) && (defined(TEXT_TELEMETRY) || defined(HEATER_PROFILING))
+#error "MODBUS_NODE takes the UART: build it without TEXT_TELEMETRY and HEATER_PROFILING"
+#endif
+
 #include <Arduino.h>
-#include <Wire.h>  // Library for I²C communication
+#include "../common/Scheduler.h"
+#ifdef DS18B20_SENSOR
+#include "../common/Ds18b20Sensor.h"     // DS18B20s on a bit-banged 1-Wire bus
+#else
+#include "../common/Lm75Sensor.h"        // LM75 over interrupt-driven I²C, replaces Wire.h
+#include "../common/OverheatInterrupt.h" // LM75 OS pin on INT0, defines the INT0/INT1 ISRs
+#endif
+#include "../common/HeaterController.h"  // Shared heater state machine
+#include "../common/LowPower.h"          // Idle sleep between tasks
+#include "../common/SettingsStore.h"     // Thresholds kept in EEPROM
+#include "../common/HistoryLog.h"        // Recent temperatures and state changes
+#include "../common/Watchdog.h"          // Stall supervisor and reset record, defines WDT_vect
+#ifdef MODBUS_NODE
+#include "../common/ModbusNode.h"        // Modbus RTU slave, defines the UART ISRs
+#else
+#include "../common/Telemetry.h"         // Binary telemetry frames
+#include "../common/HeaterConsole.h"     // Serial commands
+#endif
+
+// ====== LOGGING MODE ======
+// Binary telemetry frames by default (decode with tools/telemetry_decode.py).
+// Uncomment for the human-readable Serial Monitor output instead.
+// #define TEXT_TELEMETRY
+#ifdef TEXT_TELEMETRY
+const unsigned long serialBaud = 9600;
+#else
+const unsigned long serialBaud = 115200;
+#endif
+
+// ====== FLEET BUS ======
+// MODBUS_NODE builds: this node's address (1..247, one per board on the
+// bus), the bus speed (8E1) and the pin driving the RS-485 transceiver's
+// DE and /RE, tied together
+const uint8_t modbusAddress = 1;
+const unsigned long modbusBaud = 38400;
+const uint8_t rs485EnablePin = 4;
 
 // ====== I²C SENSOR  ======
-// The I²C address for the LM75 temperature sensor (default is 0x48)
+// The I²C address for the LM75 temperature sensor (default is 0x48).
+// The bus is scanned from here up to 0x4F at startup.
 const byte LM75_ADDRESS = 0x48;
 
+// ====== 1-WIRE SENSOR ======
+// DS18B20 data line (VDD powered, 4.7k pull-up to 5 V). The bus is
+// searched at startup; zone k is the k-th sensor found.
+const uint8_t oneWirePin = 7;
+
+// ====== ZONES ======
+// Number of heater/sensor pairs on this board (1..5 with these pins).
+// Zone k uses the k-th LM75 found on the bus and the heater on heaterPin + k.
+const uint8_t zoneCount = 1;
+
 // ====== PIN DEFINITIONS ======
-// Pin used to control the heater (relay or LED)
+// Pin used to control the heater (relay or LED); further zones follow on the next pins
 const int heaterPin = 8;
 // Pin used for the warning LED that lights up in overheat conditions
 const int ledPin = 13;
+// The LM75 OS output (all of them, wired together) goes here: INT0. It has
+// the internal pull-up, so the board still works with it left unconnected.
+const uint8_t osAlarmPin = 2;
+static_assert(heaterPin + zoneCount <= ledPin, "Zone heater pins would run into the LED pin");
+
+// ====== TASK TIMING ======
+// The control path (sample -> FSM -> heater) runs much faster than logging,
+// so the overheat check no longer waits for the 500 ms print cycle.
+const unsigned long controlPeriod = 50;      // ms between control passes
+const unsigned long controlDeadline = 10;    // ms a control task may start late
+// The LM75s are read in one background burst, started by the Timer1
+// sampling clock at sampleRate (see common/SampleClock.h); the sample task
+// collects each burst within 5 ms of its tick. The LM75 converts about
+// every 100 ms, so a faster clock would mostly read the same value again.
+const uint16_t sampleRate = 20;  // Hz
+const unsigned long samplePeriod = 5;
+const unsigned long telemetryPeriod = 500 / zoneCount;  // ms between log lines (one zone each)
+const unsigned long telemetryDeadline = 100;
+const unsigned long serialPeriod = 2;        // ms between TX queue drains
+const unsigned long storagePeriod = 4;       // ms between EEPROM byte writes (one takes 3.3 ms)
+const unsigned long historyPeriod = HISTORY_SAMPLE_PERIOD;  // ms between history samples
+
+// ====== SENSOR ======
+#ifdef DS18B20_SENSOR
+// 12 bits (1/16 °C): every sensor converts at once, one reading each
+// about every 0.85 s plus 0.1 s per sensor
+typedef Ds18b20Sensor<oneWirePin, zoneCount> Sensor;
+const uint8_t sensorBits = 12;
+// A reading is due at least every bus cycle
+const unsigned long maxSampleAge = 2000;
+#else
+// The LM75-compatible part on the bus: Lm75Part (9 bits, 0.5 °C),
+// Lm75bPart (11 bits) or Tmp75Part<Bits> (9..12 bits). A finer part can
+// hold a narrower hysteresis band (0.5 °C on a 12-bit TMP75); a TMP75
+// also takes Sensor::setResolution(zone, bits) in setup() to give a zone
+// faster conversions for coarser steps (see common/Lm75Sensor.h).
+typedef Lm75Part SensorPart;
+typedef Lm75Sensor<LM75_ADDRESS, zoneCount, sampleRate, SensorPart> Sensor;
+const uint8_t sensorBits = SensorPart::defaultBits;
+// If no fresh sample arrives within this time the heater is forced off
+const unsigned long maxSampleAge = 150;
+#endif
+
+// ====== HISTORY LOG ======
+// The last few minutes of zone 0's temperature and every zone's state
+// changes, copied to EEPROM on OVERHEAT (after the settings slots).
+// Dump it with the "log" and "log saved" commands. Counts of the
+// sensor's own resolution (1/2 °C on an LM75).
+typedef HistoryLog<16 - sensorBits> History;
+History history;
 
-// ====== TEMPERATURE THRESHOLDS ======
-// Desired target temperature in degrees Celsius
-const float targetTemp = 40.0;
-// Hysteresis helps avoid frequent on/off switching around the target temperature
-const float hysteresis = 2.0;
-// Safety limit: If temperature exceeds this, enter OVERHEAT state
-const float overheatTemp = 50.0;
-
-// ====== FSM STATES ======
-// Enum to represent the current state of the system (finite state machine)
-enum State {
-    IDLE,            // Waiting for temperature to drop
-    HEATING,         // Heater is on, trying to reach target temperature
-    STABILIZING,     // Temperature reached; waiting to stabilize
-    TARGET_REACHED,  // Temperature stable; heater off
-    OVERHEAT         // Emergency state; heater off, warning LED on
+struct HistoryTransitions {
+    static void record(uint8_t zone, HeaterState from, HeaterState to) { history.transition(zone, from, to); }
 };
 
-// Holds the current state of the system
-State currentState = IDLE;
-// Used to track when a state started (for timing purposes)
-unsigned long stateStartTime = 0;
-// Time to wait in STABILIZING state before moving to TARGET_REACHED (milliseconds)
-const unsigned long stabilizingTime = 5000;
+// ====== CONTROLLER CONFIG ======
+// All temperatures in Q8.8 degrees Celsius, converted by the compiler (see FixedPoint.h).
+// The thresholds are defaults: a valid record saved in EEPROM overrides them.
+struct Project2Config : HeaterConfigDefaults {
+    // Desired target temperature
+    static constexpr TempQ8 targetTemp = celsiusQ8(40.0);
+    // Hysteresis helps avoid frequent on/off switching around the target temperature
+    static constexpr TempQ8 hysteresis = celsiusQ8(2.0);
+    // Safety limit: If temperature exceeds this, enter OVERHEAT state
+    static constexpr TempQ8 overheatTemp = celsiusQ8(50.0);
+    // Start heating from IDLE once below the hysteresis band
+    static constexpr TempQ8 startTemp = targetTemp - hysteresis;
+    // Leave OVERHEAT once the temperature drops below target
+    static constexpr TempQ8 overheatReleaseTemp = targetTemp;
+    // Longest time to stay in STABILIZING before moving to TARGET_REACHED
+    // (milliseconds); the stability detector normally ends it sooner
+    static constexpr unsigned long stabilizingTime = 30000;
+    // If no fresh sample arrives within this time the heater is forced off
+    static constexpr unsigned long maxSampleAge = ::maxSampleAge;
+    // Heater-to-sensor lag (ms). The heater is cut early while the
+    // temperature is rising fast enough to pass overheatTemp within it.
+    static constexpr unsigned long overheatLookahead = 15000;
+    static constexpr uint8_t heaterPin = ::heaterPin;
+    static constexpr int8_t ledPin = ::ledPin;
+    // State is printed by the telemetry task instead
+    static constexpr bool logTransitions = false;
+    // BANG_BANG switches the heater fully on/off; PID regulates a
+    // time-proportioned duty in HEATING, STABILIZING and TARGET_REACHED
+    static constexpr ControlMode controlMode = BANG_BANG;
+    static constexpr unsigned long controlPeriod = ::controlPeriod;
+    // State changes go into the history log
+    typedef HistoryTransitions TransitionLog;
+#ifdef DS18B20_SENSOR
+    // CRC-checked 1/16 °C readings about once a second: filtering would
+    // only add lag
+    typedef NoFilter SampleFilter;
+#else
+    // The LM75s also watch overheatTemp themselves: their OS line trips the
+    // heaters off from an interrupt, without waiting for the next sample
+    typedef ThermostatOverheatInput<Sensor, osAlarmPin> OverheatInput;
+    // A 3-tap median drops a single glitched I²C read, then a 1/4 EMA
+    // (~200 ms at the 20 Hz sample rate) smooths the rest; OVERHEAT still
+    // trips on the median
+    typedef FilterChain<MedianFilter<3>, EmaFilter<2> > SampleFilter;
+#endif
+};
+
+// ====== CONTROLLER AND SCHEDULER ======
+typedef HeaterController<Sensor, Project2Config, zoneCount> Controller;
+Controller controller;
+SettingsStore<> settingsStore;
+#ifdef MODBUS_NODE
+typedef Scheduler<5> TaskScheduler;  // No telemetry task: the master polls instead
+TaskScheduler scheduler;
+// Registers for the bus master (see common/ModbusNode.h); writes are saved to EEPROM
+ModbusNode<Controller, SettingsStore<> > modbus(controller, settingsStore, modbusAddress);
+#else
+TelemetryLink<> telemetry;
+typedef Scheduler<6> TaskScheduler;
+TaskScheduler scheduler;
+// Serial commands (see common/HeaterConsole.h); replies as text or TLM_TEXT frames
+#ifdef TEXT_TELEMETRY
+typedef SerialConsoleOut ConsoleOut;
+ConsoleOut consoleOut(Serial);
+#else
+typedef TelemetryTextPrint<TelemetryLink<> > ConsoleOut;
+ConsoleOut consoleOut(telemetry);
+#endif
+HeaterConsole<Controller, SettingsStore<>, History, TaskScheduler, ConsoleOut> console(controller, settingsStore, history,
+                                                                                     scheduler, consoleOut);
+uint8_t telemetryZone = 0;  // Zone reported by the next telemetry task
+#endif
+// Feeds the watchdog while every task checks in (see common/Watchdog.h)
+WatchdogSupervisor<TaskScheduler, Controller> supervisor(scheduler, controller);
+
 // ====== FUNCTION PROTOTYPES ======
-// Reads temperature from LM75 sensor
-float readTemperature();
-// Changes the system to a new state
-void changeState(State newState);
-// Turns the heater on or off
-void controlHeater(bool turnOn);
+// Scheduler tasks
+void sampleTask();
+void controlTask();
+#ifndef MODBUS_NODE
+void telemetryTask();
+#endif
+void serialTask();
+void storageTask();
+void historyTask();
 
 // ====== SETUP ======
 void setup() {
-    Serial.begin(9600);   // Start serial communication for debugging
-    Wire.begin();         // Initialize I²C communication
-    pinMode(heaterPin, OUTPUT);   // Set heater pin as output
-    pinMode(ledPin, OUTPUT);      // Set LED pin as output
-    // Start in IDLE state
-    changeState(IDLE);
+    // Heaters off before anything else runs; keeps the last run's reset record
+    watchdogBoot(heaterPin, zoneCount);
+#ifdef MODBUS_NODE
+    modbus.begin(modbusBaud, rs485EnablePin);  // UART in 8E1, transceiver listening
+#else
+    Serial.begin(serialBaud);   // Start serial communication for telemetry
+#endif
+    // Thresholds from EEPROM if a valid record is there, else the Config defaults
+    HeaterSettings settings = defaultSettings<Project2Config>();
+    settingsStore.load(settings);
+    controller.begin(settings);   // Heater and LED off, LM75s found and armed, IDLE state
+#ifdef TEXT_TELEMETRY
+#ifdef DS18B20_SENSOR
+    Serial.print(F("DS18B20 sensors found: "));
+#else
+    Serial.print(F("LM75 sensors found: "));
+#endif
+    Serial.println(Sensor::sensorCount());
+#endif
+#ifndef MODBUS_NODE
+    printResetRecord(consoleOut, watchdogLastReset);  // Why the board (re)started, a TEXT record in binary mode
+#endif
+
+    scheduler.add(sampleTask, samplePeriod, samplePeriod);
+    scheduler.add(controlTask, controlPeriod, controlDeadline);
+#ifndef MODBUS_NODE
+    scheduler.add(telemetryTask, telemetryPeriod, telemetryDeadline);
+#endif
+    scheduler.add(serialTask, serialPeriod, serialPeriod);
+    scheduler.add(storageTask, storagePeriod, storagePeriod);
+    scheduler.add(historyTask, historyPeriod, historyPeriod);
+
+#ifdef DS18B20_SENSOR
+    // The 1-Wire bus is bit-banged: only Timer0 and the UART stay clocked
+    lowPowerBegin(0);
+#else
+    // Only the I²C bus, Timer1 (the sampling clock), Timer0 and the UART stay clocked
+    lowPowerBegin(LOW_POWER_KEEP_TWI | LOW_POWER_KEEP_TIMER1);
+#endif
+    // Last: the sensor's bus scan above blocks
+    supervisor.begin();
     }
 
 // ====== MAIN LOOP ======
 void loop() {
-    // Read the current temperature
-    float temp = readTemperature();
-  
-    // Print temperature and current state to Serial Monitor
-    Serial.print("Temperature: ");
-    Serial.print(temp);
-    Serial.print(" °C | State: ");
-
-    // ====== HANDLE EACH STATE ======
-    switch (currentState){
-        case IDLE:
-            Serial.println("IDLE");
-            // If temperature is below lower threshold, start heating
-            if (temp < targetTemp - hysteresis){
-                changeState(HEATING);
-            }
-            break;
-
-        case HEATING:
-            Serial.println("HEATING");
-            controlHeater(true);  // Turn heater on
-            // If target temperature is reached, start stabilizing
-            if (temp >= targetTemp) {
-                changeState(STABILIZING);
-            }
-            break;
-
-        case STABILIZING:
-            Serial.println("STABILIZING");
-            controlHeater(false);  // Turn heater off
-            // Wait for a fixed time before assuming temperature is stable
-            if (millis() - stateStartTime >= stabilizingTime) {
-                changeState(TARGET_REACHED);
-            }
-            break;
-
-        case TARGET_REACHED:
-            Serial.println("TARGET_REACHED");
-            controlHeater(false);  // Keep heater off
-            // If temperature drops, start heating again
-            if (temp < targetTemp - hysteresis) {
-                changeState(HEATING);
-            }
-            break;
-
-        case OVERHEAT:
-            Serial.println("OVERHEAT!!!");
-            controlHeater(false);           // Turn heater off immediately
-            digitalWrite(ledPin, HIGH);     // Turn on warning LED
-            // If temperature drops below target, return to IDLE
-            if (temp < targetTemp) {
-                digitalWrite(ledPin, LOW);    // Turn off warning LED
-                changeState(IDLE);
-            }
-            break;
-    }
-
-  // ====== GLOBAL OVERHEAT CHECK ======
-  // If temperature exceeds overheat limit from any state, go to OVERHEAT
-  if (temp >= overheatTemp && currentState != OVERHEAT) {
-        changeState(OVERHEAT);
+    // Dispatch whichever tasks are due; nothing here blocks
+    scheduler.run();
+    // Feeds the watchdog unless a task missed its deadline
+    supervisor.check();
+    // Idle sleep until the next interrupt (millis() tick, sampling clock, I²C, OS line, UART)
+    if (!scheduler.due()) {
+        lowPowerIdle();
     }
-
-    delay(500);  // Wait 0.5 seconds before next loop
 }
 
-// ====== READ TEMPERATURE FUNCTION ======
+// ====== CONTROL TASKS ======
+// Collect the finished I²C burst; the next clock tick starts the next one
+// (DS18B20s: one 1-Wire step, at most a reset or a byte)
+void sampleTask() { PROFILE_SCOPE(PROF_SAMPLE); controller.sample(); }
+// One pass over all zones: sample -> state machine -> heater, zone by zone
+void controlTask() { PROFILE_SCOPE(PROF_FSM); controller.update(); }
 
-float readTemperature() {
-        // Start communication with the LM75 sensor by addressing it over I²C.
-        Wire.beginTransmission(LM75_ADDRESS);
-
-        // Tell the LM75 that we want to read from register 0x00, which holds the temperature.
-         Wire.write(0x00);  // 0x00 is the temperature register in LM75
-
-        // End the transmission, but pass 'false' to keep the connection open for the next read.
-        Wire.endTransmission(false);  // This allows a repeated start without releasing the bus
-
-  // Request 2 bytes from the LM75 sensor. These contain the temperature data.
-        Wire.requestFrom(LM75_ADDRESS, (uint8_t)2);
-
-  // Check if we actually received 2 bytes from the sensor
-        if (Wire.available() >= 2) {
-    // Read the first byte (MSB - most significant byte)
-            uint8_t msb = Wire.read();
-
-    // Read the second byte (LSB - least significant byte)
-            uint8_t lsb = Wire.read();
-
-    /*
-      The LM75 sends temperature as a 9-bit two's complement number:
-      - The MSB contains the integer part.
-      - The LSB's most significant bit (bit 7) represents 0.5°C.
-      - The remaining 7 bits in LSB are unused and should be ignored.
-
-      So to combine both bytes:
-      - First, shift MSB 8 bits to the left.
-      - OR with LSB to combine them into a 16-bit number.
-      - Then shift the result to 7 bits to the right to drop unused bits.
-    */
-        int16_t tempRaw = ((msb << 8) | lsb) >> 7;
-
-    // Multiply the raw value by 0.5 to convert it to degrees Celsius
-        float temperature = tempRaw * 0.5;
-
-    // Return the final temperature value
-        return temperature;
-        }
-
-  // If 2 bytes weren't received properly, return an error value
-        return -100.0;  // Arbitrary low number indicating failure to read temperature
+#ifndef MODBUS_NODE
+// ====== TELEMETRY TASK ======
+void telemetryTask() {
+    PROFILE_SCOPE(PROF_TELEMETRY);
+    uint8_t zone = telemetryZone;
+    telemetryZone = zone + 1 < zoneCount ? zone + 1 : 0;
+#ifdef TEXT_TELEMETRY
+    // Print temperature and current state to Serial Monitor
+    if (zoneCount > 1) {
+        Serial.print(F("Zone "));
+        Serial.print(zone);
+        Serial.print(F(" | "));
     }
-
-// ====== READ TEMPERATURE FUNCTION FINISH======
-
-
-// ====== CHANGE STATE FUNCTION ======
-void changeState(State newState){
-        currentState = newState;         // Update state
-        stateStartTime = millis();       // Record time of change (for timing logic)
+    Serial.print(F("Temperature: "));
+    printTemp(Serial, controller.temperature(zone));
+    Serial.print(F(" °C | State: "));
+    printStateName(Serial, controller.state(zone));
+    Serial.print(F(" | Worst latency (us): "));
+    Serial.print(controller.worstLatencyMicros());
+    Serial.print(F(" | Read errors: "));
+    Serial.println(Sensor::readErrors);
+#else
+    // One 14-byte frame: timestamp, temperature, state, heater duty
+    // (15 bytes with the zone number on multi-zone boards)
+    if (zoneCount > 1) {
+        sendZoneStatusRecord(telemetry, controller, zone);
+    } else {
+        sendStatusRecord(telemetry, controller);
     }
+#endif
+}
+#endif
 
-// ====== CONTROL HEATER FUNCTION ======
-void controlHeater(bool turnOn) {
-        if (turnOn == true) {
-            digitalWrite(heaterPin, HIGH);  // Turn heater ON
-        } 
-        else {
-            digitalWrite(heaterPin, LOW);   // Turn heater OFF
-        }
-    }
+// ====== SERIAL TASK ======
+// Takes console commands and feeds queued telemetry frames to the UART,
+// without ever blocking (MODBUS_NODE: answers the request the bus master
+// finished sending, if any)
+void serialTask() {
+    PROFILE_SCOPE(PROF_SERIAL);
+#ifdef MODBUS_NODE
+    modbus.service();
+#else
+    console.service(Serial);      // One command or reply line at most
+    profileServiceReport(telemetry);
+    telemetry.drain(Serial);
+#endif
+}
+
+// ====== STORAGE TASK ======
+// Writes queued settings and the OVERHEAT history copy to EEPROM a byte
+// at a time; whichever finds the EEPROM idle goes first
+void storageTask() {
+    settingsStore.service();
+    history.service();
+}
 
+// ====== HISTORY TASK ======
+void historyTask() { history.sample(controller.temperature(0)); }
@@ -0,0 +1,130 @@
+#ifndef HEATER_ADC_SAMPLER_H
+#define HEATER_ADC_SAMPLER_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include "SampleClock.h"
+
+// ====== FREE-RUNNING ADC SAMPLER ======
+// Replaces synchronous analogRead() for one analog channel. The ADC runs in
+// free-running auto-trigger mode and its conversion-complete interrupt
+// oversamples: every 16 raw 10-bit conversions are summed and decimated to
+// one 12-bit value, which goes into a small ring buffer. The value handed
+// to loop() is the mean of that ring, kept as a running sum so the ISR does
+// constant work. Reading it costs a few cycles instead of ~100 µs of
+// busy-waiting.
+//
+// adcBeginClocked() runs the same chain from the hardware sampling clock
+// instead (SampleClock.h): Timer1 Compare Match B starts every conversion,
+// ADC_OVERSAMPLE of them per sample period, so each decimated sample
+// covers exactly one period and lands at a fixed rate, and its instant
+// goes into the clock's jitter statistics.
+//
+// This header defines the ADC_vect ISR and takes over the ADC, so
+// analogRead() must not be used while it runs. Include it from exactly
+// one translation unit (the sketch).
+
+// Raw conversions summed per decimated sample (16x -> 2 extra bits)
+const uint8_t ADC_OVERSAMPLE = 16;
+// Decimated samples averaged for the filtered value (power of two)
+const uint8_t ADC_RING_SIZE = 8;
+const uint8_t ADC_RING_SHIFT = 3;
+// Full scale of a decimated sample: 10 bits + 2 bits from oversampling
+const uint16_t ADC_FULL_SCALE = 4096;
+
+// ====== SAMPLER STATE (shared with the ISR) ======
+static volatile uint16_t adcAccumulator = 0;   // Sum of the current oversampling block
+static volatile uint8_t adcBlockCount = 0;     // Conversions in the current block
+static volatile uint16_t adcRing[ADC_RING_SIZE];
+static volatile uint8_t adcRingIndex = 0;
+static volatile uint16_t adcRingSum = 0;       // Running sum of adcRing
+static volatile uint16_t adcSequence = 0;      // Incremented for every decimated sample
+static volatile bool adcPrimed = false;        // Ring holds real samples
+static bool adcClocked = false;                // Conversions started by Timer1, see adcBeginClocked()
+
+// ADCSRB auto-trigger source: Timer1 Compare Match B (ADTS2:0 = 101)
+const uint8_t ADC_TRIGGER_TIMER1_COMPARE_B = _BV(ADTS2) | _BV(ADTS0);
+
+// Common part: ring reset, channel, reference and trigger source
+static inline void adcStart(uint8_t pin, uint8_t trigger) {
+    uint8_t channel = (pin >= A0 ? pin - A0 : pin) & 0x07;
+    for (uint8_t i = 0; i < ADC_RING_SIZE; i++) {
+        adcRing[i] = 0;
+    }
+    adcRingIndex = 0;
+    adcRingSum = 0;
+    adcAccumulator = 0;
+    adcBlockCount = 0;
+    adcPrimed = false;
+    adcClocked = trigger != 0;
+
+    DIDR0 |= _BV(channel);           // Digital input buffer off: less noise, less current
+    ADMUX = _BV(REFS0) | channel;    // AVcc reference, right-adjusted result
+    ADCSRB = trigger;                // Auto-trigger source: free running (0) or Timer1
+    // Enable, auto-trigger, interrupt, clock /128 = 125 kHz (~9.6k conversions/s)
+    ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+// Starts continuous conversions on analog input pin (A0..A5)
+static inline void adcBegin(uint8_t pin) {
+    adcStart(pin, 0);
+    ADCSRA |= _BV(ADSC);             // First conversion starts the free-running chain
+}
+
+// Starts conversions on analog input pin (A0..A5) clocked by Timer1, for
+// sampleHz decimated samples per second
+static inline void adcBeginClocked(uint8_t pin, uint16_t sampleHz) {
+    adcStart(pin, ADC_TRIGGER_TIMER1_COMPARE_B);
+    sampleClockBegin(sampleHz, 0, ADC_OVERSAMPLE);  // No tick interrupt: the ADC ISR re-arms the trigger
+}
+
+// Latest filtered reading as a 12-bit count (0..4095)
+static inline uint16_t adcLatest() {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t sum = adcRingSum;
+    SREG = sreg;
+    return sum >> ADC_RING_SHIFT;
+}
+
+// Counter of decimated samples; if it stops moving the ADC has stalled
+static inline uint16_t adcSampleSequence() {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t sequence = adcSequence;
+    SREG = sreg;
+    return sequence;
+}
+
+// ====== ADC INTERRUPT ======
+ISR(ADC_vect) {
+    if (adcClocked) {
+        TIFR1 = _BV(OCF1B);  // The trigger is the flag's rising edge: clear it for the next match
+    }
+    adcAccumulator += ADC;
+    if (++adcBlockCount < ADC_OVERSAMPLE) {
+        return;
+    }
+    // 16 x 10-bit = 14-bit sum; dropping 2 bits leaves a 12-bit sample
+    uint16_t sample = adcAccumulator >> 2;
+    adcAccumulator = 0;
+    adcBlockCount = 0;
+
+    if (!adcPrimed) {
+        // Prime the ring with the first sample so the mean is valid at once
+        for (uint8_t i = 0; i < ADC_RING_SIZE; i++) {
+            adcRing[i] = sample;
+        }
+        adcRingSum = sample << ADC_RING_SHIFT;
+        adcPrimed = true;
+    }
+    adcRingSum += sample - adcRing[adcRingIndex];
+    adcRing[adcRingIndex] = sample;
+    adcRingIndex = (adcRingIndex + 1) & (ADC_RING_SIZE - 1);
+    adcSequence++;
+    if (adcClocked) {
+        sampleClockRecord();
+    }
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HEATER_CRC16_H
+#define HEATER_CRC16_H
+
+#include <Arduino.h>
+
+// ====== CRC-16 ======
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), bitwise so it needs no
+// lookup table. Guards telemetry frames and the EEPROM settings record.
+const uint16_t CRC16_INIT = 0xFFFF;
+
+// One byte at a time
+static inline uint16_t crc16Update(uint16_t crc, uint8_t data) {
+    crc ^= (uint16_t)data << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static inline uint16_t crc16(const uint8_t* data, uint8_t length) {
+    uint16_t crc = CRC16_INIT;
+    for (uint8_t i = 0; i < length; i++) {
+        crc = crc16Update(crc, data[i]);
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HEATER_CRC8_H
+#define HEATER_CRC8_H
+
+#include <Arduino.h>
+
+// ====== CRC-8 ======
+// CRC-8/MAXIM (poly x^8 + x^5 + x^4 + 1, reflected 0x8C, init 0), the one
+// 1-Wire devices put after their ROM ID and scratchpad. Bitwise, so it
+// needs no lookup table. Running it over the data and its CRC byte gives 0.
+
+// One byte at a time
+static inline uint8_t crc8Update(uint8_t crc, uint8_t data) {
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x01) ? (crc >> 1) ^ 0x8C : crc >> 1;
+    }
+    return crc;
+}
+
+static inline uint8_t crc8(const uint8_t* data, uint8_t length) {
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        crc = crc8Update(crc, data[i]);
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef HEATER_DS18B20_SENSOR_H
+#define HEATER_DS18B20_SENSOR_H
+
+#include <Arduino.h>
+#include "OneWireBus.h"
+#include "FixedPoint.h"
+#include "SensorReading.h"
+
+// ====== DS18B20 SENSOR POLICY ======
+// DS18B20s on one 1-Wire bus (OneWireBus.h), VDD powered: parasite power
+// needs a strong pull-up during conversions, which this driver does not
+// drive.
+//
+// begin() runs a ROM search and keeps the ID of every DS18B20 it finds
+// (family 0x28), up to Zones of them: zone k is the k-th in search order.
+// It blocks for about 14 ms per device, once, from setup().
+//
+// After that the bus runs a cycle that never blocks longer than one reset
+// or one byte (about 1 ms):
+//   - one Skip ROM + Convert T starts every sensor converting at once, so
+//     the conversion time (750 ms at 12 bits) is paid once per bus rather
+//     than once per sensor;
+//   - completion is polled with one read slot per step (a converting
+//     DS18B20 answers 0);
+//   - then each sensor's scratchpad is read by Match ROM with its ID and
+//     checked against its CRC-8; then the next conversion starts.
+// The zones' readings are parked until they are polled, like the LM75
+// bursts. The bus takes one step per sample pass (poll(0), which the
+// controller makes first in every pass), so with the 5 ms sample task a
+// cycle takes about 0.85 s plus 0.1 s per sensor.
+//
+// A sensor that gives no presence pulse or a scratchpad failing its CRC
+// reports SENSOR_READ_FAILED on its zone's next poll and is read again in
+// the next cycle; a conversion that does not finish in twice its time
+// fails every zone. A zone with no sensor found reports SENSOR_NOT_FOUND.
+// The 85 °C a sensor holds after its own power-on reset reads as a real
+// value; the controller's slew check drops it as an impossible jump.
+const uint8_t DS18B20_FAMILY = 0x28;
+const uint8_t DS18B20_CONVERT_T = 0x44;
+const uint8_t DS18B20_READ_SCRATCHPAD = 0xBE;
+const uint8_t DS18B20_WRITE_SCRATCHPAD = 0x4E;
+const uint8_t DS18B20_SCRATCHPAD_SIZE = 9;  // Temperature LSB, MSB, TH, TL, config, 3 reserved, CRC-8
+const uint8_t DS18B20_CONFIG_FIXED = 0x1F;  // Config register bits that always read 1 (bit 7 reads 0)
+const uint8_t DS18B20_CONFIG_RESOLUTION_SHIFT = 5;  // R1:R0, 9 + n bits
+
+template <uint8_t Pin, uint8_t Zones = 1, uint8_t Bits = 12>
+struct Ds18b20Sensor {
+    typedef OneWireBus<Pin> Bus;
+    static_assert(Zones >= 1 && Zones <= 8, "Zones is 1..8");
+    static_assert(Bits >= 9 && Bits <= 12, "A DS18B20 converts at 9..12 bits");
+
+    // Longest conversion at Bits: 93.75 ms at 9 bits, doubling per bit
+    static constexpr unsigned long conversionMillis = 750UL >> (12 - Bits);
+
+    static void begin() {
+        Bus::begin();
+        discover();
+        fresh = 0;
+        failed = 0;
+        phase = PHASE_START;
+        if (Bits != 12 && Bus::reset()) {  // 12 bits is the power-on setting
+            const uint8_t config = (uint8_t)(((Bits - 9) << DS18B20_CONFIG_RESOLUTION_SHIFT) | DS18B20_CONFIG_FIXED);
+            Bus::writeByte(ONE_WIRE_SKIP_ROM);
+            Bus::writeByte(DS18B20_WRITE_SCRATCHPAD);
+            Bus::writeByte(0x7F);  // TH, TL: alarm search unused
+            Bus::writeByte(0x80);
+            Bus::writeByte(config);
+        }
+    }
+
+    static SensorReading poll(uint8_t zone) {
+        if (zone == 0) {
+            service();
+        }
+        uint8_t bit = (uint8_t)(1 << zone);
+        if (fresh & bit) {
+            fresh &= ~bit;
+            return sensorReading(SENSOR_OK, readings[zone]);
+        }
+        if (failed & bit) {
+            failed &= ~bit;
+            return sensorReading(SENSOR_READ_FAILED);
+        }
+        return sensorReading(zone < deviceCount ? SENSOR_NO_SAMPLE : SENSOR_NOT_FOUND);
+    }
+
+    // One step of the bus cycle
+    static void service() {
+        switch (phase) {
+            case PHASE_START:
+                if (deviceCount == 0) {
+                    // Nothing on the bus at all: each zone reports
+                    // SENSOR_NOT_FOUND, no read error is counted
+                } else if (Bus::reset()) {
+                    step = 0;
+                    phase = PHASE_CONVERT;
+                } else {
+                    failAll();
+                }
+                break;
+            case PHASE_CONVERT:  // Skip ROM, Convert T
+                Bus::writeByte(step == 0 ? ONE_WIRE_SKIP_ROM : DS18B20_CONVERT_T);
+                if (++step == 2) {
+                    convertStart = millis();
+                    phase = PHASE_CONVERTING;
+                }
+                break;
+            case PHASE_CONVERTING:
+                if (Bus::readBit()) {
+                    device = 0;
+                    phase = PHASE_SELECT;
+                } else if (millis() - convertStart > 2 * conversionMillis) {
+                    failAll();
+                    phase = PHASE_START;
+                }
+                break;
+            case PHASE_SELECT:
+                if (Bus::reset()) {
+                    step = 0;
+                    phase = PHASE_ADDRESS;
+                } else {
+                    fail(device);
+                    nextDevice();
+                }
+                break;
+            case PHASE_ADDRESS:  // Match ROM, the sensor's ID, Read Scratchpad
+                Bus::writeByte(step == 0 ? ONE_WIRE_MATCH_ROM
+                                         : (step <= ONE_WIRE_ROM_SIZE ? roms[device][step - 1] : DS18B20_READ_SCRATCHPAD));
+                if (++step == ONE_WIRE_ROM_SIZE + 2) {
+                    step = 0;
+                    phase = PHASE_READ;
+                }
+                break;
+            case PHASE_READ:
+                scratchpad[step] = Bus::readByte();
+                if (++step == DS18B20_SCRATCHPAD_SIZE) {
+                    collect(device);
+                    nextDevice();
+                }
+                break;
+        }
+    }
+
+    // Takes a scratchpad that passes its CRC and shows a real config byte
+    // (an all-zero one, from a line held low, has a good CRC)
+    static void collect(uint8_t zone) {
+        if (crc8(scratchpad, DS18B20_SCRATCHPAD_SIZE) != 0
+            || (scratchpad[4] & 0x9F) != DS18B20_CONFIG_FIXED) {
+            fail(zone);
+            return;
+        }
+        readings[zone] = scratchpadToQ8(scratchpad[1], scratchpad[0]);
+        fresh |= (uint8_t)(1 << zone);
+    }
+
+    static void nextDevice() {
+        if (++device >= deviceCount) {
+            phase = PHASE_START;
+        } else {
+            phase = PHASE_SELECT;
+        }
+    }
+
+    static void fail(uint8_t zone) {
+        readErrors++;
+        failed |= (uint8_t)(1 << zone);
+    }
+
+    static void failAll() {
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            fail(i);
+        }
+    }
+
+    // Searches the bus for up to Zones DS18B20s; other devices on the
+    // line (ID chips, DS18S20s) are passed over; returns how many
+    static uint8_t discover() {
+        deviceCount = Bus::search(roms, Zones, DS18B20_FAMILY);
+        return deviceCount;
+    }
+
+    static uint8_t sensorCount() { return deviceCount; }
+    static const uint8_t* rom(uint8_t zone) { return roms[zone]; }
+
+    /*
+      The DS18B20 sends temperature as a 16-bit two's complement number
+      in 1/16 °C, LSB first; below 12 bits the lowest bits are undefined.
+      Shifted up by 4 it is exactly Q8.8 °C (-55..125 °C fits easily).
+    */
+    static TempQ8 scratchpadToQ8(uint8_t msb, uint8_t lsb) {
+        uint16_t raw = (uint16_t)(((uint16_t)msb << 8) | lsb) & (uint16_t)(0xFFFFu << (12 - Bits));
+        return (TempQ8)(raw << 4);
+    }
+
+    enum Phase { PHASE_START, PHASE_CONVERT, PHASE_CONVERTING, PHASE_SELECT, PHASE_ADDRESS, PHASE_READ };
+
+    static unsigned int readErrors;     // Failed reads (no presence, bad CRC, timeout), all zones
+    static TempQ8 readings[Zones];      // Finished reads waiting for their zone's poll
+    static uint8_t fresh;               // Bit k: readings[k] not collected yet
+    static uint8_t failed;              // Bit k: zone k's last read failed, not reported yet
+    static uint8_t phase;               // A Phase
+    static uint8_t step;                // Bytes done in this phase
+    static uint8_t device;              // Zone being read
+    static unsigned long convertStart;  // millis() of the last Convert T
+    static uint8_t scratchpad[DS18B20_SCRATCHPAD_SIZE];
+    static uint8_t roms[Zones][ONE_WIRE_ROM_SIZE];  // Each zone's ROM ID
+    static uint8_t deviceCount;         // DS18B20s found by discover()
+};
+
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+unsigned int Ds18b20Sensor<Pin, Zones, Bits>::readErrors = 0;
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+TempQ8 Ds18b20Sensor<Pin, Zones, Bits>::readings[Zones];
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::fresh = 0;
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::failed = 0;
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::phase = 0;
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::step = 0;
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::device = 0;
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+unsigned long Ds18b20Sensor<Pin, Zones, Bits>::convertStart = 0;
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::scratchpad[DS18B20_SCRATCHPAD_SIZE];
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::roms[Zones][ONE_WIRE_ROM_SIZE];
+template <uint8_t Pin, uint8_t Zones, uint8_t Bits>
+uint8_t Ds18b20Sensor<Pin, Zones, Bits>::deviceCount = 0;
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef HEATER_FAST_PIN_H
+#define HEATER_FAST_PIN_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+
+// ====== FAST PINS ======
+// Digital pins resolved to their port register and bit at compile
+// time. digitalWrite() looks the pin up in three PROGMEM tables, checks
+// for a PWM timer to switch off and brackets the write with cli()/sei()
+// on every call; with a constant pin FastPin<Pin>::set() is a single sbi
+// instruction (2 cycles). sbi and cbi are also atomic, so a main-line write
+// cannot undo an ISR's write to another bit of the same port, which a
+// read-modify-write could (OverheatInterrupt.h relies on this).
+//
+// Pin numbers are the Arduino Uno's: D0-D7 on PORTD, D8-D13 on PORTB,
+// D14-D19 (A0-A5) on PORTC. A negative pin is "not fitted" and every
+// operation on it does nothing, like Config::ledPin = -1.
+//
+// input() and read() make the same pin an open-drain line (OneWireBus.h):
+// with the latch cleared, output() pulls it low and input() lets the
+// external pull-up have it.
+
+const uint8_t FAST_PORT_B = 0;
+const uint8_t FAST_PORT_C = 1;
+const uint8_t FAST_PORT_D = 2;
+const uint8_t FAST_PORT_COUNT = 3;
+
+constexpr uint8_t fastPinPort(uint8_t pin) { return pin < 8 ? FAST_PORT_D : (pin < 14 ? FAST_PORT_B : FAST_PORT_C); }
+constexpr uint8_t fastPinMask(uint8_t pin) { return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14)); }
+
+// An lvalue reference to a port register (volatile uint8_t& on the AVR)
+typedef decltype((PORTB)) FastPortRef;
+typedef decltype((DDRB)) FastDdrRef;
+typedef decltype((PINB)) FastPinRef;
+
+template <int8_t Pin>
+struct FastPin {
+    static_assert(Pin < 20, "The Uno has digital pins 0..19");
+
+    static void output() {
+        if (Pin >= 0) {
+            ddr() |= mask();
+        }
+    }
+    static void input() {
+        if (Pin >= 0) {
+            ddr() &= (uint8_t)~mask();
+        }
+    }
+    static void set() {
+        if (Pin >= 0) {
+            port() |= mask();
+        }
+    }
+    static void clear() {
+        if (Pin >= 0) {
+            port() &= (uint8_t)~mask();
+        }
+    }
+    static void write(bool high) {
+        if (high) {
+            set();
+        } else {
+            clear();
+        }
+    }
+    // The output latch, i.e. what was last written
+    static bool isSet() { return Pin >= 0 && (port() & mask()) != 0; }
+    // The level on the pin
+    static bool read() { return Pin >= 0 && (pins() & mask()) != 0; }
+
+private:
+    static constexpr uint8_t index() { return Pin < 0 ? 0 : Pin; }
+    static constexpr uint8_t mask() { return fastPinMask(index()); }
+    static FastPortRef port() {
+        return fastPinPort(index()) == FAST_PORT_D ? PORTD : (fastPinPort(index()) == FAST_PORT_B ? PORTB : PORTC);
+    }
+    static FastDdrRef ddr() {
+        return fastPinPort(index()) == FAST_PORT_D ? DDRD : (fastPinPort(index()) == FAST_PORT_B ? DDRB : DDRC);
+    }
+    static FastPinRef pins() {
+        return fastPinPort(index()) == FAST_PORT_D ? PIND : (fastPinPort(index()) == FAST_PORT_B ? PINB : PINC);
+    }
+};
+
+// Count consecutive pins from First, addressed by a run-time index (the
+// zone). The index picks one of Count inlined FastPin writes, so each
+// write is still a single sbi/cbi; an index of Count or more does nothing.
+template <uint8_t First, uint8_t Count>
+struct FastPinRange {
+    typedef FastPin<First> Head;
+    typedef FastPinRange<First + 1, Count - 1> Tail;
+
+    static void output(uint8_t index) { index == 0 ? Head::output() : Tail::output(index - 1); }
+    static void write(uint8_t index, bool high) { index == 0 ? Head::write(high) : Tail::write(index - 1, high); }
+    static bool isSet(uint8_t index) { return index == 0 ? Head::isSet() : Tail::isSet(index - 1); }
+};
+
+template <uint8_t First>
+struct FastPinRange<First, 0> {
+    static void output(uint8_t) {}
+    static void write(uint8_t, bool) {}
+    static bool isSet(uint8_t) { return false; }
+};
+
+#endif
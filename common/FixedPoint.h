@@ -0,0 +1,51 @@
+#ifndef HEATER_FIXED_POINT_H
+#define HEATER_FIXED_POINT_H
+
+#include <Arduino.h>
+
+// ====== FIXED-POINT TEMPERATURE ======
+// Temperatures are signed Q8.8 degrees Celsius: the high byte is the whole
+// degrees and the low byte is 1/256 °C. This is the LM75's native register
+// format, so LM75 readings need no conversion at all, and the range
+// (-128 °C .. +127.99 °C) covers every sensor we use. All comparisons are
+// plain 16-bit integer compares, cheap enough to run inside an ISR.
+typedef int16_t TempQ8;
+
+const uint8_t TEMP_Q8_SHIFT = 8;
+const TempQ8 TEMP_Q8_MAX = 32767;
+const TempQ8 TEMP_Q8_MIN = -32767 - 1;
+
+// Converts degrees Celsius to Q8.8, rounded to nearest. Meant for
+// thresholds: used in a constexpr initialiser it is evaluated by the
+// compiler and no floating-point code ends up in the firmware.
+constexpr TempQ8 celsiusQ8(double celsius) {
+    return (TempQ8)(celsius * 256.0 + (celsius < 0 ? -0.5 : 0.5));
+}
+
+// Clamps a wider intermediate result into the Q8.8 range
+static inline TempQ8 saturateQ8(int32_t value) {
+    return value > TEMP_Q8_MAX ? TEMP_Q8_MAX : (value < TEMP_Q8_MIN ? TEMP_Q8_MIN : (TempQ8)value);
+}
+
+// Prints a Q8.8 temperature with two decimals, e.g. "-12.25"
+static inline void printTemp(Print& out, TempQ8 temp) {
+    int32_t value = temp < 0 ? -(int32_t)temp : temp;
+    // Hundredths, rounded: (fraction * 100 + 128) / 256
+    uint16_t hundredths = (uint16_t)((((uint32_t)value & 0xFF) * 100 + 128) >> TEMP_Q8_SHIFT);
+    uint16_t whole = (uint16_t)(value >> TEMP_Q8_SHIFT);
+    if (hundredths >= 100) {
+        whole++;
+        hundredths -= 100;
+    }
+    if (temp < 0 && (whole != 0 || hundredths != 0)) {
+        out.print('-');
+    }
+    out.print(whole);
+    out.print('.');
+    if (hundredths < 10) {
+        out.print('0');
+    }
+    out.print(hundredths);
+}
+
+#endif
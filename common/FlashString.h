@@ -0,0 +1,40 @@
+#ifndef HEATER_FLASH_STRING_H
+#define HEATER_FLASH_STRING_H
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+// ====== STRINGS IN FLASH ======
+// On AVR every string literal is copied from flash into SRAM at boot and
+// stays there, so all text the firmware prints lives in PROGMEM instead:
+// F("...") for one-off strings, and for names picked by an index a
+// PROGMEM table of pointers to PROGMEM strings, declared with FLASH_STRING
+// entries. Both are read back with LPM and cost no SRAM at all.
+//
+//   FLASH_STRING(fooName0, "foo");
+//   FLASH_STRING(fooName1, "bar");
+//   static const char* const fooNames[2] PROGMEM = {fooName0, fooName1};
+//   out.print(flashTableString(fooNames, i));
+#define FLASH_STRING(name, text) static const char name[] PROGMEM = text
+
+// Entry i of a PROGMEM string table, as a flash address
+static inline PGM_P flashTableEntry(const char* const* table, uint8_t i) {
+    return (PGM_P)pgm_read_ptr(&table[i]);
+}
+
+// Entry i of a PROGMEM string table, for Print
+static inline const __FlashStringHelper* flashTableString(const char* const* table, uint8_t i) {
+    return reinterpret_cast<const __FlashStringHelper*>(flashTableEntry(table, i));
+}
+
+// Index of a RAM string in a PROGMEM string table, or -1
+static inline int8_t flashTableFind(const char* const* table, uint8_t count, const char* word) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp_P(word, flashTableEntry(table, i)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#endif
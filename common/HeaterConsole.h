@@ -0,0 +1,585 @@
+#ifndef HEATER_CONSOLE_H
+#define HEATER_CONSOLE_H
+
+#include <Arduino.h>
+#include <string.h>
+#include "FixedPoint.h"
+#include "FlashString.h"
+#include "HeaterFsm.h"
+#include "HeaterSettings.h"
+#include "HistoryLog.h"
+#include "Profiler.h"
+#include "SampleClock.h"
+#include "Scheduler.h"
+#include "SensorReading.h"
+
+// ====== SERIAL COMMAND CONSOLE ======
+// Line commands for tuning and servicing a running controller, one per
+// line, words separated by spaces, case-insensitive:
+//
+//   help                     list the commands
+//   get [name]               print the thresholds (all, or one)
+//   set <name> <value>       change a setting; saved to EEPROM
+//                            names: target hyst overheat start release (°C,
+//                            two decimals), stab (ms) and kp ki kd (PID
+//                            gains, 0..127.996, three decimals: get
+//                            prints them exactly as set takes them)
+//   state [zone] <state>     force a state: idle heating stabilizing
+//                            target overheat fault (tune: as below)
+//   tune [zone] | tune stop  relay autotune at the target, or abandon it;
+//                            "tune done" (gains, hyst and stab saved to
+//                            EEPROM) or "tune failed" follows when it ends
+//   reset [zone]             manual reset: OVERHEAT -> IDLE, once the zone
+//                            is below overheatTemp
+//   stats                    uptime, worst latency, sampling clock (rate in
+//                            Hz, worst jitter in µs, missed samples; "off"
+//                            when the sensor is not clocked), task lateness,
+//                            zones
+//                            (a faulted zone also shows why: read missing
+//                            range slew stuck stale; "guard" while the
+//                            overheat guard holds its heater off)
+//   profile                  TLM_PROFILE report (HEATER_PROFILING builds)
+//   log [saved]              dump the history log, or its copy in EEPROM
+//                            from the last OVERHEAT (see HistoryLog.h)
+//
+// Replies are "ok", "err <reason>" or the requested values. A log dump is
+// "log ram|saved <bytes> <counts per °C>", then "h <hex>" lines of CONSOLE_DUMP_BYTES
+// bytes, then "log end"; tools/telemetry_decode.py decodes it.
+//
+// service() is called from the serial task. It takes at most
+// CONSOLE_BYTES_PER_CALL bytes from the RX buffer into a fixed line
+// buffer, with no String, no heap and no waiting for the rest of a line,
+// and it runs at most one command or prints one reply line per call.
+// Multi-line replies continue on the following calls, and only when the
+// output has room for a whole line, so the console never blocks and costs
+// the control loop one short burst of work per call. set may reprogram
+// the sensors' thermostat (see HeaterController::applySettings()).
+//
+// Out is where replies go: SerialConsoleOut (text builds) or
+// TelemetryTextPrint (binary builds, see Telemetry.h). It is a Print with
+// a bool ready() that is true when a line of CONSOLE_LINE_MAX characters
+// can be written without blocking.
+
+const uint8_t CONSOLE_LINE_MAX = 24;       // Longest command line
+const uint8_t CONSOLE_BYTES_PER_CALL = 8;  // RX bytes taken per service()
+const uint8_t CONSOLE_MAX_WORDS = 3;
+const uint8_t CONSOLE_DUMP_BYTES = 10;     // Log bytes per dump line
+
+// Setting names for get/set
+const uint8_t CONSOLE_SETTING_COUNT = 9;
+FLASH_STRING(consoleSetting0, "target");
+FLASH_STRING(consoleSetting1, "hyst");
+FLASH_STRING(consoleSetting2, "overheat");
+FLASH_STRING(consoleSetting3, "start");
+FLASH_STRING(consoleSetting4, "release");
+FLASH_STRING(consoleSetting5, "stab");
+FLASH_STRING(consoleSetting6, "kp");
+FLASH_STRING(consoleSetting7, "ki");
+FLASH_STRING(consoleSetting8, "kd");
+static const char* const consoleSettingNames[CONSOLE_SETTING_COUNT] PROGMEM = {
+    consoleSetting0, consoleSetting1, consoleSetting2, consoleSetting3, consoleSetting4, consoleSetting5,
+    consoleSetting6, consoleSetting7, consoleSetting8};
+// Names for the state command, in HeaterState order
+FLASH_STRING(consoleState0, "idle");
+FLASH_STRING(consoleState1, "heating");
+FLASH_STRING(consoleState2, "stabilizing");
+FLASH_STRING(consoleState3, "target");
+FLASH_STRING(consoleState4, "overheat");
+FLASH_STRING(consoleState5, "fault");
+FLASH_STRING(consoleState6, "tune");
+static const char* const consoleStateNames[HEATER_STATE_COUNT] PROGMEM = {
+    consoleState0, consoleState1, consoleState2, consoleState3, consoleState4, consoleState5, consoleState6};
+// Why a zone is in SENSOR_FAULT, in SensorStatus order
+FLASH_STRING(consoleFault0, "none");
+FLASH_STRING(consoleFault1, "ok");
+FLASH_STRING(consoleFault2, "read");
+FLASH_STRING(consoleFault3, "missing");
+FLASH_STRING(consoleFault4, "range");
+FLASH_STRING(consoleFault5, "slew");
+FLASH_STRING(consoleFault6, "stuck");
+FLASH_STRING(consoleFault7, "stale");
+static const char* const consoleFaultNames[SENSOR_STATUS_COUNT] PROGMEM = {
+    consoleFault0, consoleFault1, consoleFault2, consoleFault3, consoleFault4, consoleFault5, consoleFault6,
+    consoleFault7};
+// help, one command per line
+const uint8_t CONSOLE_HELP_LINES = 8;
+FLASH_STRING(consoleHelp0, "get [name]");
+FLASH_STRING(consoleHelp1, "set <name> <value>");
+FLASH_STRING(consoleHelp2, "state [zone] <state>");
+FLASH_STRING(consoleHelp3, "reset [zone]");
+FLASH_STRING(consoleHelp4, "tune [zone]|stop");
+FLASH_STRING(consoleHelp5, "stats");
+FLASH_STRING(consoleHelp6, "profile");
+FLASH_STRING(consoleHelp7, "log [saved]");
+static const char* const consoleHelp[CONSOLE_HELP_LINES] PROGMEM = {
+    consoleHelp0, consoleHelp1, consoleHelp2, consoleHelp3, consoleHelp4, consoleHelp5, consoleHelp6, consoleHelp7};
+
+// Parses a decimal temperature such as "42", "-5.5" or "37.25" into
+// Q8.8, rounded to nearest. Digits past the second decimal are ignored.
+static inline bool parseTempQ8(const char* text, TempQ8& temp) {
+    bool negative = *text == '-';
+    if (negative || *text == '+') {
+        text++;
+    }
+    int32_t whole = 0;
+    uint8_t digits = 0;
+    for (; *text >= '0' && *text <= '9'; text++, digits++) {
+        whole = whole * 10 + (*text - '0');
+        if (whole > 127) {
+            return false;
+        }
+    }
+    uint16_t fraction = 0, scale = 1;
+    if (*text == '.') {
+        for (text++; *text >= '0' && *text <= '9'; text++, digits++) {
+            if (scale < 100) {
+                fraction = fraction * 10 + (*text - '0');
+                scale *= 10;
+            }
+        }
+    }
+    if (*text != '\0' || digits == 0) {
+        return false;
+    }
+    int32_t value = (whole << TEMP_Q8_SHIFT) + (((int32_t)fraction << TEMP_Q8_SHIFT) + scale / 2) / scale;
+    temp = saturateQ8(negative ? -value : value);
+    return true;
+}
+
+// Parses a PID gain such as "40", "0.5" or "127.996" into Q8.8, rounded
+// to nearest. Three decimals tell every Q8.8 step apart; digits past them
+// are ignored. Gains are never negative and must fit int16_t.
+static inline bool parseGain(const char* text, int16_t& gain) {
+    int32_t whole = 0;
+    uint8_t digits = 0;
+    for (; *text >= '0' && *text <= '9'; text++, digits++) {
+        whole = whole * 10 + (*text - '0');
+        if (whole > 127) {
+            return false;
+        }
+    }
+    uint16_t fraction = 0, scale = 1;
+    if (*text == '.') {
+        for (text++; *text >= '0' && *text <= '9'; text++, digits++) {
+            if (scale < 1000) {
+                fraction = fraction * 10 + (*text - '0');
+                scale *= 10;
+            }
+        }
+    }
+    if (*text != '\0' || digits == 0) {
+        return false;
+    }
+    int32_t value = (whole << TEMP_Q8_SHIFT) + (((int32_t)fraction << TEMP_Q8_SHIFT) + scale / 2) / scale;
+    if (value > 0x7FFF) {
+        return false;
+    }
+    gain = (int16_t)value;
+    return true;
+}
+
+// Prints a Q8.8 gain with three decimals, rounded; parseGain() reads it
+// back to the same value. The largest, 0x7FFF, prints as 127.996.
+static inline void printGain(Print& out, int16_t gain) {
+    uint16_t thousandths = (uint16_t)((((uint32_t)gain & 0xFF) * 1000 + 128) >> TEMP_Q8_SHIFT);
+    out.print((int)(gain >> TEMP_Q8_SHIFT));
+    out.print('.');
+    if (thousandths < 100) {
+        out.print('0');
+    }
+    if (thousandths < 10) {
+        out.print('0');
+    }
+    out.print(thousandths);
+}
+
+static inline bool parseUnsigned(const char* text, uint32_t& value) {
+    if (*text == '\0') {
+        return false;
+    }
+    uint32_t result = 0;
+    for (; *text; text++) {
+        if (*text < '0' || *text > '9' || result > 99999999UL) {
+            return false;
+        }
+        result = result * 10 + (*text - '0');
+    }
+    value = result;
+    return true;
+}
+
+// Console output straight to a serial port (text telemetry builds)
+class SerialConsoleOut : public Print {
+public:
+    explicit SerialConsoleOut(HardwareSerial& serialPort) : port(serialPort) {}
+    size_t write(uint8_t c) { return port.write(c); }
+    bool ready() { return port.availableForWrite() >= CONSOLE_LINE_MAX + 2; }
+
+private:
+    HardwareSerial& port;
+};
+
+template <class Controller, class Store, class Log, class Sched, class Out>
+class HeaterConsole {
+public:
+    HeaterConsole(Controller& heaterController, Store& settingsStore, Log& historyLog, Sched& taskScheduler,
+                  Out& output)
+        : controller(heaterController), store(settingsStore), history(historyLog), scheduler(taskScheduler),
+          out(output), length(0), overflow(false), listing(LIST_NONE), listIndex(0), dumpSize(0), dumpFirst(0) {}
+
+    void service(Stream& in) {
+        if (!out.ready()) {
+            return;  // Keep replies whole; the RX buffer holds the input meanwhile
+        }
+        if (listing != LIST_NONE) {
+            if (listing == LIST_SAVED && !history.savedReady()) {
+                return;  // An EEPROM read would wait out the write in progress
+            }
+            listLine();
+            return;
+        }
+        AutotuneStatus outcome = controller.takeAutotuneOutcome();
+        if (outcome != AUTOTUNE_OFF) {
+            if (outcome == AUTOTUNE_DONE) {
+                store.save(controller.settings());
+            }
+            out.println(outcome == AUTOTUNE_DONE ? F("tune done") : F("tune failed"));
+            return;
+        }
+        for (uint8_t n = 0; n < CONSOLE_BYTES_PER_CALL && in.available() > 0; n++) {
+            if (take((char)in.read())) {
+                execute();
+                return;
+            }
+        }
+    }
+
+private:
+    enum Listing { LIST_NONE, LIST_HELP, LIST_SETTINGS, LIST_STATS, LIST_LOG, LIST_SAVED };
+
+    // Adds a byte to the line; true once a complete line is in the buffer
+    bool take(char c) {
+        if (c == '\r' || c == '\n') {
+            bool complete = length > 0 && !overflow;
+            if (overflow) {
+                out.println(F("err too long"));
+            }
+            line[length] = '\0';
+            length = 0;
+            overflow = false;
+            return complete;
+        }
+        if (c == '\b' || c == 0x7F) {
+            length = length > 0 ? length - 1 : 0;
+        } else if (length < CONSOLE_LINE_MAX) {
+            line[length++] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        } else {
+            overflow = true;
+        }
+        return false;
+    }
+
+    // Splits the line into words in place and runs the command
+    void execute() {
+        char* words[CONSOLE_MAX_WORDS];
+        uint8_t count = 0;
+        for (char* p = strtok(line, " \t"); p; p = strtok(0, " \t")) {
+            if (count == CONSOLE_MAX_WORDS) {
+                out.println(F("err args"));
+                return;
+            }
+            words[count++] = p;
+        }
+        if (count == 0) {
+            return;
+        }
+        const char* command = words[0];
+        if (strcmp_P(command, PSTR("help")) == 0) {
+            startListing(LIST_HELP);
+        } else if (strcmp_P(command, PSTR("get")) == 0) {
+            commandGet(count > 1 ? words[1] : 0);
+        } else if (strcmp_P(command, PSTR("set")) == 0 && count == 3) {
+            commandSet(words[1], words[2]);
+        } else if (strcmp_P(command, PSTR("state")) == 0 && count >= 2) {
+            commandState(count == 3 ? words[1] : 0, words[count - 1]);
+        } else if (strcmp_P(command, PSTR("reset")) == 0) {
+            commandReset(count > 1 ? words[1] : 0);
+        } else if (strcmp_P(command, PSTR("tune")) == 0) {
+            commandTune(count > 1 ? words[1] : 0);
+        } else if (strcmp_P(command, PSTR("stats")) == 0) {
+            startListing(LIST_STATS);
+        } else if (strcmp_P(command, PSTR("profile")) == 0) {
+            profileRequestReport();
+            out.println(profilingEnabled ? F("ok") : F("err not built"));
+        } else if (strcmp_P(command, PSTR("log")) == 0) {
+            commandLog(count > 1 ? words[1] : 0);
+        } else {
+            out.println(F("err command"));
+        }
+    }
+
+    void commandGet(const char* name) {
+        if (!name) {
+            startListing(LIST_SETTINGS);
+            return;
+        }
+        int8_t index = flashTableFind(consoleSettingNames, CONSOLE_SETTING_COUNT, name);
+        if (index < 0) {
+            out.println(F("err name"));
+            return;
+        }
+        printSetting(index);
+    }
+
+    void commandSet(const char* name, const char* text) {
+        int8_t index = flashTableFind(consoleSettingNames, CONSOLE_SETTING_COUNT, name);
+        if (index < 0) {
+            out.println(F("err name"));
+            return;
+        }
+        HeaterSettings settings = controller.settings();
+        TempQ8 temp = 0;
+        uint32_t ms = 0;
+        int16_t gain = 0;
+        bool parsed;
+        if (index == 5) {
+            parsed = parseUnsigned(text, ms);
+        } else if (index > 5) {
+            parsed = parseGain(text, gain);
+        } else {
+            parsed = parseTempQ8(text, temp);
+        }
+        if (!parsed) {
+            out.println(F("err value"));
+            return;
+        }
+        switch (index) {
+            case 0: settings.targetTemp = temp; break;
+            case 1: settings.hysteresis = temp; break;
+            case 2: settings.overheatTemp = temp; break;
+            case 3: settings.startTemp = temp; break;
+            case 4: settings.overheatReleaseTemp = temp; break;
+            case 5: settings.stabilizingTime = ms; break;
+            case 6: settings.pidKp = gain; break;
+            case 7: settings.pidKi = gain; break;
+            default: settings.pidKd = gain; break;
+        }
+        if (!controller.applySettings(settings)) {
+            out.println(F("err range"));
+            return;
+        }
+        store.save(settings);
+        out.println(F("ok"));
+    }
+
+    void commandState(const char* zoneText, const char* name) {
+        int8_t zone = parseZone(zoneText);
+        int8_t state = flashTableFind(consoleStateNames, HEATER_STATE_COUNT, name);
+        if (zone < 0 || state < 0) {
+            out.println(zone < 0 ? F("err zone") : F("err state"));
+            return;
+        }
+        if (state == AUTOTUNE) {
+            commandTune(zoneText);  // AUTOTUNE needs a tuner behind it
+            return;
+        }
+        controller.changeState(zone, (HeaterState)state);
+        out.println(F("ok"));
+    }
+
+    // The result arrives later, through service()
+    void commandTune(const char* zoneText) {
+        if (zoneText && strcmp_P(zoneText, PSTR("stop")) == 0) {
+            controller.stopAutotune();
+            out.println(F("ok"));
+            return;
+        }
+        int8_t zone = parseZone(zoneText);
+        if (zone < 0) {
+            out.println(F("err zone"));
+        } else if (!controller.startAutotune(zone)) {
+            out.println(F("err busy"));
+        } else {
+            out.println(F("ok"));
+        }
+    }
+
+    // The FSM leaves OVERHEAT by itself only below overheatReleaseTemp;
+    // this lets an operator clear it as soon as the zone is no longer over
+    // the limit (and the hardware line, if any, has released)
+    void commandReset(const char* zoneText) {
+        int8_t zone = parseZone(zoneText);
+        if (zone < 0) {
+            out.println(F("err zone"));
+        } else if (controller.state(zone) != OVERHEAT) {
+            out.println(F("err not overheat"));
+        } else if (controller.events(zone) & EV_OVERHEAT) {
+            out.println(F("err still hot"));
+        } else {
+            controller.changeState(zone, IDLE);
+            out.println(F("ok"));
+        }
+    }
+
+    void commandLog(const char* source) {
+        if (!source) {
+            dumpSize = history.size();
+            dumpFirst = history.oldestBlock();
+            startListing(LIST_LOG);
+        } else if (strcmp_P(source, PSTR("saved")) != 0) {
+            out.println(F("err source"));
+        } else if (!history.savedReady()) {
+            out.println(F("err busy"));
+        } else {
+            dumpSize = history.savedSize();
+            startListing(LIST_SAVED);
+        }
+    }
+
+    // Zone number, 0 if none was given, -1 if out of range
+    int8_t parseZone(const char* text) const {
+        if (!text) {
+            return 0;
+        }
+        uint32_t zone;
+        return parseUnsigned(text, zone) && zone < Controller::zoneCount() ? (int8_t)zone : -1;
+    }
+
+    void printSetting(uint8_t index) {
+        const HeaterSettings& settings = controller.settings();
+        out.print(flashTableString(consoleSettingNames, index));
+        out.print(' ');
+        switch (index) {
+            case 0: printTemp(out, settings.targetTemp); break;
+            case 1: printTemp(out, settings.hysteresis); break;
+            case 2: printTemp(out, settings.overheatTemp); break;
+            case 3: printTemp(out, settings.startTemp); break;
+            case 4: printTemp(out, settings.overheatReleaseTemp); break;
+            case 5: out.print((unsigned long)settings.stabilizingTime); break;
+            case 6: printGain(out, settings.pidKp); break;
+            case 7: printGain(out, settings.pidKi); break;
+            default: printGain(out, settings.pidKd); break;
+        }
+        out.println();
+    }
+
+    void startListing(Listing what) {
+        listing = what;
+        listIndex = 0;
+        listLine();
+    }
+
+    // Prints the next line of a multi-line reply
+    void listLine() {
+        uint16_t index = listIndex++;
+        uint16_t lines;
+        if (listing == LIST_HELP) {
+            lines = CONSOLE_HELP_LINES;
+            out.println(flashTableString(consoleHelp, index));
+        } else if (listing == LIST_SETTINGS) {
+            lines = CONSOLE_SETTING_COUNT;
+            printSetting(index);
+        } else if (listing == LIST_STATS) {
+            lines = 3 + scheduler.size() + Controller::zoneCount();
+            printStatsLine(index);
+        } else {
+            lines = 2 + (dumpSize + CONSOLE_DUMP_BYTES - 1) / CONSOLE_DUMP_BYTES;
+            printDumpLine(index, lines);
+        }
+        if (listIndex >= lines) {
+            listing = LIST_NONE;
+        }
+    }
+
+    // uptime, latency, sampling clock, one line per task, one line per zone
+    void printStatsLine(uint8_t index) {
+        if (index == 0) {
+            out.print(F("uptime "));
+            out.println(millis());
+        } else if (index == 1) {
+            out.print(F("latency us "));
+            out.println(controller.worstLatencyMicros());
+        } else if (index == 2) {
+            printClockLine();
+        } else if (index < 3 + scheduler.size()) {
+            const Task& task = scheduler.task(index - 3);
+            out.print(F("task "));
+            out.print(index - 3);
+            out.print(F(" late "));
+            out.print(task.maxLateness);
+            out.print(F(" over "));
+            out.println(task.overruns);
+        } else {
+            uint8_t zone = index - 3 - scheduler.size();
+            out.print(F("zone "));
+            out.print(zone);
+            out.print(' ');
+            printTemp(out, controller.temperature(zone));
+            out.print(' ');
+            out.print(flashTableString(consoleStateNames, controller.state(zone)));
+            if (controller.sensorFault(zone)) {
+                out.print(' ');
+                out.print(flashTableString(consoleFaultNames, controller.faultCause(zone)));
+            }
+            if (controller.overheatGuard(zone)) {
+                out.print(F(" guard"));
+            }
+            out.println();
+        }
+    }
+
+    void printClockLine() {
+        SampleClockStats clock = sampleClockStats();
+        out.print(F("clock "));
+        if (clock.rate == 0) {
+            out.println(F("off"));
+            return;
+        }
+        out.print(clock.rate);
+        out.print(F(" jitter "));
+        out.print(clock.jitter());
+        out.print(F(" missed "));
+        out.println(clock.missed);
+    }
+
+    // Header, hex lines, footer. The RAM dump runs while logging goes on;
+    // it is pinned to the oldest block at the start (see HistoryLog).
+    void printDumpLine(uint16_t index, uint16_t lines) {
+        if (index == 0) {
+            out.print(listing == LIST_LOG ? F("log ram ") : F("log saved "));
+            out.print(dumpSize);
+            out.print(' ');
+            out.println(Log::countsPerDegree());
+            return;
+        }
+        if (index == lines - 1) {
+            out.println(F("log end"));
+            return;
+        }
+        uint16_t start = (index - 1) * CONSOLE_DUMP_BYTES;
+        out.print(F("h "));
+        for (uint16_t i = start; i < dumpSize && i < start + CONSOLE_DUMP_BYTES; i++) {
+            uint8_t value = listing == LIST_LOG ? history.byteAt(i, dumpFirst) : history.savedByte(i);
+            if (value < 0x10) {
+                out.print('0');
+            }
+            out.print(value, HEX);
+        }
+        out.println();
+    }
+
+    Controller& controller;
+    Store& store;
+    Log& history;
+    Sched& scheduler;
+    Out& out;
+    char line[CONSOLE_LINE_MAX + 1];
+    uint8_t length;       // Characters in line
+    bool overflow;        // The current line is too long and will be dropped
+    Listing listing;      // Multi-line reply in progress
+    uint16_t listIndex;   // Its next line
+    uint16_t dumpSize;    // Bytes in the log being dumped
+    uint8_t dumpFirst;    // Its oldest block, for a RAM dump
+};
+
+#endif
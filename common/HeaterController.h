@@ -0,0 +1,670 @@
+#ifndef HEATER_CONTROLLER_H
+#define HEATER_CONTROLLER_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+#include "HeaterFsm.h"
+#include "HeaterSettings.h"
+#include "PidControl.h"
+#include "StabilityDetector.h"
+#include "SlopeEstimator.h"
+#include "SampleFilter.h"
+#include "SensorReading.h"
+#include "FastPin.h"
+#include "RelayAutotune.h"
+#include "Profiler.h"
+
+// ====== HEATER CONTROLLER ======
+// The heater state machine shared by every board variant. It is a template
+// over two policies and a zone count, so each build gets its own fully
+// inlined copy with no virtual calls and no runtime configuration:
+//
+//   Sensor - where samples come from. Must provide
+//              static void begin();
+//              static SensorReading poll(uint8_t zone);  // value + status,
+//                                                        // see SensorReading.h
+//            poll() must never block; see Tmp36Sensor.h and Lm75Sensor.h.
+//
+//   Config - thresholds, timing and pins as static constexpr members:
+//              TempQ8 targetTemp, hysteresis, overheatTemp
+//              TempQ8 startTemp            // IDLE -> HEATING below this
+//              TempQ8 overheatReleaseTemp  // OVERHEAT -> IDLE below this
+//              unsigned long stabilizingTime, maxSampleAge (milliseconds)
+//                                          // stabilizingTime is the longest
+//                                          // STABILIZING may last; the stability
+//                                          // detector usually ends it sooner
+//                                          // The thresholds and stabilizingTime
+//                                          // are only defaults: the controller
+//                                          // runs on a HeaterSettings copy that
+//                                          // begin() and applySettings() can
+//                                          // replace (see HeaterSettings.h)
+//              uint8_t heaterPin; int8_t ledPin (-1 for none); written
+//                through the port registers (FastPin.h)
+//              bool logTransitions         // print every state change
+//              ControlMode controlMode     // BANG_BANG or PID
+//              unsigned long controlPeriod // ms between evaluate() calls
+//              int16_t pidKp, pidKi, pidKd // Q8.8 gains, see PidControl.h;
+//                                          // defaults like the thresholds
+//              uint16_t pidWindow, relayMinSwitch (milliseconds)
+//              unsigned long stabilitySampleInterval (ms, divides 1000)
+//              TempQ8 stableSlope (°C/s), stableNoise (°C)
+//              uint8_t stabilityWindow, stabilityCount (samples)
+//              uint8_t sensorFaultCount, sensorRecoverCount (samples)
+//              TempQ8 maxSlewRate (°C/s, 0: off), slewMargin (°C)
+//              unsigned long sensorStuckTime (ms, 0: off)
+//              unsigned long overheatLookahead (ms, 0: off)
+//              unsigned long slopeSampleInterval (ms, divides 1000)
+//              uint8_t slopeWindow (samples: 4, 8 or 16)
+//              TempQ8 autotuneBand (°C, the relay's half-width)
+//            and optional policy types:
+//              OverheatInput: a hardware thermostat line that trips
+//              OVERHEAT without waiting for a sample (see
+//              OverheatInterrupt.h). It must provide
+//                static void begin(uint8_t heaterPin, uint8_t zones,
+//                                  TempQ8 tripTemp, TempQ8 releaseTemp);
+//                static void reprogram(TempQ8 tripTemp, TempQ8 releaseTemp);  // must not block
+//                static bool tripped();     // line asserted, or was since acknowledge()
+//                static void acknowledge();
+//              A tripped line puts every zone into OVERHEAT.
+//              TransitionLog: static void record(uint8_t zone,
+//                HeaterState from, HeaterState to), told of every state
+//                change (see HistoryLog.h).
+//              SampleFilter: conditioning for every good sample before the
+//                state machine sees it, one instance per zone (see
+//                SampleFilter.h). OVERHEAT is checked on its fast()
+//                output, so smoothing does not delay a trip.
+//            Derive it from HeaterConfigDefaults to inherit the optional ones.
+//
+//   Zones  - independent heater/sensor pairs on one board (1..8). Zone k's
+//            heater is on pin heaterPin + k and its sensor is Sensor zone k;
+//            every zone uses the same thresholds. The warning LED lights if
+//            any zone asks for it. Per-zone state is kept as one small array
+//            per field (struct of arrays) and flag bitmasks, so a pass over
+//            all zones touches each field contiguously.
+//
+// Sensor faults are caught on the sample path, so the reaction comes
+// within one sampling period. A reading is bad if the sensor says so
+// (read failed, no device, out of range) or if it is not physically
+// plausible: it moved more than maxSlewRate allows since the last good
+// one (plus slewMargin for quantisation and noise), or it has not moved
+// at all for sensorStuckTime while the heater was at full power. Bad
+// readings never reach the filter or the state machine. sensorFaultCount
+// bad readings in a row, or no good one for maxSampleAge, put the zone
+// into SENSOR_FAULT (heater off, LED on); sensorRecoverCount good ones in
+// a row let it restart from IDLE.
+//
+// The predictive overheat guard cuts the heater before the limit is
+// reached rather than after. A least-squares fit over the last
+// slopeWindow filtered samples (SlopeEstimator.h) gives dT/dt; while
+// temp + dT/dt * overheatLookahead is at or above overheatTemp, the
+// zone's heater stays off without leaving its state. It comes back once
+// the projection is a hysteresis below the limit. overheatLookahead is
+// the plant's lag from heater to sensor: the heat already on its way
+// still arrives after the cut. The real OVERHEAT check is unchanged
+// behind it.
+//
+// startAutotune() puts one zone into AUTOTUNE, where RelayAutotune.h
+// switches its heater around the target (directly, not through the relay
+// window) until it has measured the loop. The tuned gains, hysteresis and
+// stabilizingTime then replace the settings of every zone and the zone
+// goes back to IDLE; takeAutotuneOutcome() reports how it went, once. A
+// sensor fault or overheat aborts the tune like any other state.
+//
+// The sketch either calls sample(), evaluate() and actuate() from its
+// scheduler tasks, in that order, each of which covers every zone, or runs
+// update(), a single pass that does all three zone by zone. update() polls
+// zone k's sensor right before its state machine step, so a sensor that
+// reads in the background (the LM75 bank) has zone k+1's bus read running
+// while zone k is evaluated. The transition rules themselves are in
+// HeaterFsm.h.
+
+// ====== CONTROL MODES ======
+enum ControlMode {
+    BANG_BANG,  // Heater fully on in HEATING, off otherwise
+    PID         // PID duty in HEATING/STABILIZING/TARGET_REACHED, time-proportioned
+};
+
+// No hardware overheat line: OVERHEAT comes from the samples alone
+struct NoOverheatInput {
+    static void begin(uint8_t, uint8_t, TempQ8, TempQ8) {}
+    static void reprogram(TempQ8, TempQ8) {}
+    static bool tripped() { return false; }
+    static void acknowledge() {}
+};
+
+// No history log: state changes are not recorded
+struct NoTransitionLog {
+    static void record(uint8_t, HeaterState, HeaterState) {}
+};
+
+// Defaults for the optional Config members; a sketch's Config inherits
+// these and overrides what it needs
+struct HeaterConfigDefaults {
+    typedef NoOverheatInput OverheatInput;
+    typedef NoTransitionLog TransitionLog;  // Or a sketch struct feeding a HistoryLog
+    typedef NoFilter SampleFilter;          // Raw readings
+    static constexpr int8_t ledPin = -1;
+    static constexpr bool logTransitions = false;
+    static constexpr ControlMode controlMode = BANG_BANG;
+    static constexpr unsigned long controlPeriod = 50;
+    static constexpr int16_t pidKp = 40 * 256;       // 40 counts (16%) per °C
+    static constexpr int16_t pidKi = 256 / 2;        // 0.5 counts per °C·s
+    static constexpr int16_t pidKd = 256;            // 1 count per °C/min (60 per °C/s)
+    static constexpr uint16_t pidWindow = 2000;      // Relay window (ms)
+    static constexpr uint16_t relayMinSwitch = 100;  // Shortest relay pulse (ms)
+    // Adaptive STABILIZING: stable once the slope over a 1.6 s window
+    // stays under 0.02 °C/s and the spread under 0.25 °C for 5 samples
+    static constexpr unsigned long stabilitySampleInterval = 100;
+    static constexpr TempQ8 stableSlope = celsiusQ8(0.02);
+    static constexpr TempQ8 stableNoise = celsiusQ8(0.25);
+    static constexpr uint8_t stabilityWindow = 16;
+    static constexpr uint8_t stabilityCount = 5;
+    // Sensor fault detection: 3 bad readings in a row, 20 good to recover.
+    // A load does not move 10 °C/s, and a heater at full power moves any
+    // working sensor within 30 s.
+    static constexpr uint8_t sensorFaultCount = 3;
+    static constexpr uint8_t sensorRecoverCount = 20;
+    static constexpr TempQ8 maxSlewRate = celsiusQ8(10.0);
+    static constexpr TempQ8 slewMargin = celsiusQ8(2.0);
+    static constexpr unsigned long sensorStuckTime = 30000;
+    // Predictive overheat guard: off unless the sketch sets the plant's
+    // lag. The slope comes from a 16 s fit, long enough to span several
+    // steps of a 0.5 °C sensor near the target.
+    static constexpr unsigned long overheatLookahead = 0;
+    static constexpr unsigned long slopeSampleInterval = 1000;
+    static constexpr uint8_t slopeWindow = 16;
+    // Relay autotune: a 0.5 °C dead band keeps a 0.5 °C sensor from
+    // chattering the relay on one quantisation step
+    static constexpr TempQ8 autotuneBand = celsiusQ8(0.25);
+};
+
+template <class Sensor, class Config, uint8_t Zones = 1>
+class HeaterController {
+public:
+    static_assert(Zones >= 1 && Zones <= 8, "Zones is 1..8 (one bit per zone in the flag masks)");
+
+    HeaterController()
+        : thresholds(defaultSettings<Config>()), alarmMask(0), regulatingMask(0), heaterMask(0), faultMask(0),
+          referenceMask(0), guardMask(0), hardwareOverheat(false), tuneZone(0), tuneOutcome(AUTOTUNE_OFF),
+          worstLatency(0) {
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            currentState[zone] = IDLE;
+            stateStartTime[zone] = 0;
+            temp[zone] = 0;
+            sampleTime[zone] = 0;
+            sampleMicros[zone] = 0;
+            rawTemp[zone] = 0;
+            stuckSince[zone] = 0;
+            stuckValue[zone] = 0;
+            badSamples[zone] = 0;
+            goodSamples[zone] = 0;
+            faultCauses[zone] = SENSOR_OK;
+            dutyCommand[zone] = 0;
+            appliedDuty[zone] = 0;
+            lastStabilitySample[zone] = 0;
+            lastSlopeSample[zone] = 0;
+            guardRise[zone] = 0;
+        }
+    }
+
+    // Sets up the outputs (heaters off first) and the sensor, on the
+    // Config defaults or, if they are valid, the given settings (e.g. from
+    // SettingsStore::load())
+    void begin(const HeaterSettings& initial) {
+        if (initial.valid()) {
+            thresholds = initial;
+        }
+        begin();
+    }
+
+    void begin() {
+        // Latch low before the pin becomes an output, so it never glitches high
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            HeaterPins::write(zone, false);
+            HeaterPins::output(zone);
+        }
+        LedPin::clear();
+        LedPin::output();
+        static_assert(1000 % Config::stabilitySampleInterval == 0,
+                      "stabilitySampleInterval must divide one second");
+        static_assert(1000 % Config::slopeSampleInterval == 0, "slopeSampleInterval must divide one second");
+        Sensor::begin();
+        Config::OverheatInput::begin(Config::heaterPin, Zones, thresholds.overheatTemp, thresholds.overheatReleaseTemp);
+        unsigned long now = millis();
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            pid[zone].setGains(thresholds.pidKp, thresholds.pidKi, thresholds.pidKd);
+            sampleTime[zone] = now;
+            stuckSince[zone] = now;
+            lastSlopeSample[zone] = now;
+            changeState(zone, IDLE);
+        }
+    }
+
+    // Takes a new sample for every zone whose sensor has one
+    void sample() {
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            sampleZone(zone);
+        }
+    }
+
+    // Runs one state machine step for every zone
+    void evaluate() {
+        checkOverheatInput();
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            evaluateZone(zone);
+        }
+    }
+
+    // Drives every heater (the LED changes with the state, in evaluate())
+    void actuate() {
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            actuateZone(zone);
+        }
+    }
+
+    // One batched pass: sample, evaluate and actuate zone by zone, so the
+    // next zone's sensor read overlaps this zone's work
+    void update() {
+        checkOverheatInput();
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            sampleZone(zone);
+            evaluateZone(zone);
+            actuateZone(zone);
+        }
+    }
+
+    // Threshold conditions for a zone's latest sample, as HeaterFsm.h event bits
+    uint8_t events(uint8_t zone = 0) const {
+        if (faultMask & zoneBit(zone)) {
+            return EV_SENSOR_FAULT;
+        }
+        TempQ8 t = temp[zone];
+        return (t < thresholds.startTemp ? EV_BELOW_START : 0)
+             | (t >= thresholds.targetTemp ? EV_AT_TARGET : 0)
+             | (t < (TempQ8)(thresholds.targetTemp - thresholds.hysteresis) ? EV_BELOW_BAND : 0)
+             | (filter[zone].fast() >= thresholds.overheatTemp || hardwareOverheat ? EV_OVERHEAT : 0)
+             | (t < thresholds.overheatReleaseTemp ? EV_BELOW_RELEASE : 0)
+             | (settled(zone) ? EV_SETTLED : 0);
+    }
+
+    // STABILIZING is over once the detector reports a steady temperature,
+    // or at the latest after stabilizingTime
+    bool settled(uint8_t zone = 0) const {
+        return stability[zone].stable() || millis() - stateStartTime[zone] >= thresholds.stabilizingTime;
+    }
+
+    // Switches to new thresholds on the next evaluate(); every zone keeps
+    // its state. Rejects (returns false for) settings that fail valid().
+    // If the overheat limits change and there is a hardware overheat line,
+    // the sensors are reprogrammed too, in the background: nothing here
+    // waits for the bus, and the line keeps the old limits until then.
+    bool applySettings(const HeaterSettings& settings) {
+        if (!settings.valid()) {
+            return false;
+        }
+        bool limitsChanged = settings.overheatTemp != thresholds.overheatTemp
+                          || settings.overheatReleaseTemp != thresholds.overheatReleaseTemp;
+        thresholds = settings;
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            pid[zone].setGains(thresholds.pidKp, thresholds.pidKi, thresholds.pidKd);
+        }
+        if (limitsChanged) {
+            Config::OverheatInput::reprogram(thresholds.overheatTemp, thresholds.overheatReleaseTemp);
+        }
+        return true;
+    }
+
+    const HeaterSettings& settings() const { return thresholds; }
+
+    // Starts a relay autotune on a zone at the current target. Refused
+    // while a tune is running or the zone is in OVERHEAT or SENSOR_FAULT.
+    bool startAutotune(uint8_t zone = 0) {
+        if (zone >= Zones || tuner.running() || currentState[zone] == OVERHEAT || currentState[zone] == SENSOR_FAULT) {
+            return false;
+        }
+        tuneZone = zone;
+        tuner.begin(thresholds.targetTemp, Config::autotuneBand, millis());
+        changeState(zone, AUTOTUNE);
+        return true;
+    }
+
+    // Abandons a running tune; the zone restarts from IDLE
+    void stopAutotune() {
+        if (tuner.running()) {
+            changeState(tuneZone, IDLE);
+        }
+    }
+
+    bool autotuning() const { return tuner.running(); }
+    // AUTOTUNE_DONE or AUTOTUNE_FAILED once per finished tune, else AUTOTUNE_OFF
+    AutotuneStatus takeAutotuneOutcome() {
+        AutotuneStatus outcome = (AutotuneStatus)tuneOutcome;
+        tuneOutcome = AUTOTUNE_OFF;
+        return outcome;
+    }
+    const AutotuneResult& autotuneResult() const { return tuner.result(); }
+
+    // Changes a zone's state and records when it happened. Forcing the
+    // state a zone is already in restarts it (timers, PID).
+    void changeState(uint8_t zone, HeaterState newState) {
+        enterState(zone, newState, heaterStateActions(newState));
+    }
+
+    static constexpr uint8_t zoneCount() { return Zones; }
+    HeaterState state(uint8_t zone = 0) const { return (HeaterState)currentState[zone]; }
+    TempQ8 temperature(uint8_t zone = 0) const { return temp[zone]; }
+    // The last plausible reading as the sensor gave it, before the SampleFilter
+    TempQ8 rawTemperature(uint8_t zone = 0) const { return rawTemp[zone]; }
+    // Faulted zone, and the reading status that faulted it
+    bool sensorFault(uint8_t zone = 0) const { return (faultMask & zoneBit(zone)) != 0; }
+    SensorStatus faultCause(uint8_t zone = 0) const { return (SensorStatus)faultCauses[zone]; }
+    // dT/dt from the guard's fit (Q8.8 °C/s), and whether it holds the heater off
+    TempQ8 slope(uint8_t zone = 0) const { return slopes[zone].slope(slopeRate); }
+    bool overheatGuard(uint8_t zone = 0) const { return (guardMask & zoneBit(zone)) != 0; }
+    // Heater duty actually applied, 0 (off) .. 255 (fully on)
+    uint8_t heaterDuty(uint8_t zone = 0) const { return appliedDuty[zone]; }
+    bool heaterOn(uint8_t zone = 0) const { return (heaterMask & zoneBit(zone)) != 0; }
+    PidController& pidController(uint8_t zone = 0) { return pid[zone]; }
+    // Worst sample -> heater write time over all zones
+    unsigned long worstLatencyMicros() const { return worstLatency; }
+
+private:
+    typedef FastPinRange<Config::heaterPin, Zones> HeaterPins;  // Zone k on heaterPin + k
+    typedef FastPin<Config::ledPin> LedPin;
+    static constexpr uint8_t stabilityRate = 1000 / Config::stabilitySampleInterval;
+    static constexpr uint8_t slopeRate = 1000 / Config::slopeSampleInterval;
+    static uint8_t zoneBit(uint8_t zone) { return (uint8_t)(1 << zone); }
+
+    // Latches the hardware line for this pass, so every zone sees the
+    // same answer; a trip that has since cleared is seen exactly once
+    void checkOverheatInput() {
+        hardwareOverheat = Config::OverheatInput::tripped();
+        Config::OverheatInput::acknowledge();
+    }
+
+    void sampleZone(uint8_t zone) {
+        SensorReading reading = Sensor::poll(zone);
+        unsigned long now = millis();
+        if (reading.isNew()) {
+            uint8_t status = reading.ok() ? plausibility(zone, reading.value, now) : reading.status;
+            if (status == SENSOR_OK) {
+                temp[zone] = filter[zone].add(reading.value);
+                sampleTime[zone] = now;
+                sampleMicros[zone] = micros();
+                goodSample(zone);
+            } else {
+                badSample(zone, status);
+            }
+        }
+        if (now - sampleTime[zone] > Config::maxSampleAge) {
+            badSamples[zone] = Config::sensorFaultCount;  // Straight to a fault
+            badSample(zone, SENSOR_STALE);
+        }
+    }
+
+    // SENSOR_OK, or why a reading the sensor thinks is good cannot be.
+    // While faulted, the slew check follows the raw readings, so recovery
+    // needs them to agree with each other, not with the last good one.
+    uint8_t plausibility(uint8_t zone, TempQ8 raw, unsigned long now) {
+        uint8_t bit = zoneBit(zone);
+        uint8_t status = SENSOR_OK;
+        if (Config::maxSlewRate > 0 && (referenceMask & bit)) {
+            unsigned long elapsed = now - sampleTime[zone];
+            elapsed = elapsed > 60000 ? 60000 : elapsed;  // Keeps the product in range
+            int32_t allowed = Config::slewMargin + (int32_t)Config::maxSlewRate * (int32_t)elapsed / 1000;
+            int32_t step = (int32_t)raw - rawTemp[zone];
+            if (step > allowed || step < -allowed) {
+                status = SENSOR_IMPLAUSIBLE;
+            }
+        }
+        // Stuck: the same reading throughout sensorStuckTime at full power.
+        // A zone faulted that way stays faulted until the reading moves.
+        if ((faultMask & bit) && faultCauses[zone] == SENSOR_STUCK && raw == stuckValue[zone]) {
+            return SENSOR_STUCK;
+        }
+        if (raw != rawTemp[zone] || appliedDuty[zone] != 255) {
+            stuckSince[zone] = now;
+        } else if (Config::sensorStuckTime > 0 && now - stuckSince[zone] >= Config::sensorStuckTime) {
+            status = SENSOR_STUCK;
+            stuckValue[zone] = raw;
+        }
+        if (status == SENSOR_OK || (faultMask & bit)) {
+            rawTemp[zone] = raw;
+            referenceMask |= bit;
+        }
+        if (status != SENSOR_OK && (faultMask & bit)) {
+            sampleTime[zone] = now;  // Reference time for the next slew check
+        }
+        return status;
+    }
+
+    void goodSample(uint8_t zone) {
+        badSamples[zone] = 0;
+        uint8_t bit = zoneBit(zone);
+        if ((faultMask & bit) && ++goodSamples[zone] >= Config::sensorRecoverCount) {
+            faultMask &= ~bit;
+        }
+    }
+
+    void badSample(uint8_t zone, uint8_t status) {
+        goodSamples[zone] = 0;
+        if (badSamples[zone] < Config::sensorFaultCount) {
+            badSamples[zone]++;
+        }
+        uint8_t bit = zoneBit(zone);
+        if (badSamples[zone] >= Config::sensorFaultCount && !(faultMask & bit)) {
+            faultMask |= bit;
+            faultCauses[zone] = status;
+        }
+    }
+
+    // A single table lookup gives the next state and the outputs for it
+    // Outputs change only on a transition (enterState()); a pass that
+    // stays in its state just looks the events up, plus the PID update
+    // while regulating
+    void evaluateZone(uint8_t zone) {
+        if (currentState[zone] == STABILIZING) {
+            trackStability(zone);
+        }
+        if (Config::overheatLookahead > 0) {
+            guardOverheat(zone);
+        }
+        uint8_t entry = HeaterTransitions::lookup(currentState[zone], events(zone));
+        HeaterState next = (HeaterState)(entry & FSM_STATE_MASK);
+        if (next != currentState[zone]) {
+            enterState(zone, next, entry);
+        }
+        if (currentState[zone] == AUTOTUNE) {
+            autotuneZone(zone);
+        }
+        if (Config::controlMode == PID && (regulatingMask & zoneBit(zone))) {
+            dutyCommand[zone] = pid[zone].update(thresholds.targetTemp, temp[zone], Config::controlPeriod);
+        }
+    }
+
+    // The one place a state is entered: logs the transition and runs the
+    // new state's actions (FSM_ACTION_* bits), which replace the old one's
+    void enterState(uint8_t zone, HeaterState newState, uint8_t actions) {
+        HeaterState oldState = (HeaterState)currentState[zone];
+        if (newState != oldState) {
+            Config::TransitionLog::record(zone, oldState, newState);
+        }
+        if (oldState == AUTOTUNE && tuner.running()) {
+            tuner.abort();  // Left early: forced, overheat or sensor fault
+            tuneOutcome = AUTOTUNE_FAILED;
+        }
+        currentState[zone] = newState;
+        stateStartTime[zone] = millis();
+        if (newState == STABILIZING) {
+            stability[zone].reset(temp[zone]);
+            lastStabilitySample[zone] = stateStartTime[zone];
+        }
+
+        uint8_t bit = zoneBit(zone);
+        alarmMask = (actions & FSM_ACTION_ALARM) ? (alarmMask | bit) : (alarmMask & ~bit);
+        updateLed();
+        if (Config::controlMode == PID) {
+            bool regulate = (actions & FSM_ACTION_REGULATE) != 0;
+            if (regulate && !(regulatingMask & bit)) {
+                pid[zone].reset(temp[zone]);  // Bumpless start from IDLE/OVERHEAT
+            }
+            regulatingMask = regulate ? (regulatingMask | bit) : (regulatingMask & ~bit);
+            dutyCommand[zone] = 0;  // Until the first update in the new state
+        } else {
+            dutyCommand[zone] = (actions & FSM_ACTION_HEATER) ? 255 : 0;
+        }
+
+        if (Config::logTransitions) {
+            if (Zones > 1) {
+                Serial.print(F("Zone "));
+                Serial.print(zone);
+                Serial.print(F(": "));
+            }
+            Serial.print(F("State changed to: "));
+            printStateName(Serial, newState);
+            Serial.println();
+        }
+    }
+
+    // Drives a zone's heater and tracks the sensor -> actuator latency
+    void actuateZone(uint8_t zone) {
+        unsigned long now = millis();
+        uint8_t duty = dutyCommand[zone];
+        // Fail safe: never keep heating on a stale reading
+        if (now - sampleTime[zone] > Config::maxSampleAge) {
+            duty = 0;
+        }
+        // The line may trip between evaluate() and here; its ISR has
+        // already switched the heater off, so keep it off
+        if (Config::OverheatInput::tripped()) {
+            duty = 0;
+        }
+        // Heading for the limit faster than the heat already on its way allows
+        if (guardMask & zoneBit(zone)) {
+            duty = 0;
+        }
+        // Bang-bang and the autotune relay switch directly; PID duty is
+        // spread over the relay window
+        bool on = Config::controlMode == PID && currentState[zone] != AUTOTUNE ? output[zone].update(duty, now)
+                                                                                : duty != 0;
+        // Compared with the latch, not heaterMask, which an overheat ISR
+        // switching the pin off does not update
+        if (HeaterPins::isSet(zone) != on) {
+            HeaterPins::write(zone, on);
+        }
+        uint8_t bit = zoneBit(zone);
+        heaterMask = on ? (heaterMask | bit) : (heaterMask & ~bit);
+        appliedDuty[zone] = duty;
+
+        unsigned long latency = micros() - sampleMicros[zone];
+        if (latency > worstLatency) {
+            worstLatency = latency;
+        }
+        profileRecord(PROF_LATENCY, latency);
+    }
+
+    void updateLed() {
+        bool on = alarmMask != 0;
+        if (LedPin::isSet() != on) {
+            LedPin::write(on);
+        }
+    }
+
+    // Feeds the slope fit at its fixed rate and projects overheatLookahead
+    // ahead; the guard holds until the projection is a hysteresis below
+    // the limit
+    void guardOverheat(uint8_t zone) {
+        unsigned long now = millis();
+        if (now - lastSlopeSample[zone] >= Config::slopeSampleInterval) {
+            lastSlopeSample[zone] += Config::slopeSampleInterval;
+            slopes[zone].add(temp[zone]);
+            // The divisions run once per fit sample, not every pass
+            int32_t rise = (int32_t)slopes[zone].slope(slopeRate) * (int32_t)Config::overheatLookahead / 1000;
+            guardRise[zone] = rise > 0 ? saturateQ8(rise) : 0;
+        }
+        int32_t projected = (int32_t)temp[zone] + guardRise[zone];
+        uint8_t bit = zoneBit(zone);
+        if (projected >= thresholds.overheatTemp) {
+            guardMask |= bit;
+        } else if (projected < (int32_t)thresholds.overheatTemp - thresholds.hysteresis) {
+            guardMask &= ~bit;
+        }
+    }
+
+    // One relay step. The tuner's result replaces the gains, hysteresis
+    // and stabilizingTime; a tune that ends either way goes back to IDLE.
+    void autotuneZone(uint8_t zone) {
+        if (zone != tuneZone) {
+            changeState(zone, IDLE);  // Not the zone being tuned
+            return;
+        }
+        dutyCommand[zone] = tuner.update(temp[zone], millis()) ? 255 : 0;
+        if (tuner.running()) {
+            return;
+        }
+        if (tuner.status() == AUTOTUNE_DONE) {
+            const AutotuneResult& tuned = tuner.result();
+            HeaterSettings settings = thresholds;
+            settings.pidKp = tuned.kp;
+            settings.pidKi = tuned.ki;
+            settings.pidKd = tuned.kd;
+            settings.hysteresis = tuned.hysteresis;
+            settings.stabilizingTime = tuned.stabilizingTime;
+            tuneOutcome = applySettings(settings) ? AUTOTUNE_DONE : AUTOTUNE_FAILED;
+        } else {
+            tuneOutcome = AUTOTUNE_FAILED;
+        }
+        changeState(zone, IDLE);
+    }
+
+    // Feeds a zone's stability detector at its fixed sample rate
+    void trackStability(uint8_t zone) {
+        unsigned long now = millis();
+        if (now - lastStabilitySample[zone] >= Config::stabilitySampleInterval) {
+            lastStabilitySample[zone] += Config::stabilitySampleInterval;
+            stability[zone].add(temp[zone], Config::stableSlope, Config::stableNoise, stabilityRate);
+        }
+    }
+
+    HeaterSettings thresholds;              // Thresholds in use, shared by every zone
+
+    // Per-zone state, one array per field
+    uint8_t currentState[Zones];            // HeaterState, stored in a byte
+    unsigned long stateStartTime[Zones];    // millis() when the current state was entered
+    TempQ8 temp[Zones];                     // Latest sample, filtered
+    typename Config::SampleFilter filter[Zones];  // Raw samples -> temp
+    TempQ8 rawTemp[Zones];                  // Latest plausible raw reading (slew/stuck reference)
+    unsigned long stuckSince[Zones];        // millis() since which rawTemp has not moved at full power
+    TempQ8 stuckValue[Zones];               // The reading a stuck fault is waiting to see change
+    uint8_t badSamples[Zones];              // Bad readings in a row (saturates at sensorFaultCount)
+    uint8_t goodSamples[Zones];             // Good readings in a row while faulted
+    uint8_t faultCauses[Zones];             // SensorStatus that faulted the zone
+    unsigned long sampleTime[Zones];        // millis() of the latest sample
+    unsigned long sampleMicros[Zones];      // micros() of the latest sample
+    uint8_t dutyCommand[Zones];             // Heater duty requested by the FSM / PID
+    uint8_t appliedDuty[Zones];             // Duty after the stale-sample fail-safe
+    unsigned long lastStabilitySample[Zones];  // millis() of the last detector sample
+    PidController pid[Zones];
+    TimeProportionalOutput<Config::pidWindow, Config::relayMinSwitch> output[Zones];  // Duty -> relay on/off
+    StabilityDetector<Config::stabilityWindow, Config::stabilityCount> stability[Zones];
+    SlopeEstimator<Config::slopeWindow> slopes[Zones];  // Filtered samples -> dT/dt for the guard
+    unsigned long lastSlopeSample[Zones];   // millis() of the last sample given to slopes
+    TempQ8 guardRise[Zones];                // Rise still to come over overheatLookahead (>= 0)
+
+    // Per-zone flags, bit k for zone k
+    uint8_t alarmMask;                      // Warning LED requested by the FSM
+    uint8_t regulatingMask;                 // PID loop active in the current state
+    uint8_t heaterMask;                     // What was last written to the heater pins
+    uint8_t faultMask;                      // Sensor faulted
+    uint8_t referenceMask;                  // rawTemp holds a reading
+    uint8_t guardMask;                      // Overheat guard holding the heater off
+    bool hardwareOverheat;                  // OverheatInput tripped for this pass
+
+    RelayAutotune tuner;                    // One tune at a time, on tuneZone
+    uint8_t tuneZone;
+    uint8_t tuneOutcome;                    // AutotuneStatus not yet taken
+
+    unsigned long worstLatency;             // Worst sample -> heater write time (us)
+};
+
+#endif
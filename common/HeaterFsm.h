@@ -0,0 +1,125 @@
+#ifndef HEATER_FSM_H
+#define HEATER_FSM_H
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "FlashString.h"
+
+// ====== TABLE-DRIVEN HEATER STATE MACHINE ======
+// The transition rules live in one constexpr function, heaterTransition().
+// The compiler expands it into a state x event table in PROGMEM, so the
+// controller does one indexed flash read per cycle: evaluation time is the
+// same in every state, and adding states or rules grows the table, not the
+// code.
+//
+// An "event" is the set of threshold conditions that hold for the current
+// sample, packed into a bit mask. The controller computes it once per
+// sample; the table maps (state, mask) to the next state plus the output
+// actions of that state. The controller applies the actions only when the
+// state changes, so a pass that stays in its state writes no outputs.
+
+// ====== FSM STATES ======
+enum HeaterState {
+    IDLE,            // Waiting for temperature to drop
+    HEATING,         // Heater is on, trying to reach target temperature
+    STABILIZING,     // Temperature reached; waiting to stabilize
+    TARGET_REACHED,  // Temperature stable; heater off
+    OVERHEAT,        // Emergency state; heater off, warning LED on
+    SENSOR_FAULT,    // No trustworthy reading; heater off, warning LED on
+    AUTOTUNE         // Relay autotune drives the heater (see RelayAutotune.h)
+};
+const uint8_t HEATER_STATE_COUNT = 7;
+
+// State names in flash, indexed by HeaterState (see FlashString.h)
+FLASH_STRING(heaterStateName0, "IDLE");
+FLASH_STRING(heaterStateName1, "HEATING");
+FLASH_STRING(heaterStateName2, "STABILIZING");
+FLASH_STRING(heaterStateName3, "TARGET_REACHED");
+FLASH_STRING(heaterStateName4, "OVERHEAT");
+FLASH_STRING(heaterStateName5, "SENSOR_FAULT");
+FLASH_STRING(heaterStateName6, "AUTOTUNE");
+static const char* const heaterStateNames[HEATER_STATE_COUNT] PROGMEM = {
+    heaterStateName0, heaterStateName1, heaterStateName2, heaterStateName3,
+    heaterStateName4, heaterStateName5, heaterStateName6};
+
+// Prints the name of a state
+static inline void printStateName(Print& out, HeaterState state) {
+    if (state < HEATER_STATE_COUNT) {
+        out.print(flashTableString(heaterStateNames, state));
+    }
+}
+
+// ====== EVENT BITS ======
+// One bit per threshold condition on the current sample
+const uint8_t EV_BELOW_START = 0x01;    // temp < startTemp
+const uint8_t EV_AT_TARGET = 0x02;      // temp >= targetTemp
+const uint8_t EV_BELOW_BAND = 0x04;     // temp < targetTemp - hysteresis
+const uint8_t EV_OVERHEAT = 0x08;       // temp >= overheatTemp
+const uint8_t EV_BELOW_RELEASE = 0x10;  // temp < overheatReleaseTemp
+const uint8_t EV_SETTLED = 0x20;        // stabilizingTime has passed in this state
+const uint8_t EV_SENSOR_FAULT = 0x40;   // The zone's sensor is faulted (other bits meaningless)
+const uint8_t HEATER_EVENT_COUNT = 128; // Every combination of the bits above
+
+// ====== TABLE ENTRY LAYOUT ======
+const uint8_t FSM_STATE_MASK = 0x07;    // Bits 0-2: next state
+const uint8_t FSM_ACTION_REGULATE = 0x20; // PID mode: closed-loop control in the next state
+const uint8_t FSM_ACTION_HEATER = 0x40; // Heater on in the next state
+const uint8_t FSM_ACTION_ALARM = 0x80;  // Warning LED on in the next state
+
+// Next state for a state and event mask. A sensor fault wins from every
+// state, since no other condition can be trusted then, and OVERHEAT next;
+// otherwise each state reacts to the one condition it cares about. Once
+// the fault clears, SENSOR_FAULT restarts from IDLE. AUTOTUNE is only
+// entered on command and left by the controller when the tune ends; it
+// has no outputs of its own, the tuner switches the heater.
+constexpr uint8_t heaterNextState(uint8_t state, uint8_t events) {
+    return (events & EV_SENSOR_FAULT) ? SENSOR_FAULT
+         : (events & EV_OVERHEAT) ? OVERHEAT
+         : state == IDLE ? ((events & EV_BELOW_START) ? HEATING : IDLE)
+         : state == HEATING ? ((events & EV_AT_TARGET) ? STABILIZING : HEATING)
+         : state == STABILIZING ? ((events & EV_SETTLED) ? TARGET_REACHED : STABILIZING)
+         : state == TARGET_REACHED ? ((events & EV_BELOW_BAND) ? HEATING : TARGET_REACHED)
+         : state == SENSOR_FAULT ? IDLE
+         : state == AUTOTUNE ? AUTOTUNE
+         : ((events & EV_BELOW_RELEASE) ? IDLE : OVERHEAT);
+}
+
+// Output actions that belong to a state. HEATER is the bang-bang output;
+// in PID mode every state that holds the temperature at target regulates.
+constexpr uint8_t heaterStateActions(uint8_t state) {
+    return (state == HEATING ? FSM_ACTION_HEATER : 0)
+         | ((state == HEATING || state == STABILIZING || state == TARGET_REACHED) ? FSM_ACTION_REGULATE : 0)
+         | ((state == OVERHEAT || state == SENSOR_FAULT) ? FSM_ACTION_ALARM : 0);
+}
+
+// Complete table entry: next state plus its actions
+constexpr uint8_t heaterTransition(uint8_t state, uint8_t events) {
+    return heaterNextState(state, events) | heaterStateActions(heaterNextState(state, events));
+}
+
+// ====== COMPILE-TIME TABLE EXPANSION ======
+// There is no std::index_sequence on AVR, so build the index pack by hand:
+// MakeIndexList<N>::type is IndexList<0, 1, ..., N-1>.
+template <uint16_t... I> struct IndexList {};
+template <uint16_t N, uint16_t... I> struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+template <uint16_t... I> struct MakeIndexList<0, I...> { typedef IndexList<I...> type; };
+
+template <class Indices> struct TransitionTable;
+template <uint16_t... I>
+struct TransitionTable<IndexList<I...> > {
+    static const uint8_t entries[sizeof...(I)];
+
+    // Next state and actions for a state and event mask: one flash read
+    static uint8_t lookup(uint8_t state, uint8_t events) {
+        return pgm_read_byte(&entries[state * HEATER_EVENT_COUNT + events]);
+    }
+};
+template <uint16_t... I>
+const uint8_t TransitionTable<IndexList<I...> >::entries[sizeof...(I)] PROGMEM = {
+    heaterTransition(I / HEATER_EVENT_COUNT, I % HEATER_EVENT_COUNT)...
+};
+
+// The heater's table: HEATER_STATE_COUNT x HEATER_EVENT_COUNT bytes of flash
+typedef TransitionTable<MakeIndexList<HEATER_STATE_COUNT * HEATER_EVENT_COUNT>::type> HeaterTransitions;
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef HEATER_SETTINGS_H
+#define HEATER_SETTINGS_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+// ====== RUNTIME THRESHOLDS ======
+// The thresholds and PID gains the controller acts on, as plain data so
+// they can change while it runs (console, autotune) and be kept in EEPROM
+// (see SettingsStore.h). A sketch's Config members of the same names are
+// the power-up defaults, used when no stored record is found.
+struct HeaterSettings {
+    uint32_t stabilizingTime;    // ms, longest STABILIZING may last
+    TempQ8 targetTemp;
+    TempQ8 hysteresis;
+    TempQ8 overheatTemp;
+    TempQ8 startTemp;            // IDLE -> HEATING below this
+    TempQ8 overheatReleaseTemp;  // OVERHEAT -> IDLE below this
+    int16_t pidKp, pidKi, pidKd; // Q8.8, see PidControl.h
+
+    // Sane enough to run on: temperatures inside the sensors' -55..125 °C
+    // range (which also keeps targetTemp - hysteresis inside 16 bits),
+    // start and release points below the limits they belong to, and some
+    // STABILIZING time and no negative gain
+    bool valid() const {
+        return inRange(targetTemp) && inRange(overheatTemp) && inRange(startTemp) && inRange(overheatReleaseTemp)
+            && hysteresis >= 0 && hysteresis <= celsiusQ8(50.0)
+            && startTemp <= targetTemp && targetTemp < overheatTemp && overheatReleaseTemp < overheatTemp
+            && stabilizingTime > 0 && pidKp >= 0 && pidKi >= 0 && pidKd >= 0;
+    }
+
+    static bool inRange(TempQ8 t) { return t >= celsiusQ8(-55.0) && t <= celsiusQ8(125.0); }
+};
+
+// The compile-time thresholds and gains of a Config
+template <class Config>
+HeaterSettings defaultSettings() {
+    HeaterSettings settings;
+    settings.stabilizingTime = Config::stabilizingTime;
+    settings.targetTemp = Config::targetTemp;
+    settings.hysteresis = Config::hysteresis;
+    settings.overheatTemp = Config::overheatTemp;
+    settings.startTemp = Config::startTemp;
+    settings.overheatReleaseTemp = Config::overheatReleaseTemp;
+    settings.pidKp = Config::pidKp;
+    settings.pidKi = Config::pidKi;
+    settings.pidKd = Config::pidKd;
+    return settings;
+}
+
+#endif
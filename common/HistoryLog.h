@@ -0,0 +1,209 @@
+#ifndef HEATER_HISTORY_LOG_H
+#define HEATER_HISTORY_LOG_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "FixedPoint.h"
+#include "HeaterFsm.h"
+
+// ====== HISTORY LOG ======
+// The last few minutes of temperature and state changes, kept in RAM so
+// the lead-up to an OVERHEAT survives with no serial port attached. Fixed
+// size, no allocation. The history is a ring of HISTORY_BLOCK_SIZE-byte
+// blocks; when it is full the oldest block is dropped. Each block starts
+// with a keyframe that makes it decodable on its own:
+//
+//   uint32 time (ms) | int16 temperature (counts) | uint8 bits used
+//
+// followed by up to HISTORY_BLOCK_BITS bits of records, MSB first:
+//
+//   0                       sample, temperature unchanged
+//   1 0 s                   sample, temperature +1 count (s = 0) or -1 (s = 1)
+//   1 1 0 t[12]             sample, absolute temperature t (signed counts)
+//   1 1 1 z[3] o[3] n[3] d[7]   zone z went from state o to n, d ms after
+//                           the last sample (capped at 127)
+//
+// Temperatures are stored as counts of 2^CountShift Q8.8 steps: 1/16 °C
+// by default, 1/2 °C (CountShift 7) for a 9-bit LM75, so a steady sensor
+// really does read the same count every time. The keyframe is itself the
+// block's first sample. Samples are taken
+// every HISTORY_SAMPLE_PERIOD ms, so their times are implied by their
+// position; a block opened for a transition repeats the last sample, at
+// its original time. A steady temperature costs one bit per sample, so
+// the default 512 bytes keep about five minutes at 10 Hz; one that
+// changes by a count on every sample, three bits each, under two.
+//
+// Entering OVERHEAT starts a copy of the whole ring into EEPROM at
+// EepromBase (uint16 length, then the blocks, oldest first). service()
+// programs it one byte per call when the EEPROM is idle, like
+// SettingsStore, and writes the length last, so a torn copy reads back as
+// empty. tools/telemetry_decode.py decodes a dump.
+
+const uint8_t HISTORY_BLOCK_SIZE = 32;
+const uint8_t HISTORY_HEADER_SIZE = 7;
+const uint8_t HISTORY_BLOCK_BITS = (HISTORY_BLOCK_SIZE - HISTORY_HEADER_SIZE) * 8;
+const unsigned long HISTORY_SAMPLE_PERIOD = 100;  // ms, 10 Hz
+const uint16_t HISTORY_SAVED_NONE = 0xFFFF;       // Length of an empty EEPROM copy
+
+template <uint8_t CountShift = 4, uint8_t Blocks = 16, uint16_t EepromBase = 0x100>
+class HistoryLog {
+public:
+    static_assert(CountShift >= 4 && CountShift <= 8, "Counts are 1/16 °C to 1 °C (12-bit absolute records)");
+    static_assert(Blocks >= 2, "The ring needs at least two blocks");
+    static_assert(EepromBase + 2 + Blocks * HISTORY_BLOCK_SIZE <= E2END + 1, "The EEPROM copy does not fit");
+
+    HistoryLog()
+        : first(0), count(0), lastCounts(0), lastSampleTime(0), flushSize(0), flushFirst(0), flushIndex(0),
+          flushing(false) {}
+
+    // Logs one sample; call every HISTORY_SAMPLE_PERIOD ms
+    void sample(TempQ8 temp) {
+        int16_t counts = temp >> CountShift;
+        unsigned long now = millis();
+        int16_t delta = counts - lastCounts;
+        if (count == 0 || bitsUsed() + recordBits(delta) > HISTORY_BLOCK_BITS) {
+            lastCounts = counts;
+            lastSampleTime = now;
+            openBlock();
+            return;
+        }
+        if (delta == 0) {
+            putBits(0, 1);
+        } else if (delta == 1 || delta == -1) {
+            putBits(delta < 0 ? 0x5 : 0x4, 3);
+        } else {
+            putBits(0x6, 3);
+            putBits((uint16_t)counts & 0x0FFF, 12);
+        }
+        lastCounts = counts;
+        lastSampleTime = now;
+    }
+
+    // Logs a state change (Config::TransitionLog calls this). Entering
+    // OVERHEAT also starts the EEPROM copy.
+    void transition(uint8_t zone, HeaterState from, HeaterState to) {
+        if (count == 0 || bitsUsed() + 19 > HISTORY_BLOCK_BITS) {
+            openBlock();
+        }
+        unsigned long offset = millis() - lastSampleTime;
+        putBits(0x7, 3);
+        putBits(zone & 0x07, 3);
+        putBits((uint8_t)from & 0x07, 3);
+        putBits((uint8_t)to & 0x07, 3);
+        putBits(offset > 127 ? 127 : (uint8_t)offset, 7);
+        if (to == OVERHEAT) {
+            saveToEeprom();
+        }
+    }
+
+    // Starts copying the ring into EEPROM (restarts a copy in progress)
+    void saveToEeprom() {
+        flushFirst = first;
+        flushSize = (uint16_t)count * HISTORY_BLOCK_SIZE;
+        flushIndex = 0;
+        flushing = flushSize > 0;
+    }
+
+    // Advances the EEPROM copy by at most one byte; never blocks. The
+    // ring can keep filling meanwhile: the copy runs oldest block first
+    // and finishes a block far faster than logging fills the next one.
+    void service() {
+        // Length invalidated first, blocks, then the real length
+        while (flushing && eeprom_is_ready()) {
+            uint16_t step = flushIndex++;
+            uint16_t address;
+            uint8_t value;
+            if (step < 2) {
+                address = EepromBase + step;
+                value = 0xFF;
+            } else if (step < 2 + flushSize) {
+                uint16_t i = step - 2;
+                address = EepromBase + 2 + i;
+                value = byteAt(i, flushFirst);
+            } else {
+                uint8_t half = step - 2 - flushSize;
+                address = EepromBase + half;
+                value = half == 0 ? lowByte(flushSize) : highByte(flushSize);
+                flushing = half == 0;
+            }
+            uint8_t* cell = (uint8_t*)(uintptr_t)address;
+            if (eeprom_read_byte(cell) != value) {
+                eeprom_write_byte(cell, value);  // Starts the write and returns
+                return;
+            }
+        }
+    }
+
+    bool saving() const { return flushing; }
+
+    static constexpr uint8_t countsPerDegree() { return 256 >> CountShift; }
+
+    // The ring as a flat array of whole blocks, counted from block from.
+    // A reader that takes oldestBlock() once and reads oldest first gets
+    // a consistent copy while logging goes on (the copy to EEPROM does).
+    uint16_t size() const { return (uint16_t)count * HISTORY_BLOCK_SIZE; }
+    uint8_t oldestBlock() const { return first; }
+    uint8_t byteAt(uint16_t index, uint8_t from) const {
+        return blocks[(from + index / HISTORY_BLOCK_SIZE) % Blocks][index % HISTORY_BLOCK_SIZE];
+    }
+
+    // The EEPROM copy; read only while savedReady(), as a read waits out
+    // any EEPROM write in progress
+    bool savedReady() const { return !flushing && eeprom_is_ready(); }
+    uint16_t savedSize() const {
+        uint16_t size = eeprom_read_byte(cell(0)) | (uint16_t)eeprom_read_byte(cell(1)) << 8;
+        return size == HISTORY_SAVED_NONE || size > Blocks * HISTORY_BLOCK_SIZE ? 0 : size;
+    }
+    uint8_t savedByte(uint16_t index) const { return eeprom_read_byte(cell(2 + index)); }
+
+private:
+    static const uint8_t* cell(uint16_t offset) { return (const uint8_t*)(uintptr_t)(EepromBase + offset); }
+
+    static uint8_t recordBits(int16_t delta) { return delta == 0 ? 1 : (delta == 1 || delta == -1 ? 3 : 15); }
+
+    uint8_t current() const { return (first + count - 1) % Blocks; }
+    uint8_t bitsUsed() const { return blocks[current()][HISTORY_HEADER_SIZE - 1]; }
+
+    // New block keyed on the last sample; drops the oldest if full
+    void openBlock() {
+        if (count == Blocks) {
+            first = (first + 1) % Blocks;
+        } else {
+            count++;
+        }
+        uint8_t* block = blocks[current()];
+        block[0] = (uint8_t)lastSampleTime;
+        block[1] = (uint8_t)(lastSampleTime >> 8);
+        block[2] = (uint8_t)(lastSampleTime >> 16);
+        block[3] = (uint8_t)(lastSampleTime >> 24);
+        block[4] = lowByte(lastCounts);
+        block[5] = highByte(lastCounts);
+        block[6] = 0;
+        memset(block + HISTORY_HEADER_SIZE, 0, HISTORY_BLOCK_SIZE - HISTORY_HEADER_SIZE);
+    }
+
+    // Appends the low n bits of value, MSB first; the caller checked room
+    void putBits(uint16_t value, uint8_t n) {
+        uint8_t* block = blocks[current()];
+        uint8_t used = block[HISTORY_HEADER_SIZE - 1];
+        while (n--) {
+            if (value & (1u << n)) {
+                block[HISTORY_HEADER_SIZE + (used >> 3)] |= 0x80 >> (used & 7);
+            }
+            used++;
+        }
+        block[HISTORY_HEADER_SIZE - 1] = used;
+    }
+
+    uint8_t blocks[Blocks][HISTORY_BLOCK_SIZE];
+    uint8_t first;                 // Oldest block
+    uint8_t count;                 // Blocks in use
+    int16_t lastCounts;            // Last sample, 1/16 °C counts
+    unsigned long lastSampleTime;  // millis() of the last sample
+    uint16_t flushSize;            // Bytes being copied to EEPROM
+    uint8_t flushFirst;            // Oldest block when the copy started
+    uint16_t flushIndex;           // Next copy step
+    bool flushing;
+};
+
+#endif
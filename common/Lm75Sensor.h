@@ -0,0 +1,445 @@
+#ifndef HEATER_LM75_SENSOR_H
+#define HEATER_LM75_SENSOR_H
+
+#include <Arduino.h>
+#include "TwiMaster.h"
+#include "SampleClock.h"
+#include "FixedPoint.h"
+#include "SensorReading.h"
+
+// ====== LM75 SENSOR POLICY ======
+// LM75s on I²C, read through the interrupt-driven TWI master at 400 kHz.
+//
+// begin() scans Address..0x4F. Every LM75 that answers gets its register
+// pointer set to the temperature register, and the part keeps it latched,
+// so no later read needs a pointer write. Zone k is the k-th device found,
+// in address order. This runs once, from setup(), and blocks for well
+// under a millisecond.
+//
+// After that a single burst reads 2 bytes from every device back to back
+// (repeated START between devices, one STOP): 8 sensors take about 0.7 ms
+// of bus time instead of 3.8 ms at 100 kHz with a pointer write each. The
+// burst runs in the background. Each poll collects a finished burst, parks
+// the readings until their zone is polled, and starts the next burst, so
+// sampling never waits for the bus. A device that fails to answer (NACK,
+// bus error, timeout) reports SENSOR_READ_FAILED on its zone's next poll
+// instead of a made-up value, and is simply retried in the next burst. A
+// zone with no device found reports SENSOR_NOT_FOUND.
+//
+// When a whole burst fails (bus stuck or nobody answering), the next one
+// waits 2 ms, then 4, 8, ... up to LM75_MAX_BACKOFF, so a dead bus is not
+// hammered with timeouts and recoveries; the first good burst ends it.
+//
+// With SampleHz > 0 the bursts are paced by the hardware sampling clock
+// (SampleClock.h) instead: once a poll has collected a burst, the next
+// starts from the Timer1 interrupt at the next tick, so reads go out at a
+// fixed rate however late the sample task runs. A tick that finds the
+// last burst still uncollected (or the bus busy) is skipped and shows up
+// in the clock's missed count. The part converts about every 100 ms, so
+// rates much above 10 Hz mostly read the same conversion again.
+//
+// New thermostat limits at run time (requestAlarm(), from applySettings()
+// when a console set or a Modbus write changes them) are only recorded.
+// service() writes them between two bursts, one non-blocking transaction
+// per call, collected by twiPoll() like a burst, and then resumes the
+// bursts: with 8 devices that is 32 short writes spread over as many
+// sample task runs, and the sample task never waits for the bus.
+//
+// Part is the LM75-compatible variant on the bus (see below). Every one
+// keeps the temperature left-justified in its 16-bit register, MSB =
+// whole degrees, so decoding any resolution is the same Q8.8 copy with
+// the bits below it masked off. Parts with a choice (TMP75) power up at
+// Part::defaultBits, and setResolution() trades a zone's step size
+// against its conversion time afterwards.
+const uint8_t LM75_LAST_ADDRESS = 0x4F;
+const uint32_t LM75_BUS_CLOCK = 400000;  // Fast mode; the LM75 supports up to 400 kHz
+const uint8_t LM75_MAX_BACKOFF_SHIFT = 6;  // Longest retry wait: 2^6 = 64 ms
+
+// LM75 registers
+const uint8_t LM75_REG_TEMPERATURE = 0x00;
+const uint8_t LM75_REG_CONFIG = 0x01;
+const uint8_t LM75_REG_THYST = 0x02;
+const uint8_t LM75_REG_TOS = 0x03;
+// Config: comparator mode, OS active low, fault queue 1, converting
+const uint8_t LM75_CONFIG_COMPARATOR = 0x00;
+const uint8_t LM75_CONFIG_RESOLUTION_SHIFT = 5;  // TMP75 R1:R0, 9 + n bits
+
+// ====== SENSOR VARIANTS ======
+// The Part policy: the resolutions a part converts at, the config bits
+// that select one, how long a conversion takes at each, and the
+// resolution of its Tos/Thyst registers. All power up with config 0.
+
+// LM75 / LM75A: 9 bits (0.5 °C), about 10 conversions a second
+struct Lm75Part {
+    static constexpr uint8_t minBits = 9;
+    static constexpr uint8_t maxBits = 9;
+    static constexpr uint8_t defaultBits = 9;
+    static constexpr uint8_t limitBits = 9;
+    static uint8_t configBits(uint8_t) { return 0; }
+    static uint16_t conversionMillis(uint8_t) { return 100; }
+};
+
+// LM75B: 11 bits (0.125 °C) at the same rate; the limits stay 9-bit
+struct Lm75bPart : Lm75Part {
+    static constexpr uint8_t minBits = 11;
+    static constexpr uint8_t maxBits = 11;
+    static constexpr uint8_t defaultBits = 11;
+};
+
+// TMP75 (and TMP275/TMP175 in LM75 mode): 9 to 12 bits, each extra bit
+// halving the step (0.0625 °C at 12) and doubling the conversion time
+// (27.5 ms at 9, 220 ms at 12). The limits take 12 bits.
+template <uint8_t Bits = 12>
+struct Tmp75Part {
+    static_assert(Bits >= 9 && Bits <= 12, "A TMP75 converts at 9..12 bits");
+    static constexpr uint8_t minBits = 9;
+    static constexpr uint8_t maxBits = 12;
+    static constexpr uint8_t defaultBits = Bits;
+    static constexpr uint8_t limitBits = 12;
+    static uint8_t configBits(uint8_t bits) { return (uint8_t)((bits - 9) << LM75_CONFIG_RESOLUTION_SHIFT); }
+    static uint16_t conversionMillis(uint8_t bits) { return (uint16_t)((55u << (bits - 9)) / 2); }
+};
+
+template <uint8_t Address = 0x48, uint8_t Zones = 1, uint16_t SampleHz = 0, class Part = Lm75Part>
+struct Lm75Sensor {
+    static_assert(Zones >= 1 && Zones <= 8, "An I²C bus has room for 8 LM75s (0x48..0x4F)");
+    static_assert(Zones * 2 <= TWI_RX_BUFFER_SIZE, "A burst must fit the TWI receive buffer");
+    static_assert(SampleHz == 0 || (SampleHz >= 10 && SampleHz <= 100), "SampleHz is 0 (back to back) or 10..100");
+
+    static void begin() {
+        twiBegin(LM75_BUS_CLOCK);
+        discover();
+        for (uint8_t i = 0; i < Zones; i++) {
+            resolution[i] = Part::defaultBits;
+            if (i < deviceCount && Part::configBits(resolution[i]) != 0) {
+                configure(i);
+            }
+        }
+        fresh = 0;
+        failed = 0;
+        backoffShift = 0;
+        backingOff = false;
+        alarmPending = false;
+        alarmStep = 0;
+        if (SampleHz > 0) {
+            armed = false;
+            sampleClockBegin(SampleHz, tick);
+        }
+        nextBurst();
+    }
+
+    static SensorReading poll(uint8_t zone) {
+        service();
+        uint8_t bit = (uint8_t)(1 << zone);
+        if (fresh & bit) {
+            fresh &= ~bit;
+            return sensorReading(SENSOR_OK, readings[zone]);
+        }
+        if (failed & bit) {
+            failed &= ~bit;
+            return sensorReading(SENSOR_READ_FAILED);
+        }
+        return sensorReading(zone < deviceCount ? SENSOR_NO_SAMPLE : SENSOR_NOT_FOUND);
+    }
+
+    // Collects the background burst if it is finished and starts the next,
+    // or waits out the backoff after a lost burst. New limits go out
+    // between two bursts.
+    static void service() {
+        if (armed) {
+            return;  // The next tick starts the burst; the bus status is the last one's
+        }
+        TwiStatus status = twiPoll();  // Also handles the timeout and bus recovery
+        if (status == TWI_BUSY) {
+            return;
+        }
+        if (alarmStep > 0) {
+            // A limit write finished: the next one, or back to the bursts
+            alarmOk = alarmOk && status == TWI_DONE;
+            if (alarmStep < ALARM_STEPS * deviceCount) {
+                startAlarmStep();
+                return;
+            }
+            alarmStep = 0;
+            nextBurst();
+            return;
+        }
+        if (backingOff) {
+            if (millis() - lastBurst < (1UL << backoffShift)) {
+                return;
+            }
+            backingOff = false;  // The bus status is from the lost burst: skip it
+        } else if (status == TWI_READY) {
+            // No burst yet, or no device at all: that is no read error,
+            // each zone reports SENSOR_NOT_FOUND instead
+        } else if (!collect(status)) {
+            backingOff = true;
+            lastBurst = millis();
+            return;  // Next burst after the wait
+        }
+        if (alarmPending) {
+            // Between bursts: write the new limits before the next one
+            alarmPending = false;
+            if (deviceCount > 0) {
+                alarmOk = true;
+                startAlarmStep();
+                return;
+            }
+        }
+        nextBurst();
+    }
+
+    // Starts the next burst now, or lets the next clock tick start it
+    static void nextBurst() {
+        if (SampleHz > 0) {
+            armed = true;
+        } else {
+            startBurst();
+        }
+    }
+
+    // Timer1 interrupt: starts the burst a poll has asked for
+    static void tick() {
+        if (armed && startBurst()) {
+            armed = false;
+            sampleClockRecord();
+        }
+    }
+
+    // Takes the readings of a finished burst; false if every device was lost
+    static bool collect(TwiStatus status) {
+        uint8_t all = (uint8_t)((1 << deviceCount) - 1);
+        uint8_t lost = status == TWI_DONE ? twiFailedDevices() : all;
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            uint8_t bit = (uint8_t)(1 << i);
+            if (lost & bit) {
+                readErrors++;
+                failed |= bit;
+            } else {
+                readings[i] = registerToQ8(twiReadByte(2 * i), twiReadByte(2 * i + 1), resolution[i]);
+                fresh |= bit;
+            }
+        }
+        if (lost != all) {
+            backoffShift = 0;
+            return true;
+        }
+        backoffShift = backoffShift < LM75_MAX_BACKOFF_SHIFT ? backoffShift + 1 : backoffShift;
+        return false;
+    }
+
+    // Probes each address with a pointer write to the temperature register.
+    // Blocking; returns the number of LM75s found.
+    static uint8_t discover() {
+        const uint8_t temperatureRegister = LM75_REG_TEMPERATURE;
+        deviceCount = 0;
+        for (uint8_t address = Address; address <= LM75_LAST_ADDRESS && deviceCount < Zones; address++) {
+            if (writeRegister(address, &temperatureRegister, 1)) {
+                addresses[deviceCount++] = address;
+            }
+        }
+        return deviceCount;
+    }
+
+    // Programs every device's thermostat: OS (open drain, active low,
+    // comparator mode) asserts once the temperature exceeds tripTemp and
+    // releases below releaseTemp, with no help from the MCU. Both are
+    // rounded down to the part's limit steps (0.5 °C on an LM75). Keeps
+    // each zone's resolution and points the devices back at the
+    // temperature register afterwards. Blocking, for setup() only;
+    // returns false if any device did not take the settings.
+    static bool programAlarm(TempQ8 tripTemp, TempQ8 releaseTemp) {
+        armed = false;  // No tick may start a burst between the writes
+        twiWait();      // Let the running burst finish
+        alarmPending = false;
+        alarmStep = 0;
+        alarmTrip = tripTemp;
+        alarmRelease = releaseTemp;
+        bool ok = true;
+        for (uint8_t step = 0; step < ALARM_STEPS * deviceCount; step++) {
+            uint8_t bytes[3];
+            uint8_t length = alarmBytes(step, bytes);
+            ok = writeRegister(addresses[step / ALARM_STEPS], bytes, length) && ok;
+        }
+        nextBurst();
+        return ok;
+    }
+
+    // The same limits from the main loop: recorded here and written by
+    // service() between bursts, without blocking (see above). A request
+    // made while one is being written follows it.
+    static void requestAlarm(TempQ8 tripTemp, TempQ8 releaseTemp) {
+        pendingTrip = tripTemp;
+        pendingRelease = releaseTemp;
+        alarmPending = true;
+    }
+
+    // New limits requested or being written
+    static bool alarmBusy() { return alarmPending || alarmStep > 0; }
+    // Every device took the last limits that finished writing
+    static bool alarmWritten() { return alarmOk; }
+
+    // Converts zone at bits of resolution from now on, clamped to what the
+    // part offers. Finer steps cost conversion time on parts that have the
+    // choice (conversionMillis()); a reading is then up to that old, and a
+    // sample clock faster than it reads the same conversion again.
+    // Blocking, for setup() only; returns false if the zone has no device
+    // or it did not take the setting.
+    static bool setResolution(uint8_t zone, uint8_t bits) {
+        if (bits < Part::minBits) {
+            bits = Part::minBits;
+        } else if (bits > Part::maxBits) {
+            bits = Part::maxBits;
+        }
+        resolution[zone] = bits;
+        if (zone >= deviceCount) {
+            return false;
+        }
+        armed = false;
+        twiWait();
+        bool ok = configure(zone);
+        nextBurst();
+        return ok;
+    }
+
+    // Writes a device's config register (comparator mode, as above) with
+    // its zone's resolution bits, then points it back at the temperature
+    // register. Blocking.
+    static bool configure(uint8_t zone) {
+        const uint8_t config[] = {LM75_REG_CONFIG, (uint8_t)(LM75_CONFIG_COMPARATOR | Part::configBits(resolution[zone]))};
+        const uint8_t temperature = LM75_REG_TEMPERATURE;
+        bool ok = writeRegister(addresses[zone], config, sizeof(config));
+        return writeRegister(addresses[zone], &temperature, 1) && ok;
+    }
+
+    // Writes per device for new limits: Tos, Thyst, config, then the
+    // pointer back to the temperature register
+    static const uint8_t ALARM_STEPS = 4;
+
+    // The register write of one step of the limit sequence (device
+    // step / ALARM_STEPS); returns its length
+    static uint8_t alarmBytes(uint8_t step, uint8_t* bytes) {
+        const uint8_t fraction = lowByte(resolutionMask(Part::limitBits));
+        switch (step % ALARM_STEPS) {
+            case 0:
+            case 1: {
+                TempQ8 limit = step % ALARM_STEPS == 0 ? alarmTrip : alarmRelease;
+                bytes[0] = step % ALARM_STEPS == 0 ? LM75_REG_TOS : LM75_REG_THYST;
+                bytes[1] = highByte(limit);
+                bytes[2] = (uint8_t)(lowByte(limit) & fraction);
+                return 3;
+            }
+            case 2:
+                bytes[0] = LM75_REG_CONFIG;
+                bytes[1] = (uint8_t)(LM75_CONFIG_COMPARATOR | Part::configBits(resolution[step / ALARM_STEPS]));
+                return 2;
+            default:
+                bytes[0] = LM75_REG_TEMPERATURE;
+                return 1;
+        }
+    }
+
+    // Starts the next write of the limit sequence; returns immediately.
+    // The first takes the requested limits.
+    static void startAlarmStep() {
+        if (alarmStep == 0) {
+            alarmTrip = pendingTrip;
+            alarmRelease = pendingRelease;
+        }
+        uint8_t bytes[3];
+        uint8_t length = alarmBytes(alarmStep, bytes);
+        alarmOk = twiStart(addresses[alarmStep / ALARM_STEPS], bytes, length, 0) && alarmOk;
+        alarmStep++;
+    }
+
+    // One blocking register write (pointer byte first)
+    static bool writeRegister(uint8_t address, const uint8_t* bytes, uint8_t length) {
+        return twiStart(address, bytes, length, 0) && twiWait() == TWI_DONE;
+    }
+
+    // Reads 2 bytes from every device found; returns immediately
+    static bool startBurst() {
+        return deviceCount > 0 && twiStartBurst(addresses, deviceCount, 2);
+    }
+
+    static uint8_t sensorCount() { return deviceCount; }
+    static uint8_t address(uint8_t zone) { return addresses[zone]; }
+    static uint8_t resolutionBits(uint8_t zone) { return resolution[zone]; }
+    static uint16_t conversionMillis(uint8_t zone) { return Part::conversionMillis(resolution[zone]); }
+
+    /*
+      The LM75 sends temperature as a 9-bit two's complement number:
+      - The MSB contains the integer part.
+      - The LSB's most significant bit (bit 7) represents 0.5°C.
+      - The remaining 7 bits in LSB are unused and should be ignored.
+
+      Shifting MSB up by 8 and OR-ing in the LSB gives exactly Q8.8 °C,
+      so the only work left is masking off the 7 unused bits. Finer parts
+      fill the next LSB bits down (bit 4 is 1/16 °C at 12 bits), so they
+      only mask off fewer.
+    */
+    static TempQ8 registerToQ8(uint8_t msb, uint8_t lsb, uint8_t bits = 9) {
+        return (TempQ8)((((uint16_t)msb << 8) | lsb) & resolutionMask(bits));
+    }
+
+    // The register bits a bits-wide reading uses: 0xFF80 at 9 bits
+    static uint16_t resolutionMask(uint8_t bits) { return (uint16_t)(0xFFFFu << (16 - bits)); }
+
+    static unsigned int readErrors;  // Failed reads (NACK, bus error or timeout), all zones
+    static TempQ8 readings[Zones];   // Finished reads waiting for their zone's poll
+    static uint8_t fresh;            // Bit k: readings[k] not collected yet
+    static uint8_t failed;           // Bit k: zone k's last read failed, not reported yet
+    static uint8_t backoffShift;     // Retry wait after lost bursts: 2^shift ms (0: none)
+    static bool backingOff;          // Waiting before the next burst; the bus status is stale
+    static volatile bool armed;      // Clocked: the next tick starts a burst
+    static unsigned long lastBurst;  // millis() when the last lost burst ended
+    static TempQ8 pendingTrip;       // Limits requestAlarm() recorded
+    static TempQ8 pendingRelease;
+    static bool alarmPending;        // ... and not started writing yet
+    static TempQ8 alarmTrip;         // Limits being written
+    static TempQ8 alarmRelease;
+    static uint8_t alarmStep;        // Writes of the limit sequence started (0: none running)
+    static bool alarmOk;             // No write of the sequence has failed
+    static uint8_t addresses[Zones]; // Bus address of each zone's LM75
+    static uint8_t resolution[Zones]; // Bits each zone converts at
+    static uint8_t deviceCount;      // LM75s found by discover()
+};
+
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+unsigned int Lm75Sensor<Address, Zones, SampleHz, Part>::readErrors = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+TempQ8 Lm75Sensor<Address, Zones, SampleHz, Part>::readings[Zones];
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+uint8_t Lm75Sensor<Address, Zones, SampleHz, Part>::fresh = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+uint8_t Lm75Sensor<Address, Zones, SampleHz, Part>::failed = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+uint8_t Lm75Sensor<Address, Zones, SampleHz, Part>::backoffShift = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+bool Lm75Sensor<Address, Zones, SampleHz, Part>::backingOff = false;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+unsigned long Lm75Sensor<Address, Zones, SampleHz, Part>::lastBurst = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+TempQ8 Lm75Sensor<Address, Zones, SampleHz, Part>::pendingTrip = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+TempQ8 Lm75Sensor<Address, Zones, SampleHz, Part>::pendingRelease = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+bool Lm75Sensor<Address, Zones, SampleHz, Part>::alarmPending = false;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+TempQ8 Lm75Sensor<Address, Zones, SampleHz, Part>::alarmTrip = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+TempQ8 Lm75Sensor<Address, Zones, SampleHz, Part>::alarmRelease = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+uint8_t Lm75Sensor<Address, Zones, SampleHz, Part>::alarmStep = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+bool Lm75Sensor<Address, Zones, SampleHz, Part>::alarmOk = true;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+uint8_t Lm75Sensor<Address, Zones, SampleHz, Part>::addresses[Zones];
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+uint8_t Lm75Sensor<Address, Zones, SampleHz, Part>::deviceCount = 0;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+volatile bool Lm75Sensor<Address, Zones, SampleHz, Part>::armed = false;
+template <uint8_t Address, uint8_t Zones, uint16_t SampleHz, class Part>
+uint8_t Lm75Sensor<Address, Zones, SampleHz, Part>::resolution[Zones];
+
+#endif
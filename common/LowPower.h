@@ -0,0 +1,64 @@
+#ifndef HEATER_LOW_POWER_H
+#define HEATER_LOW_POWER_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include <avr/sleep.h>
+
+// ====== LOW-POWER IDLE ======
+// Once the scheduler has nothing due, loop() puts the CPU to sleep instead
+// of spinning. It sleeps in IDLE mode: the core clock stops but the
+// peripherals keep running, and any interrupt wakes it. The wake-ups come
+// from
+//   - the Timer0 overflow that drives millis(), every 1.024 ms
+//   - ADC conversion complete (AdcSampler.h, Project 1)
+//   - the Timer1 sampling clock tick (SampleClock.h, Project 2)
+//   - TWI bus events and the LM75 OS line (TwiMaster.h and
+//     OverheatInterrupt.h, Project 2)
+//   - the UART, while telemetry is going out or a command comes in
+// Because Timer0 never stops, millis() and micros() stay exact across
+// sleeps and every millis()-based timer (task releases, stateStartTime,
+// sample ages) works unchanged. The deeper modes stop Timer0 and the
+// UART, and the Uno has no 32 kHz crystal for Timer2 to keep time with,
+// so they are not used.
+//
+// lowPowerBegin() also stops the clocks of the peripherals a sketch does
+// not use, which saves current awake or asleep.
+
+// What lowPowerBegin() must leave powered besides Timer0 and the UART
+const uint8_t LOW_POWER_KEEP_ADC = 0x01;
+const uint8_t LOW_POWER_KEEP_TWI = 0x02;
+const uint8_t LOW_POWER_KEEP_TIMER1 = 0x04;  // The sampling clock (SampleClock.h)
+
+// Gates off SPI, Timer2, the analog comparator and, unless kept, Timer1,
+// the ADC and TWI. Call from setup() after the sensor has been started.
+static inline void lowPowerBegin(uint8_t keep) {
+    power_spi_disable();
+    if (!(keep & LOW_POWER_KEEP_TIMER1)) {
+        power_timer1_disable();
+    }
+    power_timer2_disable();
+    ACSR |= _BV(ACD);  // Analog comparator off
+    if (!(keep & LOW_POWER_KEEP_ADC)) {
+        ADCSRA &= ~_BV(ADEN);  // The ADC must be disabled before its clock is gated
+        power_adc_disable();
+    }
+    if (!(keep & LOW_POWER_KEEP_TWI)) {
+        power_twi_disable();
+    }
+    set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+// Sleeps until the next interrupt. sei() takes effect only after the
+// following instruction, so an interrupt arriving here still wakes the
+// sleep instead of being missed.
+static inline void lowPowerIdle() {
+    cli();
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+}
+
+#endif
@@ -0,0 +1,404 @@
+#ifndef HEATER_MODBUS_NODE_H
+#define HEATER_MODBUS_NODE_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <string.h>
+#include "FastPin.h"
+#include "FixedPoint.h"
+#include "HeaterSettings.h"
+
+// ====== MODBUS RTU NODE ======
+// Makes the controller one node of a fleet on an RS-485 bus: a Modbus RTU
+// slave on the UART (8E1) through a half-duplex transceiver (MAX485 or
+// similar, DE and /RE tied to one pin). A master polls each node's
+// temperatures and states and writes the thresholds, to one node or to
+// all of them at once by broadcast.
+//
+// Registers, 0-based as on the wire. Input registers (function 04):
+//   8 * zone + 0   temperature, Q8.8 °C (signed)
+//              1   state (HeaterState)
+//              2   heater duty, 0..255
+//              3   flags: 1 sensor fault, 2 overheat guard, 4 heater on
+//              4   why the zone is faulted (SensorStatus), 0 if it is not
+//              5-7 reserved, read 0
+//   256 + 0        zone count
+//         1, 2     uptime in seconds, high word first
+//         3        worst sensor -> heater latency, µs (65535 or more)
+//         4        frames dropped: bad CRC, parity or framing, or a gap
+// Holding registers (03 read, 06 write one, 16 write several), the
+// thresholds as the console's set names them:
+//   0 target, 1 hyst, 2 overheat, 3 start, 4 release (Q8.8 °C),
+//   5, 6 stab (ms, high word first), 7 kp, 8 ki, 9 kd (Q8.8, units as in
+//   PidControl.h: kd per °C/min)
+// A write is all or nothing: the written registers over the current
+// settings must pass HeaterSettings::valid(), or nothing changes and the
+// reply is exception 3. Accepted settings are saved to EEPROM, unless
+// they are what the node already has, so a master may repeat a broadcast
+// every poll cycle without wearing the EEPROM. Broadcasts (address 0) are
+// writes only and get no reply.
+//
+// The UART interrupts only move bytes: USART_RX_vect stores each byte
+// with its arrival time, USART_UDRE_vect feeds the reply out and
+// USART_TX_vect drops the driver enable once the last stop bit is on the
+// line, so the bus is free for the next node at once. None of them takes
+// more than a few microseconds, so a busy bus delays the sampling clock
+// and the control passes by no more than that. service(), from the
+// serial task, takes a frame once the line has been silent for 3.5
+// characters (1.75 ms above 19200 baud), checks it and queues the reply
+// without waiting: one frame per call. A reply starts 1.75..3.75 ms after
+// the request with a 2 ms serial task; a 5-register poll of one zone then
+// takes about 10 ms at 38400 baud, so one bus serves 32 nodes at three
+// polls a second each. RS-485 drives 32 standard unit loads; 1/8 unit
+// load transceivers allow the full 247 addresses.
+//
+// A write of a new overheat limit does not wait for the LM75 bus either:
+// HeaterController::applySettings() only records it, and the sample task
+// writes it to the sensors between two bursts, like the console's set.
+//
+// This header defines the USART_RX_vect, USART_UDRE_vect and
+// USART_TX_vect ISRs and takes over the UART, so the sketch must not use
+// Serial at all. Include it from exactly one translation unit (the sketch).
+
+const uint8_t MODBUS_MAX_REGISTERS = 16;  // Per read or write
+const uint8_t MODBUS_FRAME_MAX = 9 + 2 * MODBUS_MAX_REGISTERS;  // Longest frame: a 16-register write
+const uint8_t MODBUS_BROADCAST = 0;
+
+// Function codes
+const uint8_t MODBUS_READ_HOLDING = 0x03;
+const uint8_t MODBUS_READ_INPUT = 0x04;
+const uint8_t MODBUS_WRITE_SINGLE = 0x06;
+const uint8_t MODBUS_WRITE_MULTIPLE = 0x10;
+const uint8_t MODBUS_EXCEPTION = 0x80;  // Or'ed into the function code of an exception reply
+
+// Exception codes
+const uint8_t MODBUS_ILLEGAL_FUNCTION = 1;
+const uint8_t MODBUS_ILLEGAL_ADDRESS = 2;
+const uint8_t MODBUS_ILLEGAL_VALUE = 3;
+
+// Register map
+const uint8_t MODBUS_ZONE_STRIDE = 8;
+const uint8_t MODBUS_ZONE_TEMPERATURE = 0;
+const uint8_t MODBUS_ZONE_STATE = 1;
+const uint8_t MODBUS_ZONE_DUTY = 2;
+const uint8_t MODBUS_ZONE_FLAGS = 3;
+const uint8_t MODBUS_ZONE_FAULT = 4;
+const uint16_t MODBUS_NODE_BASE = 256;
+const uint8_t MODBUS_NODE_ZONES = 0;
+const uint8_t MODBUS_NODE_UPTIME = 1;
+const uint8_t MODBUS_NODE_LATENCY = 3;
+const uint8_t MODBUS_NODE_DROPPED = 4;
+const uint8_t MODBUS_SETTING_REGISTERS = 10;
+
+const uint8_t MODBUS_FLAG_FAULT = 0x01;
+const uint8_t MODBUS_FLAG_GUARD = 0x02;
+const uint8_t MODBUS_FLAG_HEATER = 0x04;
+
+// CRC-16/MODBUS (reflected 0xA001, init 0xFFFF), sent low byte first.
+// Running it over a frame and its CRC gives 0.
+static inline uint16_t modbusCrc(const volatile uint8_t* data, uint8_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+// ====== LINE STATE (shared with the ISRs) ======
+static volatile uint8_t modbusFrame[MODBUS_FRAME_MAX];  // The frame coming in, or the reply going out
+static volatile uint8_t modbusLength = 0;        // Bytes in modbusFrame
+static volatile uint8_t modbusTxIndex = 0;       // Next reply byte to send
+static volatile bool modbusSending = false;      // A reply is going out; input is ignored
+static volatile bool modbusHeld = false;         // service() has the frame; input is ignored
+static volatile bool modbusBroken = false;       // The frame had a parity/framing error, overflowed or a gap
+static volatile unsigned long modbusLastByte = 0;  // micros() when the last byte came in
+static unsigned long modbusGapMicros = 750;      // Longest gap inside a frame (1.5 characters)
+static unsigned long modbusIdleMicros = 1750;    // Silence that ends a frame (3.5 characters)
+static uint8_t modbusEnableMask[FAST_PORT_COUNT] = {0, 0, 0};  // The transceiver's DE pin, per port
+
+// Transmitter on or off. Port writes in the main line happen with
+// interrupts off, so they cannot race OverheatInterrupt.h's port masks.
+static inline void modbusDriver(bool on) {
+    uint8_t sreg = SREG;
+    cli();
+    if (on) {
+        PORTB |= modbusEnableMask[FAST_PORT_B];
+        PORTC |= modbusEnableMask[FAST_PORT_C];
+        PORTD |= modbusEnableMask[FAST_PORT_D];
+    } else {
+        PORTB &= ~modbusEnableMask[FAST_PORT_B];
+        PORTC &= ~modbusEnableMask[FAST_PORT_C];
+        PORTD &= ~modbusEnableMask[FAST_PORT_D];
+    }
+    SREG = sreg;
+}
+
+template <class Controller, class Store>
+class ModbusNode {
+public:
+    ModbusNode(Controller& heaterController, Store& settingsStore, uint8_t nodeAddress)
+        : controller(heaterController), store(settingsStore), address(nodeAddress), dropped(0) {}
+
+    // 8 data bits, even parity, 1 stop bit, double-speed baud generator;
+    // the transceiver starts out listening
+    void begin(unsigned long baud, uint8_t enablePin) {
+        memset(modbusEnableMask, 0, sizeof(modbusEnableMask));
+        modbusEnableMask[fastPinPort(enablePin)] = fastPinMask(enablePin);
+        modbusDriver(false);
+        pinMode(enablePin, OUTPUT);
+        unsigned long charMicros = 11000000UL / baud;
+        modbusGapMicros = baud > 19200 ? 750 : charMicros * 3 / 2;  // Fixed above 19200 (Modbus over serial line, 2.5.1.1)
+        modbusIdleMicros = baud > 19200 ? 1750 : charMicros * 7 / 2;
+        modbusLength = 0;
+        modbusSending = false;
+        modbusHeld = false;
+        UBRR0 = (uint16_t)((F_CPU / 8 + baud / 2) / baud - 1);
+        UCSR0A = _BV(U2X0);
+        UCSR0C = _BV(UPM01) | _BV(UCSZ01) | _BV(UCSZ00);
+        UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+    }
+
+    // Takes a finished frame, if there is one, and starts the reply
+    void service() {
+        if (modbusSending) {
+            return;
+        }
+        uint8_t sreg = SREG;
+        cli();
+        bool complete = modbusLength > 0 && micros() - modbusLastByte >= modbusIdleMicros;
+        modbusHeld = complete;
+        SREG = sreg;
+        if (!complete) {
+            return;
+        }
+        uint8_t reply = handle(modbusLength);
+        if (reply > 0) {
+            uint16_t crc = modbusCrc(modbusFrame, reply);
+            modbusFrame[reply++] = lowByte(crc);
+            modbusFrame[reply++] = highByte(crc);
+            modbusTxIndex = 0;
+            modbusLength = reply;
+            modbusSending = true;
+            modbusDriver(true);
+            UCSR0B |= _BV(UDRIE0);
+        } else {
+            modbusLength = 0;
+        }
+        modbusHeld = false;
+    }
+
+    // Frames dropped for a bad CRC, a parity or framing error or a gap
+    unsigned int droppedFrames() const { return dropped; }
+
+private:
+    static uint16_t word(uint8_t at) { return (uint16_t)((modbusFrame[at] << 8) | modbusFrame[at + 1]); }
+    static void putWord(uint8_t at, uint16_t value) {
+        modbusFrame[at] = highByte(value);
+        modbusFrame[at + 1] = lowByte(value);
+    }
+
+    // Runs a request; returns the reply length before its CRC, 0 for none
+    uint8_t handle(uint8_t length) {
+        if (modbusBroken || length < 4 || modbusCrc(modbusFrame, length) != 0) {
+            dropped++;
+            return 0;
+        }
+        uint8_t target = modbusFrame[0];
+        if (target != address && target != MODBUS_BROADCAST) {
+            return 0;  // Another node's request, or another node's reply
+        }
+        uint8_t function = modbusFrame[1];
+        uint8_t result;
+        switch (function) {
+            case MODBUS_READ_HOLDING:
+            case MODBUS_READ_INPUT:
+                result = length == 8 && target != MODBUS_BROADCAST ? read(function) : MODBUS_ILLEGAL_VALUE;
+                break;
+            case MODBUS_WRITE_SINGLE:
+                result = length == 8 ? write(word(2), 1, 4) : MODBUS_ILLEGAL_VALUE;
+                break;
+            case MODBUS_WRITE_MULTIPLE:
+                result = length == 9 + modbusFrame[6] && modbusFrame[6] == 2 * word(4) ? write(word(2), word(4), 7)
+                                                                                      : MODBUS_ILLEGAL_VALUE;
+                break;
+            default:
+                result = MODBUS_ILLEGAL_FUNCTION;
+                break;
+        }
+        if (target == MODBUS_BROADCAST) {
+            return 0;
+        }
+        if (result != 0) {
+            modbusFrame[1] = function | MODBUS_EXCEPTION;
+            modbusFrame[2] = result;
+            return 3;
+        }
+        if (function == MODBUS_WRITE_SINGLE || function == MODBUS_WRITE_MULTIPLE) {
+            return 6;  // Echo of the address, function, start register and value or count
+        }
+        return (uint8_t)(3 + modbusFrame[2]);
+    }
+
+    // Builds a read reply in place; returns 0 or an exception code
+    uint8_t read(uint8_t function) {
+        uint16_t start = word(2), count = word(4);
+        if (count == 0 || count > MODBUS_MAX_REGISTERS) {
+            return MODBUS_ILLEGAL_VALUE;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t value;
+            bool exists = function == MODBUS_READ_INPUT ? inputRegister(start + i, value)
+                                                        : settingRegister(controller.settings(), start + i, value);
+            if (!exists) {
+                return MODBUS_ILLEGAL_ADDRESS;
+            }
+            putWord(3 + 2 * i, value);
+        }
+        modbusFrame[2] = (uint8_t)(2 * count);
+        return 0;
+    }
+
+    // Writes count registers from start, values from frame offset at;
+    // returns 0 or an exception code
+    uint8_t write(uint16_t start, uint16_t count, uint8_t at) {
+        if (count == 0 || count > MODBUS_MAX_REGISTERS) {
+            return MODBUS_ILLEGAL_VALUE;
+        }
+        HeaterSettings settings = controller.settings();
+        for (uint16_t i = 0; i < count; i++) {
+            if (!writeSetting(settings, start + i, word(at + 2 * i))) {
+                return MODBUS_ILLEGAL_ADDRESS;
+            }
+        }
+        if (memcmp(&settings, &controller.settings(), sizeof(settings)) == 0) {
+            return 0;
+        }
+        if (!controller.applySettings(settings)) {
+            return MODBUS_ILLEGAL_VALUE;
+        }
+        store.save(settings);
+        return 0;
+    }
+
+    bool inputRegister(uint16_t reg, uint16_t& value) const {
+        if (reg >= MODBUS_NODE_BASE) {
+            uint32_t uptime = millis() / 1000;
+            unsigned long latency = controller.worstLatencyMicros();
+            switch (reg - MODBUS_NODE_BASE) {
+                case MODBUS_NODE_ZONES: value = Controller::zoneCount(); return true;
+                case MODBUS_NODE_UPTIME: value = (uint16_t)(uptime >> 16); return true;
+                case MODBUS_NODE_UPTIME + 1: value = (uint16_t)uptime; return true;
+                case MODBUS_NODE_LATENCY: value = latency > 0xFFFF ? 0xFFFF : (uint16_t)latency; return true;
+                case MODBUS_NODE_DROPPED: value = dropped; return true;
+                default: return false;
+            }
+        }
+        uint8_t zone = reg / MODBUS_ZONE_STRIDE;
+        if (zone >= Controller::zoneCount()) {
+            return false;
+        }
+        switch (reg % MODBUS_ZONE_STRIDE) {
+            case MODBUS_ZONE_TEMPERATURE: value = (uint16_t)controller.temperature(zone); break;
+            case MODBUS_ZONE_STATE: value = controller.state(zone); break;
+            case MODBUS_ZONE_DUTY: value = controller.heaterDuty(zone); break;
+            case MODBUS_ZONE_FLAGS:
+                value = (controller.sensorFault(zone) ? MODBUS_FLAG_FAULT : 0)
+                      | (controller.overheatGuard(zone) ? MODBUS_FLAG_GUARD : 0)
+                      | (controller.heaterOn(zone) ? MODBUS_FLAG_HEATER : 0);
+                break;
+            case MODBUS_ZONE_FAULT: value = controller.sensorFault(zone) ? controller.faultCause(zone) : 0; break;
+            default: value = 0; break;
+        }
+        return true;
+    }
+
+    static bool settingRegister(const HeaterSettings& settings, uint16_t reg, uint16_t& value) {
+        switch (reg) {
+            case 0: value = (uint16_t)settings.targetTemp; return true;
+            case 1: value = (uint16_t)settings.hysteresis; return true;
+            case 2: value = (uint16_t)settings.overheatTemp; return true;
+            case 3: value = (uint16_t)settings.startTemp; return true;
+            case 4: value = (uint16_t)settings.overheatReleaseTemp; return true;
+            case 5: value = (uint16_t)(settings.stabilizingTime >> 16); return true;
+            case 6: value = (uint16_t)settings.stabilizingTime; return true;
+            case 7: value = (uint16_t)settings.pidKp; return true;
+            case 8: value = (uint16_t)settings.pidKi; return true;
+            case 9: value = (uint16_t)settings.pidKd; return true;
+            default: return false;
+        }
+    }
+
+    static bool writeSetting(HeaterSettings& settings, uint16_t reg, uint16_t value) {
+        switch (reg) {
+            case 0: settings.targetTemp = (TempQ8)value; return true;
+            case 1: settings.hysteresis = (TempQ8)value; return true;
+            case 2: settings.overheatTemp = (TempQ8)value; return true;
+            case 3: settings.startTemp = (TempQ8)value; return true;
+            case 4: settings.overheatReleaseTemp = (TempQ8)value; return true;
+            case 5: settings.stabilizingTime = ((uint32_t)value << 16) | (settings.stabilizingTime & 0xFFFF); return true;
+            case 6: settings.stabilizingTime = (settings.stabilizingTime & 0xFFFF0000UL) | value; return true;
+            case 7: settings.pidKp = (int16_t)value; return true;
+            case 8: settings.pidKi = (int16_t)value; return true;
+            case 9: settings.pidKd = (int16_t)value; return true;
+            default: return false;
+        }
+    }
+
+    Controller& controller;
+    Store& store;
+    uint8_t address;       // 1..247
+    unsigned int dropped;  // Damaged frames
+};
+
+// ====== UART INTERRUPTS ======
+// A byte after 3.5 characters of silence starts a new frame; one after
+// more than 1.5 inside a frame breaks it. The status bits must be read
+// before UDR0.
+ISR(USART_RX_vect) {
+    uint8_t status = UCSR0A;
+    uint8_t data = UDR0;
+    unsigned long now = micros();
+    if (modbusSending || modbusHeld) {
+        return;
+    }
+    unsigned long gap = now - modbusLastByte;
+    modbusLastByte = now;
+    if (modbusLength == 0 || gap >= modbusIdleMicros) {
+        modbusLength = 0;
+        modbusBroken = false;
+    } else if (gap > modbusGapMicros) {
+        modbusBroken = true;
+    }
+    if (status & (_BV(FE0) | _BV(DOR0) | _BV(UPE0))) {
+        modbusBroken = true;
+    }
+    if (modbusLength < MODBUS_FRAME_MAX) {
+        modbusFrame[modbusLength++] = data;
+    } else {
+        modbusBroken = true;
+    }
+}
+
+// Once the last byte is in UDR0, TXC is cleared (the data register is
+// full, so it cannot set again before that byte's stop bit) and its
+// interrupt takes over from this one
+ISR(USART_UDRE_vect) {
+    UDR0 = modbusFrame[modbusTxIndex++];
+    if (modbusTxIndex >= modbusLength) {
+        UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0);
+        UCSR0B = (UCSR0B & ~_BV(UDRIE0)) | _BV(TXCIE0);
+    }
+}
+
+// The last stop bit is out: release the bus and listen again
+ISR(USART_TX_vect) {
+    modbusDriver(false);
+    UCSR0B &= ~_BV(TXCIE0);
+    modbusLength = 0;
+    modbusSending = false;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef HEATER_ONE_WIRE_BUS_H
+#define HEATER_ONE_WIRE_BUS_H
+
+#include <Arduino.h>
+#include "FastPin.h"
+#include "Crc8.h"
+
+// ====== 1-WIRE BUS ======
+// A bit-banged 1-Wire master at standard speed on one open-drain pin,
+// with an external 4.7 kΩ pull-up to 5 V. The pin's latch stays low, so
+// driving the line is just its DDR bit (FastPin output()/input()).
+//
+// Time slots follow Maxim's recommended timings and take 70 µs each, a
+// byte about 0.56 ms and a reset about 1 ms. A slot runs with interrupts
+// off, because an ISR stretching a write-1 pulse past 15 µs turns it into
+// a 0; a reset's long low pulse may stretch, so it does not. Callers
+// budget the rest: one reset or one byte per call keeps any single
+// blocking stretch near a millisecond.
+const uint8_t ONE_WIRE_SEARCH_ROM = 0xF0;
+const uint8_t ONE_WIRE_MATCH_ROM = 0x55;
+const uint8_t ONE_WIRE_SKIP_ROM = 0xCC;
+const uint8_t ONE_WIRE_ROM_SIZE = 8;  // Family code, 48-bit serial, CRC-8
+
+template <uint8_t Pin>
+struct OneWireBus {
+    typedef FastPin<Pin> Line;
+
+    // Latch low, line released
+    static void begin() {
+        Line::clear();
+        Line::input();
+    }
+
+    // Reset pulse; true if any device answered with a presence pulse. A
+    // line already held low (shorted, or a device stuck mid-slot) has no
+    // presence to see and reports none.
+    static bool reset() {
+        if (!Line::read()) {
+            return false;
+        }
+        Line::output();
+        delayMicroseconds(480);
+        uint8_t sreg = SREG;
+        cli();
+        Line::input();
+        delayMicroseconds(70);
+        bool present = !Line::read();
+        SREG = sreg;
+        delayMicroseconds(410);
+        return present;
+    }
+
+    static void writeBit(bool bit) {
+        uint8_t sreg = SREG;
+        cli();
+        Line::output();
+        delayMicroseconds(bit ? 6 : 60);
+        Line::input();
+        SREG = sreg;
+        delayMicroseconds(bit ? 64 : 10);
+    }
+
+    // A read slot; devices answer 0 by holding the line low through it
+    static bool readBit() {
+        uint8_t sreg = SREG;
+        cli();
+        Line::output();
+        delayMicroseconds(3);
+        Line::input();
+        delayMicroseconds(9);
+        bool bit = Line::read();
+        SREG = sreg;
+        delayMicroseconds(53);
+        return bit;
+    }
+
+    // Least significant bit first
+    static void writeByte(uint8_t value) {
+        for (uint8_t i = 0; i < 8; i++) {
+            writeBit(value & 1);
+            value >>= 1;
+        }
+    }
+
+    static uint8_t readByte() {
+        uint8_t value = 0;
+        for (uint8_t i = 0; i < 8; i++) {
+            value >>= 1;
+            if (readBit()) {
+                value |= 0x80;
+            }
+        }
+        return value;
+    }
+
+    // Search ROM (Maxim AN187): finds up to max devices, one 64-bit walk
+    // per device, and returns how many it found. IDs that fail their CRC
+    // are left out, and so are other families than family if it is not
+    // 0; those take none of the max slots. Blocking, about 14 ms per
+    // device on the line; for setup() only.
+    static uint8_t search(uint8_t (*roms)[ONE_WIRE_ROM_SIZE], uint8_t max, uint8_t family = 0) {
+        uint8_t rom[ONE_WIRE_ROM_SIZE] = {0};
+        int8_t lastDiscrepancy = -1;  // Highest bit where the last walk took the 0 branch
+        uint8_t found = 0;
+        while (found < max && reset()) {
+            writeByte(ONE_WIRE_SEARCH_ROM);
+            int8_t discrepancy = -1;
+            for (int8_t i = 0; i < 64; i++) {
+                bool bit = readBit();
+                bool complement = readBit();
+                if (bit && complement) {
+                    return found;  // Nobody left on this branch
+                }
+                uint8_t& bits = rom[i / 8];
+                uint8_t mask = (uint8_t)(1 << (i % 8));
+                bool direction = bit;
+                if (bit == complement) {  // Devices differ here
+                    direction = i < lastDiscrepancy ? (bits & mask) != 0 : i == lastDiscrepancy;
+                    if (!direction) {
+                        discrepancy = i;
+                    }
+                }
+                bits = direction ? (uint8_t)(bits | mask) : (uint8_t)(bits & ~mask);
+                writeBit(direction);
+            }
+            if (crc8(rom, ONE_WIRE_ROM_SIZE) == 0 && (family == 0 || rom[0] == family)) {
+                memcpy(roms[found++], rom, ONE_WIRE_ROM_SIZE);
+            }
+            if (discrepancy < 0) {
+                break;  // That was the last branch
+            }
+            lastDiscrepancy = discrepancy;
+        }
+        return found;
+    }
+};
+
+#endif
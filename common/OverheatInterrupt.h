@@ -0,0 +1,104 @@
+#ifndef HEATER_OVERHEAT_INTERRUPT_H
+#define HEATER_OVERHEAT_INTERRUPT_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include "FixedPoint.h"
+#include "FastPin.h"
+
+// ====== HARDWARE OVERHEAT LINE ======
+// A second, independent overheat path. The sensor's own thermostat output
+// (the LM75 OS pin: open drain, active low) goes to INT0 (pin 2) or INT1
+// (pin 3). Its falling edge runs the ISR below, which switches every
+// heater off and latches the trip within a few microseconds, however busy
+// loop() is or however late the next sample would be. The controller
+// turns the latch into OVERHEAT on its next pass and keeps the heaters off
+// until then (see OverheatInput in HeaterController.h).
+//
+// The OS pins of several LM75s can share one line (wired OR), so on a
+// multi-zone board a trip in any zone stops every zone.
+//
+// This header defines the INT0_vect and INT1_vect ISRs, so
+// attachInterrupt() must not be used on pins 2 and 3. Include it from
+// exactly one translation unit (the sketch).
+
+// ====== LINE STATE (shared with the ISR) ======
+static uint8_t overheatLinePin = 0;          // Pin the thermostat output is wired to
+static uint8_t overheatHeaterMask[FAST_PORT_COUNT] = {0, 0, 0};  // Heater pin bits per port
+static volatile bool overheatLatch = false;  // Set by the ISR, cleared by overheatAcknowledge()
+
+// Arms the interrupt on pin 2 (INT0) or 3 (INT1); the line idles high on
+// the internal pull-up. Calling it again (new thresholds) keeps a trip
+// that is still latched.
+static inline void overheatInterruptBegin(uint8_t linePin, uint8_t heaterPin, uint8_t zones) {
+    uint8_t interrupt = linePin == 3 ? INT1 : INT0;
+    overheatLinePin = linePin;
+    uint8_t masks[FAST_PORT_COUNT] = {0, 0, 0};
+    for (uint8_t zone = 0; zone < zones; zone++) {
+        masks[fastPinPort(heaterPin + zone)] |= fastPinMask(heaterPin + zone);
+    }
+    uint8_t sreg = SREG;
+    cli();
+    memcpy(overheatHeaterMask, masks, sizeof(masks));
+    SREG = sreg;
+    pinMode(linePin, INPUT_PULLUP);
+    // Falling edge: ISCn1 set, ISCn0 clear
+    uint8_t sense = interrupt == INT1 ? (_BV(ISC11) | _BV(ISC10)) : (_BV(ISC01) | _BV(ISC00));
+    EICRA = (EICRA & ~sense) | (interrupt == INT1 ? _BV(ISC11) : _BV(ISC01));
+    EIFR = _BV(interrupt == INT1 ? INTF1 : INTF0);  // Drop an edge seen while configuring
+    EIMSK |= _BV(interrupt);
+}
+
+// True while the line is asserted, and after a trip until acknowledged.
+// The level check also covers a sensor that is already over its limit at
+// power-up, which produces no edge.
+static inline bool overheatTripped() {
+    return overheatLatch || digitalRead(overheatLinePin) == LOW;
+}
+
+// Clears the latch once the line has been released
+static inline void overheatAcknowledge() {
+    if (digitalRead(overheatLinePin) == HIGH) {
+        overheatLatch = false;
+    }
+}
+
+// ====== LINE INTERRUPTS ======
+// Three and-masks on the output ports instead of a digitalWrite() per
+// zone: every heater is off a couple of microseconds after the edge, for
+// any zone count. The main line writes these ports only with sbi/cbi
+// (FastPin.h) or with interrupts off (digitalWrite()), so nothing can put
+// a stale value back over this read-modify-write.
+static inline void overheatTrip() {
+    PORTB &= ~overheatHeaterMask[FAST_PORT_B];
+    PORTC &= ~overheatHeaterMask[FAST_PORT_C];
+    PORTD &= ~overheatHeaterMask[FAST_PORT_D];
+    overheatLatch = true;
+}
+
+ISR(INT0_vect) { overheatTrip(); }
+ISR(INT1_vect) { overheatTrip(); }
+
+// ====== OVERHEAT INPUT POLICY ======
+// Config::OverheatInput for a sensor with a programmable thermostat output.
+// Sensor must provide static bool programAlarm(TempQ8 trip, TempQ8 release),
+// blocking for setup(), and static void requestAlarm(TempQ8 trip,
+// TempQ8 release), which writes new ones from the sample task without
+// blocking (Lm75Sensor does both). The thresholds are the controller's
+// own, so the line trips at overheatTemp and releases below
+// overheatReleaseTemp. If a sensor rejects them the sampled overheat
+// check still protects the zone.
+template <class Sensor, uint8_t LinePin = 2>
+struct ThermostatOverheatInput {
+    static_assert(LinePin == 2 || LinePin == 3, "The thermostat line must be on pin 2 (INT0) or pin 3 (INT1)");
+
+    static void begin(uint8_t heaterPin, uint8_t zones, TempQ8 tripTemp, TempQ8 releaseTemp) {
+        Sensor::programAlarm(tripTemp, releaseTemp);
+        overheatInterruptBegin(LinePin, heaterPin, zones);
+    }
+    static void reprogram(TempQ8 tripTemp, TempQ8 releaseTemp) { Sensor::requestAlarm(tripTemp, releaseTemp); }
+    static bool tripped() { return overheatTripped(); }
+    static void acknowledge() { overheatAcknowledge(); }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef HEATER_PID_CONTROL_H
+#define HEATER_PID_CONTROL_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+// ====== FIXED-POINT PID ======
+// Integer-only PID producing a heater duty of 0 (off) .. 255 (fully on).
+// Gains are Q8.8 and expressed in duty counts:
+//   kp - counts per °C of error
+//   ki - counts per °C of error per second
+//   kd - counts per °C/min of temperature rise
+// kd is per minute so that the slow loads this drives (a Td of minutes,
+// see RelayAutotune.h) still fit Q8.8; the rate saturates at 128 °C/min.
+// Internally everything is Q16.16 duty counts in int32_t. The derivative
+// acts on the measurement rather than the error, so setpoint changes do
+// not kick the output. Anti-windup: the integrator is clamped to the
+// output range and stops integrating while the output is saturated in the
+// direction the error is pushing.
+
+const int32_t PID_OUTPUT_MAX = 255L << 16;  // Full duty in Q16.16
+// Limit for each term before summing, so the sum cannot overflow int32_t
+const int32_t PID_TERM_LIMIT = 1024L << 16;
+
+static inline int32_t clampPid(int32_t value, int32_t low, int32_t high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+class PidController {
+public:
+    PidController() : kp(0), ki(0), kd(0), integral(0), remainder(0), lastTemp(0) {}
+
+    void setGains(int16_t newKp, int16_t newKi, int16_t newKd) {
+        kp = newKp;
+        ki = newKi;
+        kd = newKd;
+    }
+
+    // Clears the integrator; call when regulation starts so the first
+    // derivative step and the old integral do not bump the output
+    void reset(TempQ8 temp) {
+        integral = 0;
+        remainder = 0;
+        lastTemp = temp;
+    }
+
+    // One control step. dtMs is the time since the previous step and must
+    // be between 1 and 1000 ms.
+    uint8_t update(TempQ8 setpoint, TempQ8 temp, uint16_t dtMs) {
+        int32_t error = (int32_t)setpoint - temp;  // Q8.8 °C
+
+        int32_t p = clampPid((int32_t)kp * error, -PID_TERM_LIMIT, PID_TERM_LIMIT);
+
+        // Temperature rate in Q8.8 °C per minute, on the measurement; the
+        // step is clamped first so the product fits int32_t
+        int32_t rate = clampPid((int32_t)temp - lastTemp, -0x7FFF, 0x7FFF) * 60000 / dtMs;
+        lastTemp = temp;
+        int32_t d = clampPid(-(int32_t)kd * saturateQ8(rate), -PID_TERM_LIMIT, PID_TERM_LIMIT);
+
+        // ki * error is per second; scale to this step's dt, carrying the
+        // division remainder so small steady errors still integrate
+        int32_t perSecond = (int32_t)ki * error;
+        int32_t step = perSecond / 1000 * dtMs;
+        remainder += (perSecond % 1000) * dtMs;
+        step += remainder / 1000;
+        remainder %= 1000;
+        int32_t unclamped = p + integral + d;
+        bool pushingHigh = unclamped >= PID_OUTPUT_MAX && step > 0;
+        bool pushingLow = unclamped <= 0 && step < 0;
+        if (!pushingHigh && !pushingLow) {
+            integral = clampPid(integral + step, 0, PID_OUTPUT_MAX);
+        }
+
+        int32_t out = clampPid(p + integral + d, 0, PID_OUTPUT_MAX);
+        return (uint8_t)(out >> 16);
+    }
+
+    int16_t proportionalGain() const { return kp; }
+    int16_t integralGain() const { return ki; }
+    int16_t derivativeGain() const { return kd; }
+
+private:
+    int16_t kp, ki, kd;  // Q8.8 gains
+    int32_t integral;    // Q16.16 duty counts
+    int32_t remainder;   // Integration remainder, in 1/1000 Q16.16 counts
+    TempQ8 lastTemp;     // Previous measurement, for the derivative
+};
+
+// ====== TIME-PROPORTIONED OUTPUT ======
+// Turns a 0..255 duty into on/off time inside a fixed window, for relays
+// and SSRs on pins without hardware PWM (the heater is on pin 8, which has
+// none on the Uno). The on-time is latched when a window starts, so a duty
+// that moves every control step still gives at most one pulse per window.
+// Pulses shorter than MinSwitchMs are skipped or merged so the relay is
+// never chattered. Duty 0 switches off at once and for the rest of the
+// window (fail-safe, IDLE, OVERHEAT). The timings are template parameters,
+// so an array of outputs (one per zone) needs no constructor arguments.
+template <uint16_t WindowMs, uint16_t MinSwitchMs>
+class TimeProportionalOutput {
+public:
+    TimeProportionalOutput() : windowStart(0), onTime(0), running(false) {}
+
+    // Returns the pin level for this moment
+    bool update(uint8_t duty, unsigned long now) {
+        if (duty == 0) {
+            onTime = 0;
+            return false;
+        }
+        if (!running || now - windowStart >= WindowMs) {
+            // Start a new window; resync after a long pause or if we fell
+            // more than one behind
+            windowStart = (!running || now - windowStart >= 2UL * WindowMs) ? now : windowStart + WindowMs;
+            onTime = onTimeFor(duty);
+            running = true;
+        }
+        return now - windowStart < onTime;
+    }
+
+private:
+    static uint16_t onTimeFor(uint8_t duty) {
+        uint16_t on = (uint16_t)((uint32_t)duty * WindowMs / 255);
+        if (on < MinSwitchMs) {
+            return 0;
+        }
+        return WindowMs - on < MinSwitchMs ? WindowMs : on;
+    }
+
+    unsigned long windowStart;  // millis() when the current window began
+    uint16_t onTime;            // On-time latched for the current window (ms)
+    bool running;               // A window has been started
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef HEATER_PROFILER_H
+#define HEATER_PROFILER_H
+
+#include <Arduino.h>
+#include "Telemetry.h"
+
+// ====== LOOP PROFILER ======
+// Per-stage timing of the control loop, measured with micros() (4 µs
+// resolution at 16 MHz). Each stage keeps count, min, max, mean and an
+// 8-bucket power-of-two histogram in RAM. The sketch sends the results as
+// TLM_PROFILE telemetry records when asked (profileRequestReport()).
+//
+// Everything here compiles to nothing unless HEATER_PROFILING is defined
+// before this header is included, so release builds carry no cost.
+//
+// Usage:  void sampleTask() { PROFILE_SCOPE(PROF_SAMPLE); controller.sample(); }
+
+// ====== STAGES ======
+enum ProfileStage {
+    PROF_SAMPLE,     // Sensor poll
+    PROF_FSM,        // State machine and control law
+    PROF_ACTUATE,    // Output pins
+    PROF_TELEMETRY,  // Building telemetry records
+    PROF_SERIAL,     // Draining the TX queue
+    PROF_LATENCY,    // Sample timestamp -> heater pin written
+    PROF_MEDIAN,     // Median filter stage (SampleFilter.h)
+    PROF_EMA,        // Moving average stage
+    PROF_STAGE_COUNT
+};
+
+const uint8_t PROF_BUCKETS = 8;  // <8, <16, <32, <64, <128, <256, <512, >=512 µs
+
+struct ProfileStats {
+    uint32_t count;
+    uint32_t total;   // Sum of all durations (µs), for the mean
+    uint16_t minimum;
+    uint16_t maximum;
+    uint16_t histogram[PROF_BUCKETS];
+};
+
+// Histogram bucket for a duration: 0 for < 8 µs, then one per doubling
+static inline uint8_t profileBucket(uint16_t micros) {
+    uint8_t bucket = 0;
+    micros >>= 3;
+    while (micros != 0 && bucket < PROF_BUCKETS - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+#ifdef HEATER_PROFILING
+
+static ProfileStats profileStats[PROF_STAGE_COUNT];
+
+// Adds one measurement (µs) to a stage
+static inline void profileRecord(ProfileStage stage, unsigned long duration) {
+    ProfileStats& s = profileStats[stage];
+    uint16_t us = duration > 0xFFFF ? 0xFFFF : (uint16_t)duration;
+    if (s.count == 0 || us < s.minimum) {
+        s.minimum = us;
+    }
+    if (us > s.maximum) {
+        s.maximum = us;
+    }
+    s.count++;
+    s.total += us;
+    uint16_t& bucket = s.histogram[profileBucket(us)];
+    if (bucket != 0xFFFF) {
+        bucket++;
+    }
+}
+
+static inline void profileReset() {
+    memset(profileStats, 0, sizeof(profileStats));
+}
+
+static inline const ProfileStats& profileStage(uint8_t stage) { return profileStats[stage]; }
+
+// Times the enclosing block
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileStage s) : stage(s), start(micros()) {}
+    ~ProfileScope() { profileRecord(stage, micros() - start); }
+
+private:
+    ProfileStage stage;
+    unsigned long start;
+};
+
+#define PROFILE_SCOPE(stage) ProfileScope profileScope_(stage)
+const bool profilingEnabled = true;
+
+// ====== REPORTING ======
+// A full report is PROF_STAGE_COUNT frames, more than the TX queue holds,
+// so it goes out one stage at a time as the queue drains.
+const uint8_t PROFILE_PAYLOAD_SIZE = 27;
+static uint8_t profileNextStage = PROF_STAGE_COUNT;  // == COUNT: no report pending
+
+// Asks for a report of every stage
+static inline void profileRequestReport() { profileNextStage = 0; }
+
+// Sends the next pending stage if the queue has room; call every pass
+template <class Link>
+void profileServiceReport(Link& link) {
+    if (profileNextStage >= PROF_STAGE_COUNT || !link.hasRoom(PROFILE_PAYLOAD_SIZE)) {
+        return;
+    }
+    const ProfileStats& s = profileStats[profileNextStage];
+    uint8_t payload[PROFILE_PAYLOAD_SIZE];
+    uint8_t* p = payload;
+    *p++ = profileNextStage;
+    p = packU32(p, s.count);
+    p = packU16(p, s.minimum);
+    p = packU16(p, s.maximum);
+    p = packU16(p, s.count ? (uint16_t)(s.total / s.count) : 0);
+    for (uint8_t i = 0; i < PROF_BUCKETS; i++) {
+        p = packU16(p, s.histogram[i]);
+    }
+    link.send(TLM_PROFILE, payload, sizeof(payload));
+    profileNextStage++;
+}
+
+#else
+
+static inline void profileRecord(ProfileStage, unsigned long) {}
+static inline void profileReset() {}
+static inline void profileRequestReport() {}
+template <class Link> void profileServiceReport(Link&) {}
+#define PROFILE_SCOPE(stage) do {} while (0)
+const bool profilingEnabled = false;
+
+#endif
+
+#endif
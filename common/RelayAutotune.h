@@ -0,0 +1,159 @@
+#ifndef HEATER_RELAY_AUTOTUNE_H
+#define HEATER_RELAY_AUTOTUNE_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+// ====== RELAY AUTOTUNE ======
+// Åström-Hägglund relay feedback: the heater is switched fully on below
+// setpoint - band and fully off above setpoint + band, which makes any
+// heater and load settle into a steady oscillation around the setpoint.
+// Its period Tu and amplitude a give the ultimate gain
+//
+//   Ku = 4 d / (pi sqrt(a^2 - band^2))    d = half the relay swing, 127.5 counts
+//
+// and from Ku and Tu the PID gains (Ziegler-Nichols "some overshoot"):
+//
+//   Kp = Ku / 3    Ti = Tu / 2    Td = Tu / 3
+//
+// The classic Kp = 0.6 Ku rule rings on these slow, lag-dominated loads.
+// Gains are Q8.8 in duty counts like PidControl.h (Kd per °C/min, so
+// Kd = Kp Tu / 180 with Tu in seconds). A gain that format cannot hold
+// fails the tune rather than being stored cut to its ceiling. The oscillation also sets the bang-bang hysteresis (its
+// peak-to-peak swing: a narrower band only adds relay switching) and the
+// STABILIZING limit (one period).
+//
+// A cycle runs from one heater switch-on to the next. The first is the
+// warm-up and is dropped; the next AUTOTUNE_CYCLES are averaged. A cycle
+// longer than AUTOTUNE_CYCLE_TIMEOUT, or an oscillation no bigger than the
+// band, fails the tune. Everything is integer and O(1) per sample.
+
+const uint8_t AUTOTUNE_CYCLES = 3;
+const unsigned long AUTOTUNE_CYCLE_TIMEOUT = 30UL * 60 * 1000;  // ms
+const int32_t AUTOTUNE_KU_NUMERATOR = 10638978L;  // 4 * 127.5 / pi in Q8.8, times 256
+
+enum AutotuneStatus { AUTOTUNE_OFF, AUTOTUNE_RUNNING, AUTOTUNE_DONE, AUTOTUNE_FAILED };
+
+// Tuned parameters
+struct AutotuneResult {
+    int16_t kp, ki, kd;              // Q8.8, see PidControl.h
+    TempQ8 hysteresis;
+    uint32_t stabilizingTime;        // ms
+    uint32_t period;                 // Tu, ms
+    TempQ8 amplitude;                // a, °C
+};
+
+// Integer square root, rounded down
+static inline uint16_t autotuneSqrt(uint32_t value) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1UL << 30; bit; bit >>= 2) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return (uint16_t)root;
+}
+
+class RelayAutotune {
+public:
+    RelayAutotune() : state(AUTOTUNE_OFF) {}
+
+    void begin(TempQ8 setpoint, TempQ8 relayBand, unsigned long now) {
+        target = setpoint;
+        band = relayBand;
+        heating = true;
+        cycles = 0;
+        lastSwitchOn = now;
+        swingSum = 0;
+        periodSum = 0;
+        high = TEMP_Q8_MIN;
+        low = TEMP_Q8_MAX;
+        state = AUTOTUNE_RUNNING;
+    }
+
+    void abort() {
+        if (state == AUTOTUNE_RUNNING) {
+            state = AUTOTUNE_FAILED;
+        }
+    }
+
+    // One step; returns true while the heater should be on
+    bool update(TempQ8 temp, unsigned long now) {
+        if (state != AUTOTUNE_RUNNING) {
+            return false;
+        }
+        high = temp > high ? temp : high;
+        low = temp < low ? temp : low;
+        if (heating && temp > target + band) {
+            heating = false;
+        } else if (!heating && temp < target - band) {
+            heating = true;
+            endCycle(now);
+        } else if (now - lastSwitchOn > AUTOTUNE_CYCLE_TIMEOUT) {
+            state = AUTOTUNE_FAILED;
+        }
+        return heating && state == AUTOTUNE_RUNNING;
+    }
+
+    uint8_t status() const { return state; }
+    bool running() const { return state == AUTOTUNE_RUNNING; }
+    const AutotuneResult& result() const { return tuned; }
+
+private:
+    void endCycle(unsigned long now) {
+        if (cycles > 0) {  // The first cycle is the warm-up
+            swingSum += high - low;
+            periodSum += now - lastSwitchOn;
+        }
+        lastSwitchOn = now;
+        high = TEMP_Q8_MIN;
+        low = TEMP_Q8_MAX;
+        if (++cycles > AUTOTUNE_CYCLES) {
+            state = compute() ? AUTOTUNE_DONE : AUTOTUNE_FAILED;
+        }
+    }
+
+    bool compute() {
+        int32_t amplitude = swingSum / (2 * AUTOTUNE_CYCLES);  // a, Q8.8
+        if (amplitude <= band) {
+            return false;  // No oscillation to speak of
+        }
+        // sqrt(a^2 - band^2) in Q8.8; a stays below 128 °C, so the squares fit
+        int32_t effective = autotuneSqrt((uint32_t)(amplitude * amplitude - (int32_t)band * band));
+        int32_t ku = AUTOTUNE_KU_NUMERATOR / (effective > 0 ? effective : 1);  // Q8.8 counts per °C
+        uint32_t tu = periodSum / AUTOTUNE_CYCLES;
+        uint32_t tuSeconds = (tu + 500) / 1000;
+        int32_t kp = ku / 3;
+        if (kp > 0x7FFF) {
+            return false;  // Beyond Q8.8: a cut gain would not be the tuned one
+        }
+        int32_t ki = kp * 2000 / (int32_t)(tu > 0 ? tu : 1);
+        int32_t kd = kp * (int32_t)tuSeconds / 180;  // Kp Td, Td = Tu / 3 in minutes
+        if (ki > 0x7FFF || kd > 0x7FFF) {
+            return false;
+        }
+        tuned.kp = (int16_t)kp;
+        tuned.ki = (int16_t)ki;
+        tuned.kd = (int16_t)kd;
+        tuned.hysteresis = saturateQ8(2 * amplitude);
+        tuned.stabilizingTime = tu;
+        tuned.period = tu;
+        tuned.amplitude = (TempQ8)amplitude;
+        return true;
+    }
+
+    AutotuneResult tuned;
+    uint32_t periodSum;          // ms over the measured cycles
+    int32_t swingSum;            // Peak-to-peak over the measured cycles, Q8.8
+    unsigned long lastSwitchOn;  // millis() of the last heater switch-on
+    TempQ8 target, band;
+    TempQ8 high, low;            // Extremes of the current cycle
+    uint8_t cycles;              // Switch-ons so far
+    uint8_t state;               // An AutotuneStatus
+    bool heating;                // Relay output
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef HEATER_SAMPLE_CLOCK_H
+#define HEATER_SAMPLE_CLOCK_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+
+// ====== HARDWARE SAMPLING CLOCK ======
+// Timer1 as a fixed-rate tick, so samples are taken at exact intervals
+// from the crystal instead of whenever loop() gets round to it. CTC mode
+// with TOP in OCR1A; OCR1B matches at the same count, so one period gives
+// both a Compare Match A interrupt and a Compare Match B event, which the
+// ADC can use as its auto-trigger (AdcSampler.h). The prescaler is the
+// smallest that fits the period in 16 bits, so the rate is as exact as
+// the crystal for any rate that divides 16 MHz.
+//
+// sampleClockRecord() is called at every sample instant (from the ISR
+// that takes the sample) and keeps the jitter statistics: the shortest
+// and longest interval between samples and how many sample slots were
+// skipped. A skipped slot shows up as an interval of about two periods
+// and is counted once per missing period.
+//
+// This header defines the TIMER1_COMPA_vect ISR and takes over Timer1, so
+// analogWrite() on pins 9 and 10 and the Servo library cannot be used.
+// Include it from exactly one translation unit (the sketch).
+
+// Called from the Compare Match A interrupt once per tick (0: none)
+typedef void (*SampleClockHandler)();
+
+// Statistics since sampleClockBegin(); all times in microseconds
+struct SampleClockStats {
+    uint16_t rate;           // Samples per second, 0 if the clock is not running
+    unsigned long period;    // Nominal sample interval
+    unsigned long shortest;  // Shortest interval seen (0: fewer than two samples)
+    unsigned long longest;   // Longest interval seen
+    unsigned long samples;   // Samples recorded
+    uint16_t missed;         // Sample slots skipped (saturates)
+
+    // Worst deviation of an interval from the nominal period
+    unsigned long jitter() const {
+        unsigned long early = shortest != 0 && shortest < period ? period - shortest : 0;
+        unsigned long late = longest > period ? longest - period : 0;
+        return early > late ? early : late;
+    }
+};
+
+// ====== CLOCK STATE (shared with the ISRs) ======
+static SampleClockHandler volatile sampleClockHandler = 0;
+static volatile SampleClockStats sampleClockState = {0, 0, 0, 0, 0, 0};
+static volatile unsigned long sampleClockLast = 0;  // micros() of the last sample
+
+// Starts Timer1 for sampleHz samples per second, ticking ticksPerSample
+// times per sample (4..65535 ticks per second), and calls handler from its
+// interrupt on every tick, if there is one. Restarting resets the
+// statistics.
+static inline void sampleClockBegin(uint16_t sampleHz, SampleClockHandler handler, uint8_t ticksPerSample = 1) {
+    // Clock select 1..5: prescaler 1, 8, 64, 256, 1024
+    const uint16_t prescalers[] = {1, 8, 64, 256, 1024};
+    uint8_t select = 0;
+    uint32_t counts = F_CPU / ((uint32_t)sampleHz * ticksPerSample);
+    while (select < 4 && counts / prescalers[select] > 65536UL) {
+        select++;
+    }
+    uint16_t top = (uint16_t)(counts / prescalers[select] - 1);
+
+    uint8_t sreg = SREG;
+    cli();
+    power_timer1_enable();
+    TCCR1B = 0;  // Stopped while it is set up
+    TCCR1A = 0;
+    TCNT1 = 0;
+    OCR1A = top;
+    OCR1B = top;
+    TIFR1 = _BV(OCF1A) | _BV(OCF1B);
+    sampleClockHandler = handler;
+    TIMSK1 = handler ? _BV(OCIE1A) : 0;
+    sampleClockState.rate = sampleHz;
+    sampleClockState.period = 1000000UL / sampleHz;
+    sampleClockState.shortest = 0;
+    sampleClockState.longest = 0;
+    sampleClockState.samples = 0;
+    sampleClockState.missed = 0;
+    TCCR1B = _BV(WGM12) | (select + 1);  // CTC, TOP = OCR1A
+    SREG = sreg;
+}
+
+// Records a sample instant. Interrupt context only; divides only when a
+// slot was skipped.
+static inline void sampleClockRecord() {
+    unsigned long now = micros();
+    if (sampleClockState.samples > 0) {
+        unsigned long interval = now - sampleClockLast;
+        unsigned long period = sampleClockState.period;
+        if (sampleClockState.shortest == 0 || interval < sampleClockState.shortest) {
+            sampleClockState.shortest = interval;
+        }
+        if (interval > sampleClockState.longest) {
+            sampleClockState.longest = interval;
+        }
+        if (interval > period + period / 2) {
+            unsigned long skipped = (interval - period / 2) / period;
+            sampleClockState.missed = sampleClockState.missed + skipped > 0xFFFF
+                                    ? 0xFFFF : (uint16_t)(sampleClockState.missed + skipped);
+        }
+    }
+    sampleClockLast = now;
+    sampleClockState.samples = sampleClockState.samples + 1;
+}
+
+// A consistent copy of the statistics
+static inline SampleClockStats sampleClockStats() {
+    uint8_t sreg = SREG;
+    cli();
+    SampleClockStats stats;
+    stats.rate = sampleClockState.rate;
+    stats.period = sampleClockState.period;
+    stats.shortest = sampleClockState.shortest;
+    stats.longest = sampleClockState.longest;
+    stats.samples = sampleClockState.samples;
+    stats.missed = sampleClockState.missed;
+    SREG = sreg;
+    return stats;
+}
+
+// ====== TIMER1 INTERRUPT ======
+ISR(TIMER1_COMPA_vect) {
+    SampleClockHandler handler = sampleClockHandler;
+    if (handler) {
+        handler();
+    }
+}
+
+#endif
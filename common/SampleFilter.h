@@ -0,0 +1,139 @@
+#ifndef HEATER_SAMPLE_FILTER_H
+#define HEATER_SAMPLE_FILTER_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+#include "Profiler.h"
+
+// ====== SAMPLE FILTERS ======
+// Conditioning between the sensor and the state machine, chosen per
+// sketch with Config::SampleFilter. Every stage is integer-only, O(1) per
+// sample and holds its state in a few bytes per zone:
+//
+//   MedianFilter<3 or 5>   rejects a single glitched reading (3 taps) or
+//                          two in a row (5 taps); a real step passes
+//                          through (Taps - 1) / 2 samples late
+//   EmaFilter<Shift>       exponential moving average with weight
+//                          1/2^Shift; the time constant is about 2^Shift
+//                          sample periods
+//   FilterChain<A, B>      A, then B
+//   NoFilter               the raw reading (default)
+//
+// A stage is a class with
+//
+//   TempQ8 add(TempQ8 raw)  takes a sample, returns the new output
+//   TempQ8 value() const    the last output
+//   TempQ8 fast() const     the least delayed useful reading, for the
+//                           overheat check: for a chain, the first stage's
+//                           output, so a median + EMA trips OVERHEAT on
+//                           the spike-free reading without waiting for the
+//                           average to catch up
+//
+// The first sample fills the stage's history, so there is no ramp up
+// from zero after reset. With HEATER_PROFILING each stage's add() is
+// timed as its own profiler stage (PROF_MEDIAN, PROF_EMA).
+
+struct NoFilter {
+    NoFilter() : last(0) {}
+    TempQ8 add(TempQ8 raw) { return last = raw; }
+    TempQ8 value() const { return last; }
+    TempQ8 fast() const { return last; }
+
+    TempQ8 last;
+};
+
+template <uint8_t Taps>
+class MedianFilter {
+public:
+    static_assert(Taps == 3 || Taps == 5, "The median filter has 3 or 5 taps");
+
+    MedianFilter() : index(0), primed(false), median(0) {}
+
+    TempQ8 add(TempQ8 raw) {
+        PROFILE_SCOPE(PROF_MEDIAN);
+        if (!primed) {
+            for (uint8_t i = 0; i < Taps; i++) {
+                taps[i] = raw;
+            }
+            primed = true;
+        }
+        taps[index] = raw;
+        index = index + 1 < Taps ? index + 1 : 0;
+        median = Taps == 3 ? median3(taps[0], taps[1], taps[2]) : median5();
+        return median;
+    }
+    TempQ8 value() const { return median; }
+    TempQ8 fast() const { return median; }
+
+private:
+    static TempQ8 median3(TempQ8 a, TempQ8 b, TempQ8 c) {
+        return a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+    }
+
+    static void order(TempQ8& a, TempQ8& b) {
+        if (a > b) {
+            TempQ8 t = a;
+            a = b;
+            b = t;
+        }
+    }
+
+    // Seven compare-exchanges on a copy: fixed cost, no loop over a sort
+    TempQ8 median5() const {
+        TempQ8 p[5] = {taps[0], taps[1], taps[2], taps[3 % Taps], taps[4 % Taps]};
+        order(p[0], p[1]);
+        order(p[3], p[4]);
+        order(p[0], p[3]);
+        order(p[1], p[4]);
+        order(p[1], p[2]);
+        order(p[2], p[3]);
+        order(p[1], p[2]);
+        return p[2];
+    }
+
+    TempQ8 taps[Taps];
+    uint8_t index;  // Oldest tap, overwritten next
+    bool primed;
+    TempQ8 median;
+};
+
+// y += (x - y) / 2^Shift, with Shift extra fraction bits kept so small
+// steps are not lost to truncation
+template <uint8_t Shift>
+class EmaFilter {
+public:
+    static_assert(Shift >= 1 && Shift <= 8, "EMA weight is 1/2 .. 1/256");
+
+    EmaFilter() : accumulator(0), primed(false) {}
+
+    TempQ8 add(TempQ8 raw) {
+        PROFILE_SCOPE(PROF_EMA);
+        if (!primed) {
+            accumulator = (int32_t)raw << Shift;
+            primed = true;
+        }
+        accumulator += raw - value();
+        return value();
+    }
+    // Rounded to nearest, so a steady input is reproduced exactly
+    TempQ8 value() const { return (TempQ8)((accumulator + (1 << (Shift - 1))) >> Shift); }
+    TempQ8 fast() const { return value(); }
+
+private:
+    int32_t accumulator;  // Output << Shift
+    bool primed;
+};
+
+template <class First, class Second>
+class FilterChain {
+public:
+    TempQ8 add(TempQ8 raw) { return second.add(first.add(raw)); }
+    TempQ8 value() const { return second.value(); }
+    TempQ8 fast() const { return first.fast(); }
+
+private:
+    First first;
+    Second second;
+};
+
+#endif
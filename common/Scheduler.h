@@ -0,0 +1,125 @@
+#ifndef HEATER_SCHEDULER_H
+#define HEATER_SCHEDULER_H
+
+#include <Arduino.h>
+
+// ====== COOPERATIVE TASK SCHEDULER ======
+// Non-blocking replacement for the delay() at the end of loop().
+// Every task has its own period and deadline. run() is called from loop()
+// as often as possible and dispatches each task whose release time has
+// passed, in the order the tasks were added. Tasks must never block.
+// Between releases loop() may sleep while due() is false (see LowPower.h).
+//
+// A task checks in by starting within its deadline. overdue() names the
+// tasks that have not: their last release started late, or the current
+// one is past its deadline and has not started (starved by the others,
+// or behind one that never returns). The watchdog supervisor
+// (Watchdog.h) feeds only while there are none.
+
+// ====== SHARED WITH THE WATCHDOG ISR ======
+// The task run() is in now (-1 between tasks), so a watchdog timeout can
+// say which one hung; and the flag the ISR sets to stop all dispatching
+// until the reset, so no task can switch a heater back on meanwhile
+static volatile int8_t schedulerRunning = -1;
+static volatile bool schedulerHalted = false;
+
+// A task body: plain function, no arguments, no return value
+typedef void (*TaskFunction)();
+
+struct Task {
+    TaskFunction run;           // Task body
+    unsigned long period;       // Time between releases (milliseconds)
+    unsigned long deadline;     // Allowed lateness after release (milliseconds)
+    unsigned long nextRelease;  // millis() value at which the task is next due
+    unsigned long maxLateness;  // Worst lateness seen so far (milliseconds)
+    unsigned int overruns;      // Number of releases that started after their deadline
+    bool late;                  // The last release started after its deadline
+};
+
+template <uint8_t MaxTasks>
+class Scheduler {
+public:
+    Scheduler() : count(0) {}
+
+    // Registers a task. Returns its index, or -1 if the table is full.
+    int8_t add(TaskFunction fn, unsigned long period, unsigned long deadline) {
+        if (count >= MaxTasks) {
+            return -1;
+        }
+        Task& t = tasks[count];
+        t.run = fn;
+        t.period = period;
+        t.deadline = deadline;
+        t.nextRelease = millis();
+        t.maxLateness = 0;
+        t.overruns = 0;
+        t.late = false;
+        return count++;
+    }
+
+    // Runs every task that is due. Call this from loop() without any delay().
+    void run() {
+        for (uint8_t i = 0; i < count && !schedulerHalted; i++) {
+            Task& t = tasks[i];
+            unsigned long now = millis();
+            // Signed difference keeps this correct across the millis() rollover
+            if ((long)(now - t.nextRelease) < 0) {
+                continue;
+            }
+            unsigned long lateness = now - t.nextRelease;
+            if (lateness > t.maxLateness) {
+                t.maxLateness = lateness;
+            }
+            t.late = lateness > t.deadline;
+            if (t.late) {
+                t.overruns++;
+            }
+            schedulerRunning = i;
+            t.run();
+            schedulerRunning = -1;
+            // Keep a fixed rate; if we fell more than a whole period behind,
+            // resynchronise instead of running a burst of catch-up releases
+            t.nextRelease += t.period;
+            if ((long)(now - t.nextRelease) >= 0) {
+                t.nextRelease = now + t.period;
+            }
+        }
+    }
+
+    // True if a task's release time has passed. loop() only sleeps when
+    // this is false; the next millis() tick wakes it in time to check again.
+    bool due() const {
+        if (schedulerHalted) {
+            return false;
+        }
+        unsigned long now = millis();
+        for (uint8_t i = 0; i < count; i++) {
+            if ((long)(now - tasks[i].nextRelease) >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Bit i set if task i has not checked in within its deadline
+    uint8_t overdue() const {
+        static_assert(MaxTasks <= 8, "overdue() has one bit per task");
+        unsigned long now = millis();
+        uint8_t late = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (tasks[i].late || (long)(now - tasks[i].nextRelease) > (long)tasks[i].deadline) {
+                late |= 1 << i;
+            }
+        }
+        return late;
+    }
+
+    uint8_t size() const { return count; }
+    const Task& task(uint8_t index) const { return tasks[index]; }
+
+private:
+    Task tasks[MaxTasks];
+    uint8_t count;
+};
+
+#endif
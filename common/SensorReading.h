@@ -0,0 +1,39 @@
+#ifndef HEATER_SENSOR_READING_H
+#define HEATER_SENSOR_READING_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+// ====== SENSOR READING ======
+// What a sensor policy's poll() returns: a value and why it can or cannot
+// be trusted. There is no sentinel temperature; a reading is only used
+// when its status is SENSOR_OK. The first four statuses come from the
+// sensor policy, the rest from the controller's plausibility checks (see
+// HeaterController.h), which also turn repeated bad readings into the
+// SENSOR_FAULT state.
+enum SensorStatus {
+    SENSOR_NO_SAMPLE,     // Nothing new since the last poll; not an error
+    SENSOR_OK,
+    SENSOR_READ_FAILED,   // NACK, bus error or timeout
+    SENSOR_NOT_FOUND,     // No device for this zone
+    SENSOR_OUT_OF_RANGE,  // Outside what the part can output: open or shorted input
+    SENSOR_IMPLAUSIBLE,   // Moved faster than a real load can (Config::maxSlewRate)
+    SENSOR_STUCK,         // Unchanged at full heat for Config::sensorStuckTime
+    SENSOR_STALE          // No sample for Config::maxSampleAge
+};
+const uint8_t SENSOR_STATUS_COUNT = 8;
+
+struct SensorReading {
+    TempQ8 value;    // Meaningful only if status == SENSOR_OK
+    uint8_t status;  // A SensorStatus
+
+    bool isNew() const { return status != SENSOR_NO_SAMPLE; }
+    bool ok() const { return status == SENSOR_OK; }
+};
+
+static inline SensorReading sensorReading(uint8_t status, TempQ8 value = 0) {
+    SensorReading reading = {value, status};
+    return reading;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef HEATER_SETTINGS_STORE_H
+#define HEATER_SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include "Crc16.h"
+#include "HeaterSettings.h"
+
+// ====== EEPROM SETTINGS STORE ======
+// Keeps HeaterSettings in EEPROM across power cycles. Each save goes into
+// a record of
+//
+//   uint8 version | uint16 sequence | HeaterSettings | uint16 CRC16
+//
+// in the next of Slots slots, round robin, so the writes are spread over
+// Slots times the EEPROM (wear levelling: ~100k cycles per cell becomes
+// ~Slots * 100k saves). On load the valid record with the newest sequence
+// wins. The CRC is the last thing written, so a save cut short by a reset
+// leaves a bad record that is skipped, and the previous settings load.
+// A record of another version is ignored too (defaults are used).
+//
+// save() only queues. service(), called from a scheduler task, writes at
+// most one byte per call and only when the EEPROM is idle, so the control
+// loop never waits out the ~3.3 ms write cycle. It also holds off until
+// no save() has come in for SETTINGS_SAVE_DELAY, so a burst of changes
+// costs one record, not one each. Bytes that already hold the right value
+// are not rewritten.
+
+const uint8_t SETTINGS_VERSION = 3;  // 2: PID gains added, 3: kd per °C/min
+const unsigned long SETTINGS_SAVE_DELAY = 2000;  // ms of quiet before writing
+
+struct SettingsRecord {
+    uint8_t version;
+    uint16_t sequence;
+    HeaterSettings settings;
+    uint16_t crc;  // Over every byte before it
+};
+
+template <uint16_t BaseAddress = 0, uint8_t Slots = 8>
+class SettingsStore {
+public:
+    static_assert(Slots >= 1, "Need at least one slot");
+    static_assert(BaseAddress + Slots * sizeof(SettingsRecord) <= E2END + 1, "Settings slots do not fit the EEPROM");
+
+    SettingsStore() : slot(Slots - 1), target(0), writeIndex(0), writing(false), dirty(false), dirtySince(0) {
+        image.sequence = 0;
+    }
+
+    // Finds the newest valid record and copies its settings. Returns false
+    // (settings untouched) if there is none. EEPROM reads take a few
+    // cycles per byte, but they wait for a write in progress: setup() only.
+    bool load(HeaterSettings& settings) {
+        bool found = false;
+        for (uint8_t i = 0; i < Slots; i++) {
+            SettingsRecord record;
+            eeprom_read_block(&record, slotAddress(i), sizeof(record));
+            if (!intact(record) || !record.settings.valid()) {
+                continue;
+            }
+            // Serial-number compare: live sequences are never far apart
+            if (!found || (int16_t)(record.sequence - image.sequence) > 0) {
+                image = record;
+                slot = i;
+                found = true;
+            }
+        }
+        if (found) {
+            settings = image.settings;
+        }
+        return found;
+    }
+
+    // Queues settings for the next record; the latest call wins
+    void save(const HeaterSettings& settings) {
+        queued = settings;
+        dirty = true;
+        dirtySince = millis();
+    }
+
+    // Advances a pending save by at most one byte; never blocks
+    void service() {
+        if (!writing) {
+            if (!dirty || millis() - dirtySince < SETTINGS_SAVE_DELAY) {
+                return;
+            }
+            image.version = SETTINGS_VERSION;
+            image.sequence++;
+            image.settings = queued;
+            image.crc = crc16((const uint8_t*)&image, offsetof(SettingsRecord, crc));
+            target = slot + 1 < Slots ? slot + 1 : 0;
+            writeIndex = 0;
+            writing = true;
+            dirty = false;
+        }
+        if (!eeprom_is_ready()) {
+            return;  // Previous byte still being written
+        }
+        const uint8_t* bytes = (const uint8_t*)&image;
+        uint8_t* address = (uint8_t*)slotAddress(target);
+        while (writeIndex < sizeof(image)) {
+            uint8_t i = writeIndex++;
+            if (eeprom_read_byte(address + i) != bytes[i]) {
+                eeprom_write_byte(address + i, bytes[i]);  // Starts the write and returns
+                return;
+            }
+        }
+        writing = false;
+        slot = target;
+    }
+
+    // A save is queued or being written
+    bool busy() const { return dirty || writing; }
+    // Sequence number of the last record loaded or written
+    uint16_t sequence() const { return image.sequence; }
+
+private:
+    static const void* slotAddress(uint8_t index) {
+        return (const void*)(uintptr_t)(BaseAddress + index * sizeof(SettingsRecord));
+    }
+
+    static bool intact(const SettingsRecord& record) {
+        return record.version == SETTINGS_VERSION
+            && record.crc == crc16((const uint8_t*)&record, offsetof(SettingsRecord, crc));
+    }
+
+    SettingsRecord image;      // Newest record: loaded, or being written
+    HeaterSettings queued;     // Waiting for the next record
+    uint8_t slot;              // Slot holding the newest complete record
+    uint8_t target;            // Slot being written
+    uint8_t writeIndex;        // Next byte of image to write
+    bool writing;
+    bool dirty;                // save() since the last record was started
+    unsigned long dirtySince;  // millis() of the last save()
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef HEATER_SLOPE_ESTIMATOR_H
+#define HEATER_SLOPE_ESTIMATOR_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+// ====== STREAMING SLOPE ESTIMATE ======
+// Least-squares slope of the last Window samples, taken at a fixed rate,
+// for the predictive overheat guard (see HeaterController.h). Like
+// StabilityDetector.h it keeps running sums, so a sample costs O(1): the
+// sums of y and of position * y. Only the slope is needed, so there is no
+// variance sum and the samples are whole temperatures, not clamped
+// offsets: with Window <= 16 every sum fits int32_t for any Q8.8 value.
+//
+// Window must be a power of two. slope() is 0 until the window is full.
+
+template <uint8_t Window>
+class SlopeEstimator {
+public:
+    static_assert(Window >= 4 && Window <= 16 && (Window & (Window - 1)) == 0,
+                  "The slope window is 4, 8 or 16 samples");
+
+    SlopeEstimator() { reset(); }
+
+    void reset() {
+        count = 0;
+        index = 0;
+        sumY = 0;
+        sumIY = 0;
+    }
+
+    void add(TempQ8 temp) {
+        if (count < Window) {
+            sumIY += (int32_t)count * temp;
+            count++;
+        } else {
+            // Every remaining sample moves down one position and the
+            // oldest (position 0) leaves
+            sumY -= samples[index];
+            sumIY -= sumY;
+            sumIY += (int32_t)(Window - 1) * temp;
+        }
+        samples[index] = temp;
+        index = (index + 1) & (Window - 1);
+        sumY += temp;
+    }
+
+    bool ready() const { return count == Window; }
+
+    // Q8.8 °C per second, saturated
+    TempQ8 slope(uint8_t samplesPerSecond) const {
+        if (count < Window) {
+            return 0;
+        }
+        int32_t numerator = (int32_t)Window * sumIY - SUM_I * sumY;
+        int32_t limit = 0x7FFFFFFFL / samplesPerSecond;  // Only a glitch gets near it
+        numerator = numerator > limit ? limit : (numerator < -limit ? -limit : numerator);
+        return saturateQ8(numerator * samplesPerSecond / SLOPE_DENOMINATOR);
+    }
+
+private:
+    static constexpr int32_t SUM_I = (int32_t)Window * (Window - 1) / 2;
+    static constexpr int32_t SUM_II = (int32_t)(Window - 1) * Window * (2 * Window - 1) / 6;
+    static constexpr int32_t SLOPE_DENOMINATOR = (int32_t)Window * SUM_II - SUM_I * SUM_I;
+
+    TempQ8 samples[Window];  // Ring, oldest at index once full
+    uint8_t count;           // Samples in the window (saturates at Window)
+    uint8_t index;           // Ring position of the oldest sample
+    int32_t sumY;            // Sum of samples
+    int32_t sumIY;           // Sum of position * sample
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef HEATER_STABILITY_DETECTOR_H
+#define HEATER_STABILITY_DETECTOR_H
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+// ====== STREAMING STABILITY DETECTOR ======
+// Decides when the temperature has settled, instead of waiting a fixed
+// time. It keeps the last Window samples and, with running sums updated in
+// O(1) per sample, the least-squares slope and the variance over that
+// window. The temperature is "stable" once the window is full and slope and
+// spread have both stayed inside their limits for RequiredCount samples in
+// a row.
+//
+// Samples are stored as offsets from the first sample after reset() and
+// clamped to +-8 °C, which keeps every sum comfortably inside int32_t; a
+// reading that far off is not settling anyway.
+//
+// Window must be a power of two. slopeLimit is in Q8.8 °C per second,
+// noiseLimit is the allowed standard deviation in Q8.8 °C, and
+// samplesPerSecond is the rate add() is called at.
+
+const int16_t STABILITY_OFFSET_LIMIT = 8 * 256;  // +-8 °C in Q8.8
+
+template <uint8_t Window, uint8_t RequiredCount>
+class StabilityDetector {
+public:
+    StabilityDetector() { reset(0); }
+
+    // Starts a new window relative to this temperature
+    void reset(TempQ8 reference) {
+        origin = reference;
+        count = 0;
+        index = 0;
+        sumY = 0;
+        sumIY = 0;
+        sumYY = 0;
+        inLimits = 0;
+    }
+
+    // Adds one sample; returns true while the temperature is stable
+    bool add(TempQ8 temp, TempQ8 slopeLimit, TempQ8 noiseLimit, uint8_t samplesPerSecond) {
+        int32_t offset = (int32_t)temp - origin;
+        int16_t y = (int16_t)(offset > STABILITY_OFFSET_LIMIT ? STABILITY_OFFSET_LIMIT
+                            : (offset < -STABILITY_OFFSET_LIMIT ? -STABILITY_OFFSET_LIMIT : offset));
+
+        if (count < Window) {
+            // Filling: the new sample sits at position count
+            sumIY += (int32_t)count * y;
+            count++;
+        } else {
+            // Sliding: every remaining sample moves down one position and
+            // the oldest (position 0) leaves
+            int16_t oldest = samples[index];
+            sumY -= oldest;
+            sumYY -= (int32_t)oldest * oldest;
+            sumIY -= sumY;  // sum over the survivors of (i - 1) * y
+            sumIY += (int32_t)(Window - 1) * y;
+        }
+        samples[index] = y;
+        index = (index + 1) & (Window - 1);
+        sumY += y;
+        sumYY += (int32_t)y * y;
+
+        if (count == Window && withinLimits(slopeLimit, noiseLimit, samplesPerSecond)) {
+            if (inLimits < RequiredCount) {
+                inLimits++;
+            }
+        } else {
+            inLimits = 0;
+        }
+        return stable();
+    }
+
+    bool stable() const { return inLimits >= RequiredCount; }
+
+    // Least-squares slope over the window, in Q8.8 °C per second
+    TempQ8 slope(uint8_t samplesPerSecond) const {
+        return count < Window ? 0 : saturateQ8(slopeNumerator() * samplesPerSecond / SLOPE_DENOMINATOR);
+    }
+
+private:
+    // Sum of i and of i^2 for positions 0..Window-1, and W*Sum(i^2) - Sum(i)^2
+    static constexpr int32_t SUM_I = (int32_t)Window * (Window - 1) / 2;
+    static constexpr int32_t SUM_II = (int32_t)(Window - 1) * Window * (2 * Window - 1) / 6;
+    static constexpr int32_t SLOPE_DENOMINATOR = (int32_t)Window * SUM_II - SUM_I * SUM_I;
+
+    // Slope per sample is slopeNumerator() / SLOPE_DENOMINATOR
+    int32_t slopeNumerator() const { return (int32_t)Window * sumIY - SUM_I * sumY; }
+
+    // Compares without dividing:
+    //   |numerator| * samplesPerSecond <= slopeLimit * denominator
+    //   W * Sum(y^2) - Sum(y)^2 <= W^2 * noiseLimit^2
+    bool withinLimits(TempQ8 slopeLimit, TempQ8 noiseLimit, uint8_t samplesPerSecond) const {
+        int32_t numerator = slopeNumerator();
+        if (numerator < 0) {
+            numerator = -numerator;
+        }
+        if (numerator * samplesPerSecond > (int32_t)slopeLimit * SLOPE_DENOMINATOR) {
+            return false;
+        }
+        int32_t spread = (int32_t)Window * sumYY - sumY * sumY;
+        return spread <= (int32_t)Window * Window * noiseLimit * noiseLimit;
+    }
+
+    int16_t samples[Window];  // Ring of offsets from origin
+    TempQ8 origin;            // Reference temperature for the offsets
+    uint8_t count;            // Samples in the window (saturates at Window)
+    uint8_t index;            // Ring position of the oldest sample
+    int32_t sumY;             // Sum of offsets
+    int32_t sumIY;            // Sum of position * offset
+    int32_t sumYY;            // Sum of squared offsets
+    uint8_t inLimits;         // Consecutive samples within limits
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef HEATER_TELEMETRY_H
+#define HEATER_TELEMETRY_H
+
+#include <Arduino.h>
+#include "Crc16.h"
+#include "FixedPoint.h"
+#include "HeaterFsm.h"
+
+// ====== BINARY TELEMETRY ======
+// Compact framed records instead of text lines. Every frame is
+//
+//   0xA5 0x5A | type | length | payload (length bytes) | CRC16 (2 bytes)
+//
+// Multi-byte fields are little-endian. The CRC is CRC-16/CCITT-FALSE
+// (poly 0x1021, init 0xFFFF) over type, length and payload, sent low byte
+// first. tools/telemetry_decode.py is the host-side decoder.
+//
+// Frames are queued in a RAM ring buffer and trickled into the serial
+// driver only as fast as it has room (availableForWrite()), so sending
+// never blocks the control loop. A frame that does not fit is dropped
+// whole and counted.
+
+const uint8_t TLM_SYNC1 = 0xA5;
+const uint8_t TLM_SYNC2 = 0x5A;
+const uint8_t TLM_HEADER_SIZE = 4;  // Sync, sync, type, length
+const uint8_t TLM_CRC_SIZE = 2;
+const uint8_t TLM_MAX_PAYLOAD = 32;
+
+// ====== RECORD TYPES ======
+// TLM_STATUS payload (8 bytes):
+//   uint32 timestamp (millis), int16 reading (Q8.8 °C: the sensor's last
+//   plausible reading, before the SampleFilter, so the host sees the
+//   spikes the filter takes out),
+//   uint8 state (HeaterState), uint8 heater duty (0 = off .. 255 = fully on)
+const uint8_t TLM_STATUS = 0x01;
+// TLM_PROFILE payload (27 bytes), one record per ProfileStage:
+//   uint8 stage, uint32 count, uint16 min, uint16 max, uint16 mean (µs),
+//   uint16 histogram[8] (<8, <16, ... <512, >=512 µs)
+const uint8_t TLM_PROFILE = 0x02;
+// TLM_ZONE_STATUS payload (9 bytes), multi-zone boards, one zone per record:
+//   uint32 timestamp (millis), uint8 zone, int16 reading (Q8.8 °C, as above),
+//   uint8 state (HeaterState), uint8 heater duty
+const uint8_t TLM_ZONE_STATUS = 0x03;
+// TLM_TEXT payload (1..32 bytes): one line of console output in ASCII,
+// without the line end; longer lines are split over several records
+const uint8_t TLM_TEXT = 0x04;
+
+// ====== TELEMETRY LINK ======
+// QueueSize must be a power of two
+template <uint8_t QueueSize = 64>
+class TelemetryLink {
+public:
+    TelemetryLink() : head(0), tail(0), dropped(0) {}
+
+    // Queues one frame. Returns false (and counts a drop) if it does not fit.
+    bool send(uint8_t type, const uint8_t* payload, uint8_t length) {
+        if (length > TLM_MAX_PAYLOAD || !hasRoom(length)) {
+            dropped++;
+            return false;
+        }
+        uint16_t crc = 0xFFFF;
+        put(TLM_SYNC1);
+        put(TLM_SYNC2);
+        put(type);
+        crc = crc16Update(crc, type);
+        put(length);
+        crc = crc16Update(crc, length);
+        for (uint8_t i = 0; i < length; i++) {
+            put(payload[i]);
+            crc = crc16Update(crc, payload[i]);
+        }
+        put(lowByte(crc));
+        put(highByte(crc));
+        return true;
+    }
+
+    // Moves queued bytes into the serial driver, never more than it can
+    // take without blocking. Call this often (every scheduler pass).
+    void drain(HardwareSerial& port) {
+        int room = port.availableForWrite();
+        while (room-- > 0 && tail != head) {
+            port.write(buffer[tail]);
+            tail = (tail + 1) & (QueueSize - 1);
+        }
+    }
+
+    // True if a frame with this payload length would fit right now
+    bool hasRoom(uint8_t length) const { return free() >= TLM_HEADER_SIZE + length + TLM_CRC_SIZE; }
+
+    unsigned int droppedFrames() const { return dropped; }
+
+private:
+    uint8_t free() const { return (QueueSize - 1) - ((head - tail) & (QueueSize - 1)); }
+    void put(uint8_t b) {
+        buffer[head] = b;
+        head = (head + 1) & (QueueSize - 1);
+    }
+
+    uint8_t buffer[QueueSize];
+    uint8_t head;           // Next byte to write
+    uint8_t tail;           // Next byte to send
+    unsigned int dropped;   // Frames that did not fit
+};
+
+// ====== PAYLOAD PACKING ======
+static inline uint8_t* packU16(uint8_t* p, uint16_t v) {
+    p[0] = lowByte(v);
+    p[1] = highByte(v);
+    return p + 2;
+}
+
+static inline uint8_t* packU32(uint8_t* p, uint32_t v) {
+    p = packU16(p, (uint16_t)v);
+    return packU16(p, (uint16_t)(v >> 16));
+}
+
+// ====== TEXT OVER THE LINK ======
+// A Print that turns each line into a TLM_TEXT record, so console replies
+// share the binary link without corrupting it. ready() is true when a
+// full-length record fits the queue.
+template <class Link>
+class TelemetryTextPrint : public Print {
+public:
+    explicit TelemetryTextPrint(Link& telemetryLink) : link(telemetryLink), length(0) {}
+
+    size_t write(uint8_t c) {
+        if (c == '\r') {
+            return 1;
+        }
+        if (c == '\n') {
+            flush();
+            return 1;
+        }
+        text[length++] = c;
+        if (length == TLM_MAX_PAYLOAD) {
+            flush();
+        }
+        return 1;
+    }
+
+    bool ready() const { return link.hasRoom(TLM_MAX_PAYLOAD); }
+
+private:
+    void flush() {
+        if (length > 0) {
+            link.send(TLM_TEXT, text, length);
+            length = 0;
+        }
+    }
+
+    Link& link;
+    uint8_t text[TLM_MAX_PAYLOAD];
+    uint8_t length;
+};
+
+// Queues a TLM_STATUS record for a controller
+template <class Link, class Controller>
+bool sendStatusRecord(Link& link, const Controller& controller) {
+    uint8_t payload[8];
+    uint8_t* p = packU32(payload, millis());
+    p = packU16(p, (uint16_t)controller.rawTemperature());
+    *p++ = (uint8_t)controller.state();
+    *p++ = controller.heaterDuty();
+    return link.send(TLM_STATUS, payload, sizeof(payload));
+}
+
+// Queues a TLM_ZONE_STATUS record for one zone of a multi-zone controller
+template <class Link, class Controller>
+bool sendZoneStatusRecord(Link& link, const Controller& controller, uint8_t zone) {
+    uint8_t payload[9];
+    uint8_t* p = packU32(payload, millis());
+    *p++ = zone;
+    p = packU16(p, (uint16_t)controller.rawTemperature(zone));
+    *p++ = (uint8_t)controller.state(zone);
+    *p++ = controller.heaterDuty(zone);
+    return link.send(TLM_ZONE_STATUS, payload, sizeof(payload));
+}
+
+#endif
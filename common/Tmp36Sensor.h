@@ -0,0 +1,64 @@
+#ifndef HEATER_TMP36_SENSOR_H
+#define HEATER_TMP36_SENSOR_H
+
+#include <Arduino.h>
+#include "AdcSampler.h"
+#include "FixedPoint.h"
+#include "SensorReading.h"
+
+// ====== TMP36 SENSOR POLICY ======
+// TMP36 on an analog pin, read through the free-running ADC sampler.
+// A sample counts as new only if the ADC has produced one since the last
+// poll, so a stalled ADC shows up as a stale reading. The sampler handles a
+// single channel, so this is a one-zone sensor.
+//
+// SampleHz 0 lets the ADC free-run. Otherwise the hardware sampling clock
+// (SampleClock.h) starts the conversions and the sampler delivers exactly
+// SampleHz samples per second whatever loop() is doing; the ADC takes
+// 16 conversions per sample, so up to 500 Hz.
+//
+// A TMP36 can only output 0.1 V (-40 °C) to 1.75 V (125 °C). A reading
+// well outside that, near either rail, means a broken wire or a short and
+// is reported as SENSOR_OUT_OF_RANGE rather than as a temperature.
+const uint16_t TMP36_MIN_COUNTS = 41;    // 0.05 V at 5 V / 4096 counts
+const uint16_t TMP36_MAX_COUNTS = 1638;  // 2.0 V
+template <uint8_t Pin, uint16_t SampleHz = 0>
+struct Tmp36Sensor {
+    static_assert(SampleHz == 0 || (SampleHz >= 10 && SampleHz <= 500), "SampleHz is 0 (free-running) or 10..500");
+
+    static void begin() {
+        // Oversampled conversions from here on
+        if (SampleHz > 0) {
+            adcBeginClocked(Pin, SampleHz);
+        } else {
+            adcBegin(Pin);
+        }
+        lastSequence = adcSampleSequence();
+    }
+
+    static SensorReading poll(uint8_t /* zone: always 0 */) {
+        uint16_t sequence = adcSampleSequence();
+        if (sequence == lastSequence) {
+            return sensorReading(SENSOR_NO_SAMPLE);
+        }
+        lastSequence = sequence;
+        uint16_t counts = adcLatest();
+        if (counts < TMP36_MIN_COUNTS || counts > TMP36_MAX_COUNTS) {
+            return sensorReading(SENSOR_OUT_OF_RANGE);
+        }
+        return sensorReading(SENSOR_OK, countsToQ8(counts));
+    }
+
+    // TMP36 formula: °C = (mV - 500) / 10, with mV = counts * 5000 / 4096.
+    // In Q8.8 that is counts * 31.25 - 12800, all in integers.
+    static TempQ8 countsToQ8(uint16_t counts) {
+        return saturateQ8((((int32_t)counts * 125) >> 2) - 12800);
+    }
+
+    static uint16_t lastSequence;  // ADC sample counter seen by the last poll
+};
+
+template <uint8_t Pin, uint16_t SampleHz>
+uint16_t Tmp36Sensor<Pin, SampleHz>::lastSequence = 0;
+
+#endif
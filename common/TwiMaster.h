@@ -0,0 +1,286 @@
+#ifndef HEATER_TWI_MASTER_H
+#define HEATER_TWI_MASTER_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+
+// ====== INTERRUPT-DRIVEN I²C (TWI) MASTER ======
+// Non-blocking replacement for the Wire library. twiStart() queues one
+// transaction (optional register write, repeated start, optional read)
+// and returns at once; the TWI interrupt walks the bus protocol and sets
+// the completion status. twiPoll() is called from the main loop: it
+// reports the status and aborts a transaction that has run past its
+// timeout, recovering the bus if a slave is holding SDA low.
+//
+// twiStartBurst() reads several slaves in a single transaction: a repeated
+// START between devices and one STOP at the end, so a bank of sensors is
+// read back to back with no gaps and no per-device setup.
+//
+// This header defines the TWI_vect ISR, so it replaces Wire.h and must be
+// included from exactly one translation unit (the sketch).
+
+// ====== TRANSFER STATUS ======
+enum TwiStatus {
+    TWI_READY,      // No transaction started yet
+    TWI_BUSY,       // Transaction in progress
+    TWI_DONE,       // Transaction finished, read data is valid
+    TWI_NACK,       // Slave did not acknowledge
+    TWI_BUS_ERROR,  // Illegal START/STOP or lost arbitration
+    TWI_TIMEOUT     // Transaction aborted after the timeout, bus recovered
+};
+
+// Largest register write a single transaction can carry
+const uint8_t TWI_BUFFER_SIZE = 4;
+// Largest read, over all devices of a burst
+const uint8_t TWI_RX_BUFFER_SIZE = 16;
+// Most slaves one burst can read
+const uint8_t TWI_MAX_DEVICES = 8;
+// Abort a transaction that has not finished after this long, per device
+// (microseconds)
+const unsigned long TWI_TIMEOUT_US = 2000;
+// Longest a STOP may take to leave the bus before the next START
+// (a few SCL periods at 100 kHz; microseconds)
+const unsigned long TWI_STOP_TIMEOUT_US = 100;
+
+// ====== TRANSFER STATE (shared with the ISR) ======
+static volatile TwiStatus twiStatus = TWI_READY;
+static volatile uint8_t twiDevices[TWI_MAX_DEVICES];  // Slave addresses, in bus order
+static volatile uint8_t twiDeviceCount = 0;
+static volatile uint8_t twiDeviceIndex = 0;           // Slave being addressed
+static volatile uint8_t twiFailedMask = 0;            // Bit i: device i did not acknowledge
+static volatile uint8_t twiTxBuffer[TWI_BUFFER_SIZE];
+static volatile uint8_t twiTxLength = 0;
+static volatile uint8_t twiTxIndex = 0;
+static volatile uint8_t twiRxBuffer[TWI_RX_BUFFER_SIZE];
+static volatile uint8_t twiRxLength = 0;              // Bytes read from each device
+static volatile uint8_t twiRxIndex = 0;
+static volatile uint8_t twiRxEnd = 0;                 // End of the current device's bytes
+static unsigned long twiStartMicros = 0;
+static unsigned long twiTimeoutMicros = TWI_TIMEOUT_US;
+static unsigned int twiRecoveries = 0;  // Number of times the bus had to be recovered
+
+// ====== TWCR COMMANDS ======
+// Every command keeps the peripheral and its interrupt enabled
+#define TWI_CMD(bits) (_BV(TWEN) | _BV(TWIE) | _BV(TWINT) | (bits))
+
+static inline void twiSendStart() { TWCR = TWI_CMD(_BV(TWSTA)); }
+static inline void twiSendStop() { TWCR = TWI_CMD(_BV(TWSTO)); }
+static inline void twiAck() { TWCR = TWI_CMD(_BV(TWEA)); }
+static inline void twiNack() { TWCR = TWI_CMD(0); }
+
+// Sets the SCL clock. TWBR formula from the ATmega328P datasheet, prescaler 1.
+static inline void twiSetClock(uint32_t clockHz) {
+    TWSR &= ~(_BV(TWPS1) | _BV(TWPS0));
+    TWBR = (uint8_t)(((F_CPU / clockHz) - 16) / 2);
+}
+
+// Enables the TWI peripheral with internal pull-ups on SDA/SCL
+static inline void twiBegin(uint32_t clockHz = 100000) {
+    pinMode(SDA, INPUT_PULLUP);
+    pinMode(SCL, INPUT_PULLUP);
+    twiSetClock(clockHz);
+    TWCR = _BV(TWEN) | _BV(TWIE);
+    twiStatus = TWI_READY;
+}
+
+// Frees a bus that a slave is holding: with the peripheral off, clock SCL
+// by hand until SDA is released (at most 9 pulses), then issue a STOP.
+// Takes well under 100 µs and only runs after a timeout.
+static inline void twiRecoverBus() {
+    TWCR = 0;  // Hand the pins back to the GPIO driver
+    pinMode(SDA, INPUT_PULLUP);
+    pinMode(SCL, OUTPUT);
+    for (uint8_t i = 0; i < 9 && digitalRead(SDA) == LOW; i++) {
+        digitalWrite(SCL, LOW);
+        delayMicroseconds(5);
+        digitalWrite(SCL, HIGH);
+        delayMicroseconds(5);
+    }
+    // STOP condition: SDA low -> high while SCL is high
+    digitalWrite(SCL, LOW);
+    pinMode(SDA, OUTPUT);
+    digitalWrite(SDA, LOW);
+    delayMicroseconds(5);
+    digitalWrite(SCL, HIGH);
+    delayMicroseconds(5);
+    digitalWrite(SDA, HIGH);
+    delayMicroseconds(5);
+    pinMode(SDA, INPUT_PULLUP);
+    pinMode(SCL, INPUT_PULLUP);
+    twiRecoveries++;
+}
+
+// Common part of twiStart() and twiStartBurst(); the device list is set.
+// twiStatus is TWI_DONE as soon as the last STOP is requested, but the
+// hardware holds TWSTO until the STOP is on the bus, and a START written
+// before then is lost: wait for it, as twi.c does, and recover a bus that
+// never lets it out.
+static inline void twiLaunch(uint8_t deviceCount, uint8_t txLength, uint8_t rxLength) {
+    unsigned long stopStart = micros();
+    while (TWCR & _BV(TWSTO)) {
+        if (micros() - stopStart > TWI_STOP_TIMEOUT_US) {
+            twiRecoverBus();
+            TWCR = _BV(TWEN) | _BV(TWIE);
+            break;
+        }
+    }
+    twiDeviceCount = deviceCount;
+    twiDeviceIndex = 0;
+    twiFailedMask = 0;
+    twiTxLength = txLength;
+    twiTxIndex = 0;
+    twiRxLength = rxLength;
+    twiRxIndex = 0;
+    twiRxEnd = rxLength;
+    twiTimeoutMicros = TWI_TIMEOUT_US * deviceCount;
+    twiStartMicros = micros();
+    twiStatus = TWI_BUSY;
+    twiSendStart();
+}
+
+// Starts a transaction: write txLength bytes, then read rxLength bytes
+// after a repeated start. Either length may be 0. Returns false without
+// touching the bus if a transaction is still running or the lengths are
+// too large.
+static inline bool twiStart(uint8_t address, const uint8_t* tx, uint8_t txLength, uint8_t rxLength) {
+    if (twiStatus == TWI_BUSY || txLength > TWI_BUFFER_SIZE || rxLength > TWI_RX_BUFFER_SIZE) {
+        return false;
+    }
+    for (uint8_t i = 0; i < txLength; i++) {
+        twiTxBuffer[i] = tx[i];
+    }
+    twiDevices[0] = address;
+    twiLaunch(1, txLength, rxLength);
+    return true;
+}
+
+// Starts a burst: length bytes from each of count slaves, back to back in
+// one transaction. Each slave must already point at the register to read.
+// Device i's bytes are twiReadByte(i * length) onwards. The burst ends
+// TWI_DONE if at least one device answered (see twiFailedDevices()), or
+// TWI_NACK if none did.
+static inline bool twiStartBurst(const uint8_t* addresses, uint8_t count, uint8_t length) {
+    if (twiStatus == TWI_BUSY || count == 0 || count > TWI_MAX_DEVICES || length == 0
+        || (uint16_t)count * length > TWI_RX_BUFFER_SIZE) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        twiDevices[i] = addresses[i];
+    }
+    twiLaunch(count, 0, length);
+    return true;
+}
+
+// Reports the transaction status. Call regularly from the main loop; a
+// transaction running longer than TWI_TIMEOUT_US is aborted here.
+static inline TwiStatus twiPoll() {
+    if (twiStatus == TWI_BUSY && micros() - twiStartMicros > twiTimeoutMicros) {
+        twiRecoverBus();
+        TWCR = _BV(TWEN) | _BV(TWIE);  // Re-enable the peripheral
+        twiStatus = TWI_TIMEOUT;
+    }
+    return twiStatus;
+}
+
+// Waits for the running transaction to finish or time out. Blocking, so
+// for setup() only.
+static inline TwiStatus twiWait() {
+    TwiStatus status;
+    while ((status = twiPoll()) == TWI_BUSY) {
+    }
+    return status;
+}
+
+// Byte i of the data read by the last completed transaction
+static inline uint8_t twiReadByte(uint8_t i) { return twiRxBuffer[i]; }
+
+// Devices of the last transaction that did not acknowledge, bit i for device i
+static inline uint8_t twiFailedDevices() { return twiFailedMask; }
+
+// After a device's read phase: repeated start into the next device of a
+// burst, or STOP once all of them are done
+static inline void twiNextDevice() {
+    if (twiDeviceIndex + 1 < twiDeviceCount) {
+        twiDeviceIndex++;
+        twiRxIndex = twiRxEnd;
+        twiRxEnd += twiRxLength;
+        twiSendStart();
+    } else {
+        twiSendStop();
+        uint8_t all = (uint8_t)((1 << twiDeviceCount) - 1);
+        twiStatus = twiFailedMask == all ? TWI_NACK : TWI_DONE;
+    }
+}
+
+// ====== TWI INTERRUPT ======
+// One step of the master transmitter/receiver protocol per bus event.
+// Status codes are from the ATmega328P datasheet, TWI chapter.
+ISR(TWI_vect) {
+    switch (TWSR & 0xF8) {
+        case 0x08:  // START sent
+        case 0x10:  // Repeated START sent
+            // Write phase first, then the read phase
+            TWDR = (twiDevices[twiDeviceIndex] << 1) | (twiTxIndex < twiTxLength ? 0 : 1);
+            twiNack();
+            break;
+
+        case 0x18:  // SLA+W sent, ACK received
+        case 0x28:  // Data byte sent, ACK received
+            if (twiTxIndex < twiTxLength) {
+                TWDR = twiTxBuffer[twiTxIndex++];
+                twiNack();
+            } else if (twiRxLength > 0) {
+                twiSendStart();  // Repeated start into the read phase
+            } else {
+                twiSendStop();
+                twiStatus = TWI_DONE;
+            }
+            break;
+
+        case 0x40:  // SLA+R sent, ACK received
+            // ACK every byte except the last one
+            if (twiRxLength > 1) {
+                twiAck();
+            } else {
+                twiNack();
+            }
+            break;
+
+        case 0x50:  // Data byte received, ACK returned
+            twiRxBuffer[twiRxIndex++] = TWDR;
+            if (twiRxIndex < twiRxEnd - 1) {
+                twiAck();
+            } else {
+                twiNack();
+            }
+            break;
+
+        case 0x58:  // Last data byte of this device received, NACK returned
+            twiRxBuffer[twiRxIndex++] = TWDR;
+            twiNextDevice();
+            break;
+
+        case 0x48:  // SLA+R sent, NACK received: skip this device
+            twiFailedMask |= (uint8_t)(1 << twiDeviceIndex);
+            twiNextDevice();
+            break;
+
+        case 0x20:  // SLA+W sent, NACK received
+        case 0x30:  // Data byte sent, NACK received
+            twiSendStop();
+            twiStatus = TWI_NACK;
+            break;
+
+        case 0x38:  // Arbitration lost
+            twiNack();  // Release the bus
+            twiStatus = TWI_BUS_ERROR;
+            break;
+
+        default:    // 0x00 bus error or an unexpected code
+            twiSendStop();
+            twiStatus = TWI_BUS_ERROR;
+            break;
+    }
+}
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef HEATER_WATCHDOG_H
+#define HEATER_WATCHDOG_H
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include <string.h>
+#include "Crc8.h"
+#include "FastPin.h"
+#include "HeaterFsm.h"
+#include "Scheduler.h"
+
+// ====== WATCHDOG SUPERVISOR ======
+// A hung bus read or a stalled loop() leaves the heater pins as they were
+// last written, possibly on. The AVR watchdog catches both: the
+// supervisor feeds it from loop() only while every scheduler task has
+// checked in within its deadline (Scheduler::overdue()), so a task that
+// never returns, or one starved by the others, stops the feeding.
+//
+// The watchdog runs in interrupt-and-reset mode. The first timeout runs
+// WDT_vect below, which switches every heater off through the port
+// registers (like OverheatInterrupt.h), halts the scheduler so no task
+// switches one back on, and notes in the reset record which task was
+// running and which were late. The hardware clears WDIE on that vector,
+// so the next timeout, one period later, resets the part. With the
+// default 250 ms the heaters are off within 250 ms of a stall and the
+// board restarts 250 ms after that.
+//
+// The reset record lives in .noinit RAM, which the C runtime does not
+// clear, so it survives every reset but a power cycle. The supervisor
+// keeps each zone's FSM state in it as the states change; after a reset
+// watchdogBoot() finds there what the controller was doing and why it
+// stopped. A CRC-8 over the record tells a kept one from the random
+// contents of RAM after power-up. The bootloader on the Uno clears MCUSR
+// before the sketch starts, so the cause is often 0; a stall from the
+// ISR is recorded even then.
+//
+// This header defines the WDT_vect ISR. Include it from exactly one
+// translation unit (the sketch).
+
+const uint8_t RESET_RECORD_ZONES = 8;
+
+// Reset cause bits, as in MCUSR
+const uint8_t RESET_POWER_ON = _BV(PORF);
+const uint8_t RESET_EXTERNAL = _BV(EXTRF);
+const uint8_t RESET_BROWN_OUT = _BV(BORF);
+const uint8_t RESET_WATCHDOG = _BV(WDRF);
+
+struct ResetRecord {
+    uint8_t cause;     // RESET_* bits of the reset that started this run, 0 if unknown
+    uint8_t resets;    // Resets since power-up (saturates)
+    bool stalled;      // WDT_vect ran: the watchdog was not fed
+    int8_t task;       // Task running when it ran, -1 if between tasks
+    uint8_t overdue;   // Tasks past their deadline at the last check (Scheduler::overdue())
+    uint8_t zones;     // Entries of state[] in use
+    uint8_t state[RESET_RECORD_ZONES];  // HeaterState of each zone at the last check
+    uint8_t crc;       // CRC-8 of the bytes above
+};
+
+// ====== RECORD (shared with the ISR) ======
+static ResetRecord watchdogRecord __attribute__((section(".noinit")));
+static ResetRecord watchdogLastReset;  // The record watchdogBoot() found: the previous run
+static uint8_t watchdogHeaterMask[FAST_PORT_COUNT] = {0, 0, 0};  // Heater pin bits per port
+
+static inline void watchdogSeal() {
+    watchdogRecord.crc = crc8((const uint8_t*)&watchdogRecord, sizeof(watchdogRecord) - 1);
+}
+
+// Timed sequence: the new WDE and prescaler only take if written within
+// four cycles of setting WDCE
+static inline void watchdogWrite(uint8_t control) {
+    uint8_t sreg = SREG;
+    cli();
+    wdt_reset();
+    WDTCSR = _BV(WDCE) | _BV(WDE);
+    WDTCSR = control;
+    SREG = sreg;
+}
+
+// The first thing setup() calls. Switches the heaters off (latched low,
+// outputs) before anything else can run, stops the watchdog a watchdog
+// reset leaves running at 16 ms, and moves the previous run's record to
+// watchdogLastReset. zones heaters from heaterPin up, as the controller.
+static inline void watchdogBoot(uint8_t heaterPin, uint8_t zones) {
+    uint8_t masks[FAST_PORT_COUNT] = {0, 0, 0};
+    for (uint8_t zone = 0; zone < zones; zone++) {
+        masks[fastPinPort(heaterPin + zone)] |= fastPinMask(heaterPin + zone);
+    }
+    PORTB &= ~masks[FAST_PORT_B];
+    PORTC &= ~masks[FAST_PORT_C];
+    PORTD &= ~masks[FAST_PORT_D];
+    DDRB |= masks[FAST_PORT_B];
+    DDRC |= masks[FAST_PORT_C];
+    DDRD |= masks[FAST_PORT_D];
+    memcpy(watchdogHeaterMask, masks, sizeof(masks));
+
+    uint8_t cause = MCUSR;
+    MCUSR = 0;  // WDRF forces WDE on until cleared
+    watchdogWrite(0);
+
+    bool kept = !(cause & RESET_POWER_ON)
+                && crc8((const uint8_t*)&watchdogRecord, sizeof(watchdogRecord)) == 0
+                && watchdogRecord.zones <= RESET_RECORD_ZONES;
+    if (!kept) {
+        memset(&watchdogRecord, 0, sizeof(watchdogRecord));
+        watchdogRecord.task = -1;
+    } else if (watchdogRecord.stalled) {
+        cause |= RESET_WATCHDOG;  // Even if the bootloader cleared MCUSR
+    }
+    watchdogLastReset = watchdogRecord;
+    watchdogLastReset.cause = cause;
+    watchdogRecord.cause = cause;
+    if (kept && watchdogRecord.resets < 255) {
+        watchdogRecord.resets++;
+    }
+    watchdogRecord.stalled = false;
+    watchdogRecord.task = -1;
+    watchdogRecord.overdue = 0;
+    watchdogSeal();
+    schedulerHalted = false;
+    schedulerRunning = -1;
+}
+
+// ====== WATCHDOG INTERRUPT ======
+// Heaters off first, then the record. Nothing is fed from here on, so the
+// reset follows a timeout later whatever the main line does.
+ISR(WDT_vect) {
+    PORTB &= ~watchdogHeaterMask[FAST_PORT_B];
+    PORTC &= ~watchdogHeaterMask[FAST_PORT_C];
+    PORTD &= ~watchdogHeaterMask[FAST_PORT_D];
+    schedulerHalted = true;
+    watchdogRecord.stalled = true;
+    watchdogRecord.task = schedulerRunning;
+    watchdogSeal();
+}
+
+// Prints a reset record on one line, e.g.
+// "reset watchdog resets 2 task 1 overdue 6 states HEATING"
+static inline void printResetRecord(Print& out, const ResetRecord& record) {
+    out.print(F("reset"));
+    if (record.cause == 0) {
+        out.print(F(" unknown"));
+    }
+    if (record.cause & RESET_POWER_ON) {
+        out.print(F(" power-on"));
+    }
+    if (record.cause & RESET_EXTERNAL) {
+        out.print(F(" external"));
+    }
+    if (record.cause & RESET_BROWN_OUT) {
+        out.print(F(" brown-out"));
+    }
+    if (record.cause & RESET_WATCHDOG) {
+        out.print(F(" watchdog"));
+    }
+    out.print(F(" resets "));
+    out.print(record.resets);
+    if (record.stalled) {
+        out.print(F(" task "));
+        out.print((int)record.task);
+        out.print(F(" overdue "));
+        out.print(record.overdue);
+    }
+    if (record.zones > 0) {
+        out.print(F(" states"));
+        for (uint8_t zone = 0; zone < record.zones; zone++) {
+            out.print(' ');
+            printStateName(out, (HeaterState)record.state[zone]);
+        }
+    }
+    out.println();
+}
+
+// ====== SUPERVISOR ======
+// Sched is the sketch's Scheduler, Controller its HeaterController.
+template <class Sched, class Controller>
+class WatchdogSupervisor {
+    static_assert(Controller::zoneCount() <= RESET_RECORD_ZONES, "The reset record holds 8 zones");
+
+public:
+    WatchdogSupervisor(Sched& taskScheduler, Controller& heaterController)
+        : scheduler(taskScheduler), controller(heaterController) {}
+
+    // Starts the watchdog, at the end of setup() once the blocking bus
+    // scans are done. timeout is a WDTO_ code (250 ms by default).
+    void begin(uint8_t timeout = WDTO_250MS) {
+        watchdogRecord.zones = Controller::zoneCount();
+        record(scheduler.overdue());
+        uint8_t prescaler = (timeout & 0x07) | ((timeout & 0x08) ? _BV(WDP3) : 0);
+        watchdogWrite(_BV(WDIE) | _BV(WDE) | prescaler);
+    }
+
+    // Call from loop() after every scheduler.run(): keeps the record
+    // current and feeds the watchdog if no task is overdue. Once WDT_vect
+    // has run the record stays as the ISR left it, and the reset comes.
+    void check() {
+        if (schedulerHalted) {
+            return;
+        }
+        uint8_t late = scheduler.overdue();
+        bool changed = late != watchdogRecord.overdue;
+        for (uint8_t zone = 0; zone < Controller::zoneCount(); zone++) {
+            changed = changed || watchdogRecord.state[zone] != controller.state(zone);
+        }
+        if (changed) {
+            record(late);
+        }
+        if (late == 0) {
+            wdt_reset();
+        }
+    }
+
+private:
+    // States and late tasks into the record, with interrupts off so the
+    // ISR never seals half of an update
+    void record(uint8_t late) {
+        uint8_t sreg = SREG;
+        cli();
+        watchdogRecord.overdue = late;
+        for (uint8_t zone = 0; zone < Controller::zoneCount(); zone++) {
+            watchdogRecord.state[zone] = controller.state(zone);
+        }
+        watchdogSeal();
+        SREG = sreg;
+    }
+
+    Sched& scheduler;
+    Controller& controller;
+};
+
+#endif
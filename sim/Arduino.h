@@ -0,0 +1,114 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// ====== HOST MOCK OF THE ARDUINO CORE ======
+// Just enough of the Arduino API for the firmware headers and sketches to
+// compile natively. Time is virtual: millis()/micros() return the
+// simulation clock, which only moves when the harness advances it.
+// AVR registers are plain variables (see avr/io.h); the harness plays the
+// peripherals by reading and writing them and calling the ISRs directly.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define DEC 10
+#define HEX 16
+
+// Arduino Uno pin numbers
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define SDA 18
+#define SCL 19
+#define LED_BUILTIN 13
+#define NUM_DIGITAL_PINS 20
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bit(b) (1UL << (b))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+// ====== PRINT / SERIAL ======
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const uint8_t* data, size_t length);
+
+    size_t print(const char* s);
+    size_t print(const __FlashStringHelper* s);
+    size_t print(char c);
+    size_t print(unsigned char v, int base = DEC);
+    size_t print(int v, int base = DEC);
+    size_t print(unsigned int v, int base = DEC);
+    size_t print(long v, int base = DEC);
+    size_t print(unsigned long v, int base = DEC);
+    size_t print(double v, int digits = 2);
+
+    size_t println();
+    template <class T> size_t println(T v) { return print(v) + println(); }
+    template <class T> size_t println(T v, int format) { return print(v, format) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// Serial port backed by host buffers: output is collected (or discarded),
+// input is whatever the harness queued with simSerialInput()
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud);
+    void end();
+    size_t write(uint8_t c);
+    using Print::write;
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    void flush();
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,397 @@
+// ====== HOST IMPLEMENTATION OF THE MOCK ARDUINO CORE ======
+// Virtual clock, pin states, AVR register storage and the serial port.
+// See SimHardware.h for the harness-side API.
+
+#include "Arduino.h"
+#include "SimHardware.h"
+#include "avr/eeprom.h"
+#include "avr/wdt.h"
+
+#include <stdio.h>
+#include <deque>
+#include <vector>
+
+// ====== REGISTERS ======
+volatile uint8_t ADCSRA, ADCSRB, ADMUX, DIDR0;
+volatile uint16_t ADC;
+volatile uint8_t TWBR, TWSR, TWDR, TWCR;
+volatile uint8_t EICRA, EIMSK, EIFR;
+volatile uint8_t ACSR, PRR, SMCR;
+volatile uint8_t WDTCSR, MCUSR;
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t TCNT1, OCR1A, OCR1B;
+SimFlagRegister TIFR1;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C;
+volatile uint16_t UBRR0;
+SimUsartData UDR0;
+
+// ====== VIRTUAL TIME ======
+static uint64_t simClock = 0;  // Microseconds since simReset()
+
+static SimHook idleHook = 0;
+
+unsigned long millis() { return (unsigned long)(simClock / 1000); }
+
+// Reading the clock costs 1 µs and gives the hardware a chance to move, so
+// firmware busy-waits (twiWait()) finish or time out
+unsigned long micros() {
+    simClock++;
+    if (idleHook) {
+        idleHook();
+    }
+    return (unsigned long)simClock;
+}
+// ====== TIMER1 ======
+static uint64_t timer1Next = 0;  // simClock of the next compare match (0: stopped)
+static unsigned long timer1Matches = 0;
+static SimAdc* triggeredAdc = 0;
+
+void simAttachAdc(SimAdc* adc) { triggeredAdc = adc; }
+unsigned long simTimer1Matches() { return timer1Matches; }
+
+// Compare match period in µs, 0 unless clocked and in CTC mode
+static uint64_t timer1Period() {
+    static const uint16_t prescalers[] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    uint16_t prescaler = prescalers[TCCR1B & 0x07];
+    if ((PRR & _BV(PRTIM1)) || prescaler == 0 || (TCCR1B & (_BV(WGM13) | _BV(WGM12))) != _BV(WGM12)) {
+        return 0;
+    }
+    return ((uint64_t)OCR1A + 1) * prescaler * 1000000ULL / F_CPU;
+}
+
+static void timer1Match() {
+    timer1Matches++;
+    bool edge = !(TIFR1 & _BV(OCF1B));
+    TIFR1.value |= _BV(OCF1A) | _BV(OCF1B);
+    if (TIMSK1 & _BV(OCIE1A)) {
+        TIFR1.value &= ~_BV(OCF1A);  // Cleared by running the vector
+        TIMER1_COMPA_vect();
+    }
+    bool triggered = (ADCSRA & _BV(ADEN)) && (ADCSRA & _BV(ADATE)) && (ADCSRB & 0x07) == (_BV(ADTS2) | _BV(ADTS0));
+    if (edge && triggered && triggeredAdc) {
+        triggeredAdc->trigger();
+    }
+}
+
+// ====== WATCHDOG ======
+static uint64_t watchdogFedAt = 0;  // simClock of the last wdt_reset()
+static unsigned long watchdogResets = 0;
+
+void wdt_reset() { watchdogFedAt = simClock; }
+unsigned long simWatchdogResets() { return watchdogResets; }
+
+// Timeout in µs, 0 while the watchdog is stopped
+static uint64_t watchdogTimeout() {
+    if (!(WDTCSR & (_BV(WDE) | _BV(WDIE)))) {
+        return 0;
+    }
+    uint8_t prescaler = (WDTCSR & 0x07) | ((WDTCSR & _BV(WDP3)) ? 8 : 0);
+    return 16000ULL << prescaler;
+}
+
+static void watchdogTimeoutReached() {
+    watchdogFedAt = simClock;
+    if (WDTCSR & _BV(WDIE)) {
+        if (WDTCSR & _BV(WDE)) {
+            WDTCSR &= ~_BV(WDIE);  // Cleared by running the vector: the next timeout resets
+        }
+        WDT_vect();  // WDIF set and cleared again by running the vector
+    } else {
+        watchdogResets++;
+        MCUSR |= _BV(WDRF);
+        WDTCSR = 0;
+    }
+}
+
+// Moves the clock to target, running the matches and watchdog timeouts
+// on the way, in order
+static void advanceTo(uint64_t target) {
+    for (;;) {
+        uint64_t period = timer1Period();
+        if (period == 0) {
+            timer1Next = 0;
+        } else if (timer1Next == 0 || timer1Next > simClock + period) {
+            timer1Next = simClock + period;  // Just started, or restarted with a shorter period
+        }
+        uint64_t timeout = watchdogTimeout();
+        uint64_t watchdogNext = timeout ? watchdogFedAt + timeout : 0;
+        bool watchdog = watchdogNext && (timer1Next == 0 || watchdogNext <= timer1Next);
+        uint64_t next = watchdog ? watchdogNext : timer1Next;
+        if (next == 0 || next > target) {
+            break;
+        }
+        simClock = next > simClock ? next : simClock;
+        if (watchdog) {
+            watchdogTimeoutReached();
+        } else {
+            timer1Next += period;
+            timer1Match();
+        }
+    }
+    simClock = target > simClock ? target : simClock;
+}
+
+void delay(unsigned long ms) { advanceTo(simClock + (uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { advanceTo(simClock + us); }
+
+void simAdvanceMicros(uint64_t us) { advanceTo(simClock + us); }
+void simSetIdleHook(SimHook hook) { idleHook = hook; }
+uint64_t simNowMicros() { return simClock; }
+
+// ====== PINS ======
+// Pin levels live in the port latches, as on the part, so the firmware's
+// direct port writes (FastPin.h) and digitalWrite() see the same state
+SimPort PORTB, PORTC, PORTD;
+SimPort DDRB, DDRC, DDRD;
+SimPinRegister PINB = {8}, PINC = {14}, PIND = {0};
+static SimPinReader pinReader = 0;
+static SimHook lineHook = 0;
+
+// Uno numbering: D0-D7 on PORTD, D8-D13 on PORTB, D14-D19 on PORTC
+static SimPort& pinPort(uint8_t pin) { return pin < 8 ? PORTD : (pin < 14 ? PORTB : PORTC); }
+static SimPort& pinDdr(uint8_t pin) { return pin < 8 ? DDRD : (pin < 14 ? DDRB : DDRC); }
+static uint8_t pinBit(uint8_t pin) { return pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14); }
+static bool pinIsOutput(uint8_t pin) { return pinDdr(pin) & _BV(pinBit(pin)); }
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    if (mode == OUTPUT) {
+        pinDdr(pin) |= _BV(pinBit(pin));
+    } else {
+        pinDdr(pin) &= ~_BV(pinBit(pin));
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    if (value) {
+        pinPort(pin) |= _BV(pinBit(pin));
+    } else {
+        pinPort(pin) &= ~_BV(pinBit(pin));
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return LOW;
+    }
+    if (!pinIsOutput(pin) && pinReader) {
+        return pinReader(pin);
+    }
+    // Outputs read back their latch; undriven inputs float high (pull-ups)
+    return pinIsOutput(pin) ? simPinLevel(pin) : HIGH;
+}
+
+int analogRead(uint8_t) { return 0; }
+void attachInterrupt(uint8_t, void (*)(), int) {}
+void detachInterrupt(uint8_t) {}
+
+uint8_t simPinLevel(uint8_t pin) {
+    return pin < NUM_DIGITAL_PINS && (pinPort(pin) & _BV(pinBit(pin))) ? HIGH : LOW;
+}
+unsigned long simPinToggles(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? pinPort(pin).toggles[pinBit(pin)] : 0; }
+void simSetPinReader(SimPinReader reader) { pinReader = reader; }
+void simSetLineHook(SimHook hook) { lineHook = hook; }
+
+void simPortWritten() {
+    if (lineHook) {
+        lineHook();
+    }
+}
+
+SimPinRegister::operator uint8_t() const {
+    uint8_t levels = 0;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        uint8_t pin = firstPin + bit;
+        if (pin < NUM_DIGITAL_PINS && digitalRead(pin) == HIGH) {
+            levels |= _BV(bit);
+        }
+    }
+    return levels;
+}
+
+// ====== EEPROM ======
+// Not cleared by simReset(): it survives power cycles
+static const uint64_t EEPROM_WRITE_US = 3400;
+static uint8_t eepromData[E2END + 1];
+static unsigned long eepromWrites[E2END + 1];
+static uint64_t eepromBusyUntil = 0;
+static unsigned long eepromWaits = 0;
+static bool eepromInitialised = false;
+
+static void eepromWait() {
+    if (!eepromInitialised) {
+        simEepromErase();
+    }
+    if (simClock < eepromBusyUntil) {
+        eepromWaits++;
+        simClock = eepromBusyUntil;
+    }
+}
+
+bool simEepromReady() { return simClock >= eepromBusyUntil; }
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+    eepromWait();
+    return eepromData[(uintptr_t)address & E2END];
+}
+
+void eeprom_write_byte(uint8_t* address, uint8_t value) {
+    eepromWait();
+    uintptr_t index = (uintptr_t)address & E2END;
+    eepromData[index] = value;
+    eepromWrites[index]++;
+    eepromBusyUntil = simClock + EEPROM_WRITE_US;
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value) {
+    if (eeprom_read_byte(address) != value) {
+        eeprom_write_byte(address, value);
+    }
+}
+
+void eeprom_read_block(void* destination, const void* source, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        ((uint8_t*)destination)[i] = eeprom_read_byte((const uint8_t*)source + i);
+    }
+}
+
+void simEepromErase() {
+    memset(eepromData, 0xFF, sizeof(eepromData));
+    memset(eepromWrites, 0, sizeof(eepromWrites));
+    eepromBusyUntil = 0;
+    eepromWaits = 0;
+    eepromInitialised = true;
+}
+
+uint8_t simEepromByte(uint16_t address) {
+    eepromWait();
+    return eepromData[address & E2END];
+}
+void simEepromPoke(uint16_t address, uint8_t value) {
+    eepromWait();
+    eepromData[address & E2END] = value;
+}
+unsigned long simEepromWrites(uint16_t address) { return eepromWrites[address & E2END]; }
+unsigned long simEepromWaits() { return eepromWaits; }
+
+// ====== PRINT ======
+size_t Print::write(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        write(data[i]);
+    }
+    return length;
+}
+
+static size_t printText(Print& out, const char* s) {
+    return out.write((const uint8_t*)s, strlen(s));
+}
+
+size_t Print::print(const char* s) { return printText(*this, s); }
+size_t Print::print(const __FlashStringHelper* s) { return printText(*this, (const char*)s); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char v, int base) { return print((unsigned long)v, base); }
+size_t Print::print(int v, int base) { return print((long)v, base); }
+size_t Print::print(unsigned int v, int base) { return print((unsigned long)v, base); }
+
+size_t Print::print(long v, int base) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%ld", v);
+    return printText(*this, text);
+}
+
+size_t Print::print(unsigned long v, int base) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", v);
+    return printText(*this, text);
+}
+
+size_t Print::print(double v, int digits) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", digits, v);
+    return printText(*this, text);
+}
+
+size_t Print::println() { return write('\r') + write('\n'); }
+
+// ====== SERIAL ======
+HardwareSerial Serial;
+
+static std::deque<uint8_t> serialInput;
+static std::vector<uint8_t> serialOutput;
+static bool serialEcho = false;
+
+void HardwareSerial::begin(unsigned long) {}
+void HardwareSerial::end() {}
+
+size_t HardwareSerial::write(uint8_t c) {
+    serialOutput.push_back(c);
+    if (serialEcho) {
+        fputc(c, stdout);
+    }
+    return 1;
+}
+
+int HardwareSerial::available() { return (int)serialInput.size(); }
+
+int HardwareSerial::read() {
+    if (serialInput.empty()) {
+        return -1;
+    }
+    int c = serialInput.front();
+    serialInput.pop_front();
+    return c;
+}
+
+int HardwareSerial::peek() { return serialInput.empty() ? -1 : serialInput.front(); }
+// The Uno's TX ring holds 63 bytes; the host drains it instantly
+int HardwareSerial::availableForWrite() { return 63; }
+void HardwareSerial::flush() {}
+
+void simSerialInput(const char* text) {
+    while (*text) {
+        serialInput.push_back((uint8_t)*text++);
+    }
+}
+
+void simSerialEcho(bool echo) { serialEcho = echo; }
+const std::vector<uint8_t>& simSerialOutput() { return serialOutput; }
+void simSerialClear() { serialOutput.clear(); }
+
+// ====== RESET ======
+void simReset() {
+    simClock = 0;
+    memset(&PORTB, 0, sizeof(PORTB));
+    memset(&PORTC, 0, sizeof(PORTC));
+    memset(&PORTD, 0, sizeof(PORTD));
+    memset(&DDRB, 0, sizeof(DDRB));
+    memset(&DDRC, 0, sizeof(DDRC));
+    memset(&DDRD, 0, sizeof(DDRD));
+    pinReader = 0;
+    lineHook = 0;
+    idleHook = 0;
+    ADCSRA = ADCSRB = ADMUX = DIDR0 = 0;
+    ADC = 0;
+    TWBR = TWSR = TWDR = TWCR = 0;
+    EICRA = EIMSK = EIFR = 0;
+    ACSR = PRR = SMCR = 0;
+    WDTCSR = MCUSR = 0;
+    watchdogFedAt = 0;
+    watchdogResets = 0;
+    SREG = 0;
+    TCCR1A = TCCR1B = TIMSK1 = 0;
+    TCNT1 = OCR1A = OCR1B = 0;
+    TIFR1.value = 0;
+    UCSR0A = UCSR0B = UCSR0C = 0;
+    UBRR0 = 0;
+    memset(&UDR0, 0, sizeof(UDR0));
+    timer1Next = 0;
+    timer1Matches = 0;
+    serialInput.clear();
+    serialOutput.clear();
+}
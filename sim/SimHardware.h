@@ -0,0 +1,694 @@
+#ifndef SIM_HARDWARE_H
+#define SIM_HARDWARE_H
+
+// ====== HARNESS-SIDE HARDWARE API ======
+// What the simulation uses to drive the mock core: the virtual clock, pin
+// readback, the serial port, and emulators for the peripherals the
+// firmware talks to through registers (the ADC, LM75s on the TWI bus,
+// DS18B20s on a 1-Wire line, and the UART on an RS-485 line). The
+// emulators play the hardware's side of the register protocol and call
+// the firmware's own ISRs, so AdcSampler.h, TwiMaster.h, OneWireBus.h,
+// ModbusNode.h and the sensor policies run unmodified.
+
+#include <math.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "Arduino.h"
+#include "../common/Crc8.h"
+
+// ====== CORE CONTROL ======
+void simReset();                     // Clock to 0, pins low, registers cleared
+void simAdvanceMicros(uint64_t us);  // Moves virtual time forward
+uint64_t simNowMicros();
+// Called from every micros(); lets an emulated peripheral progress while
+// the firmware busy-waits on it (setup-time bus scans)
+typedef void (*SimHook)();
+void simSetIdleHook(SimHook hook);
+
+uint8_t simPinLevel(uint8_t pin);
+unsigned long simPinToggles(uint8_t pin);  // Level changes since simReset()
+// Supplies digitalRead() levels for pins that are not outputs
+typedef int (*SimPinReader)(uint8_t pin);
+void simSetPinReader(SimPinReader reader);
+// Called after every write to a port or direction register, so a line
+// emulator sees each pin change at the virtual time it happens
+void simSetLineHook(SimHook hook);
+
+void simSerialInput(const char* text);  // Queues bytes for Serial.read()
+void simSerialEcho(bool echo);          // Copy serial output to stdout
+const std::vector<uint8_t>& simSerialOutput();
+void simSerialClear();
+
+// EEPROM (avr/eeprom.h). Its contents survive simReset(), like the part's.
+void simEepromErase();                          // All 0xFF, counters cleared
+uint8_t simEepromByte(uint16_t address);
+void simEepromPoke(uint16_t address, uint8_t value);  // Corrupt a byte
+unsigned long simEepromWrites(uint16_t address);      // Write cycles of one cell
+unsigned long simEepromWaits();  // Accesses that had to wait for a write
+
+// ISRs defined by the firmware headers
+extern "C" void ADC_vect(void);
+extern "C" void TWI_vect(void);
+extern "C" void INT0_vect(void);
+extern "C" void INT1_vect(void);
+extern "C" void TIMER1_COMPA_vect(void);
+extern "C" void USART_RX_vect(void);
+extern "C" void USART_UDRE_vect(void);
+extern "C" void USART_TX_vect(void);
+extern "C" void WDT_vect(void);
+
+// ====== TIMER1 ======
+// Timer1 counts in virtual time while it is clocked (PRR, TCCR1B) and in
+// CTC mode: every simAdvanceMicros() / delay() runs the compare matches
+// that fall inside it at their own instants. A match sets OCF1A and
+// OCF1B, runs TIMER1_COMPA_vect() if OCIE1A is set, and starts a
+// conversion on the attached SimAdc if the ADC is auto-triggered by
+// Compare Match B and the firmware has cleared OCF1B since the last one.
+unsigned long simTimer1Matches();  // Since simReset()
+
+// ====== WATCHDOG ======
+// The watchdog counts in virtual time like Timer1, in steps of 16 ms << the
+// WDTCSR prescaler, from the last wdt_reset(). A timeout with WDIE set
+// sets WDIF and runs WDT_vect() (clearing WDIE too if WDE is set, so the
+// next timeout resets); one with only WDE set is a system reset. The
+// harness cannot restart the firmware, so a reset is only counted and
+// stops the watchdog: reboot with simReset() and MCUSR = _BV(WDRF).
+unsigned long simWatchdogResets();  // Since simReset()
+
+// ====== ADC EMULATOR ======
+// Completes conversions of a voltage on the 5 V AVcc reference, with an
+// optional deterministic +-1 LSB dither so oversampling has noise to
+// average (a real ADC always has some).
+// A clocked ADC (Timer1 Compare Match B trigger) converts input at every
+// trigger instead; the latest SimAdc constructed is the one attached.
+class SimAdc;
+void simAttachAdc(SimAdc* adc);  // 0 detaches
+
+class SimAdc {
+public:
+    SimAdc() : dither(true), input(0.0), stopped(false), noise(12345) { simAttachAdc(this); }
+    ~SimAdc() { simAttachAdc(0); }
+
+    void convert(double volts, unsigned int conversions) {
+        if (!(ADCSRA & _BV(ADEN))) {
+            return;
+        }
+        double exact = volts / 5.0 * 1024.0;
+        for (unsigned int i = 0; i < conversions; i++) {
+            double value = exact + (dither ? nextDither() : 0.0);
+            ADC = value < 0 ? 0 : (value > 1023 ? 1023 : (uint16_t)value);
+            if (ADCSRA & _BV(ADIE)) {
+                ADC_vect();
+            }
+        }
+    }
+
+    // One triggered conversion of input (Timer1 calls this)
+    void trigger() {
+        if (!stopped) {
+            convert(input, 1);
+        }
+    }
+
+    bool dither;
+    double input;  // Volts seen by triggered conversions
+    bool stopped;  // Triggers no longer convert (a stalled ADC)
+
+private:
+    // Uniform in [-1, 1) LSB from a small LCG
+    double nextDither() {
+        noise = noise * 1103515245u + 12345u;
+        return ((noise >> 16) & 0x7FFF) / 16384.0 - 1.0;
+    }
+
+    uint32_t noise;
+};
+
+// ====== TWI BUS AND LM75 SLAVES ======
+// An LM75 register file (pointer, temperature, config, Thyst, Tos) and
+// its thermostat output in comparator mode. bits is the part's fixed
+// resolution (9: LM75, 11: LM75B), or 0 for a TMP75, which converts at
+// 9 + config bits 6:5 and keeps 12-bit limits.
+class SimLm75 {
+public:
+    explicit SimLm75(uint8_t busAddress, uint8_t bits = 9)
+        : address(busAddress), present(true), pointerWrites(0), fixedBits(bits), pointer(0), config(0),
+          thyst(75 << 8), tos(80 << 8), temperature(0), byteIndex(0), os(false) {}
+
+    // Temperature the sensor will report, quantised like the part (0.5 °C
+    // on an LM75). OS asserts above Tos and releases below Thyst.
+    void setTemperature(double celsius) {
+        int shift = 16 - resolution();
+        double scale = 256.0 / (1 << shift);
+        int steps = (int)(celsius * scale + (celsius < 0 ? -0.5 : 0.5));
+        temperature = (uint16_t)((int16_t)(steps << shift));
+        if ((int16_t)temperature > (int16_t)tos) {
+            os = true;
+        } else if ((int16_t)temperature < (int16_t)thyst) {
+            os = false;
+        }
+    }
+
+    // OS output asserted; with config bit 2 clear the pin is then low
+    bool osAsserted() const { return os; }
+
+    // Bus side. select() starts a new direction after SLA+R/W
+    void select() { byteIndex = 0; }
+
+    // First byte after SLA+W selects the register, the rest write it MSB first
+    void writeByte(uint8_t value) {
+        if (byteIndex++ == 0) {
+            pointer = value & 0x03;
+            pointerWrites++;
+            return;
+        }
+        uint8_t offset = byteIndex - 2;
+        if (pointer == 1) {
+            config = value;
+        } else if (pointer == 2 || pointer == 3) {
+            uint16_t& reg = pointer == 2 ? thyst : tos;
+            uint8_t fraction = fixedBits ? 0x80 : 0xF0;
+            reg = offset == 0 ? (uint16_t)((value << 8) | (reg & 0xFF)) : (uint16_t)((reg & 0xFF00) | (value & fraction));
+        }
+    }
+
+    uint8_t readByte() {
+        if (pointer == 1) {
+            return config;
+        }
+        uint16_t value = pointer == 0 ? temperature : (pointer == 2 ? thyst : tos);
+        bool msb = (byteIndex++ & 1) == 0;
+        return (uint8_t)(msb ? value >> 8 : value);
+    }
+
+    uint8_t registerPointer() const { return pointer; }
+    uint16_t thresholdTos() const { return tos; }
+    uint16_t thresholdThyst() const { return thyst; }
+    uint8_t configuration() const { return config; }
+    uint8_t resolution() const { return fixedBits ? fixedBits : 9 + ((config >> 5) & 0x03); }
+
+    uint8_t address;
+    bool present;                 // false: the address is NACKed
+    unsigned long pointerWrites;  // Register pointer updates
+
+private:
+    uint8_t fixedBits;
+    uint8_t pointer;
+    uint8_t config;
+    uint16_t thyst, tos, temperature;  // Register images, MSB:LSB
+    uint8_t byteIndex;                 // Bytes since SLA in this direction
+    bool os;                           // Thermostat output state
+};
+
+// Emulation of the ATmega's TWI master hardware with slaves attached.
+// service() carries out whatever bus operation the firmware last requested
+// through TWCR, sets TWSR to the status code the hardware would, and calls
+// TWI_vect(), until the firmware issues a STOP: one whole transaction per
+// call. A real LM75 read or burst takes well under a millisecond, so the
+// harness calls service() about as often as that much time passes.
+class SimTwiBus {
+public:
+    static const uint8_t MAX_DEVICES = 8;
+
+    SimTwiBus() : stuck(false), transactions(0), deviceCount(0), selected(0), phase(BUS_IDLE) {}
+
+    void attach(SimLm75* device) {
+        if (deviceCount < MAX_DEVICES) {
+            devices[deviceCount++] = device;
+        }
+    }
+
+    void service() {
+        for (uint8_t guard = 0; guard < 128 && !stuck; guard++) {
+            uint8_t command = TWCR;
+            if (!(command & _BV(TWEN)) || !(command & _BV(TWINT))) {
+                return;  // Nothing requested
+            }
+            if (command & _BV(TWSTO)) {
+                phase = BUS_IDLE;
+                transactions++;
+                TWCR = command & ~(_BV(TWINT) | _BV(TWSTO));
+                return;
+            }
+            TWCR = command & ~_BV(TWINT);  // Operation under way
+            TWSR = (TWSR & 0x07) | step(command);
+            if (TWCR & _BV(TWIE)) {
+                TWI_vect();
+            }
+        }
+    }
+
+    bool stuck;                  // true: the bus never completes (SDA held low)
+    unsigned long transactions;  // Completed (STOPped) transactions
+
+private:
+    enum Phase { BUS_IDLE, BUS_ADDRESS, BUS_WRITE, BUS_READ };
+
+    SimLm75* find(uint8_t address) const {
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            if (devices[i]->address == address && devices[i]->present) {
+                return devices[i];
+            }
+        }
+        return 0;
+    }
+
+    // One hardware operation; returns the TWSR status code
+    uint8_t step(uint8_t command) {
+        if (command & _BV(TWSTA)) {
+            uint8_t code = phase == BUS_IDLE ? 0x08 : 0x10;
+            phase = BUS_ADDRESS;
+            return code;
+        }
+        switch (phase) {
+            case BUS_ADDRESS: {
+                uint8_t sla = TWDR;
+                bool reading = (sla & 1) != 0;
+                selected = find(sla >> 1);
+                if (!selected) {
+                    phase = BUS_IDLE;
+                    return reading ? 0x48 : 0x20;
+                }
+                selected->select();
+                phase = reading ? BUS_READ : BUS_WRITE;
+                return reading ? 0x40 : 0x18;
+            }
+            case BUS_WRITE:
+                selected->writeByte(TWDR);
+                return 0x28;
+            case BUS_READ:
+                TWDR = selected->readByte();
+                return (command & _BV(TWEA)) ? 0x50 : 0x58;
+            default:
+                return 0x00;  // Bus error: data with no START
+        }
+    }
+
+    SimLm75* devices[MAX_DEVICES];
+    uint8_t deviceCount;
+    SimLm75* selected;
+    Phase phase;
+};
+
+// ====== 1-WIRE BUS AND DS18B20 SLAVES ======
+// A DS18B20's ROM ID, scratchpad and conversion, VDD powered. It sees the
+// bus as slot starts (the master pulled the line low) and slot ends (the
+// low pulse's width), and sends a 0 by holding the line low for 30 µs
+// from the start of a read slot. Another family code makes it some other
+// device as far as the ROM search goes.
+class SimDs18b20 {
+public:
+    explicit SimDs18b20(uint8_t serial, uint8_t family = 0x28)
+        : present(true), corrupt(false), convertCommands(0), celsius(25.0), mode(ASLEEP), bitCount(0),
+          shift(0), index(0), searchPhase(0), matched(false), converting(false), convertEnd(0), receiving(false),
+          holdUntil(0) {
+        const uint8_t id[7] = {family, serial, 0x5A, 0xC3, 0x00, 0x00, 0x00};
+        memcpy(rom, id, sizeof(id));
+        rom[7] = crc8(rom, 7);
+        const uint8_t powerOn[8] = {0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10};
+        memcpy(scratchpad, powerOn, sizeof(powerOn));  // 85 °C, 12 bits
+    }
+
+    // Temperature the next conversion measures
+    void setTemperature(double value) { celsius = value; }
+    uint8_t resolution() const { return 9 + ((scratchpad[4] >> 5) & 0x03); }
+    const uint8_t* romId() const { return rom; }
+
+    // Bus side
+    void reset(uint64_t now) {
+        finish(now);
+        mode = present ? ROM_COMMAND : ASLEEP;
+        bitCount = 0;
+        holdUntil = 0;
+    }
+
+    void slotStart(uint64_t now) {
+        finish(now);
+        int bit = transmitBit(now);
+        receiving = bit < 0;
+        holdUntil = bit == 0 ? now + 30 : 0;
+    }
+
+    void slotEnd(bool one) {
+        if (!receiving || mode == ASLEEP) {
+            return;
+        }
+        if (mode == SEARCH) {  // The master's direction bit
+            mode = one == romBit(index) ? (++index == 64 ? FUNCTION : SEARCH) : ASLEEP;
+            searchPhase = 0;
+            return;
+        }
+        shift = (uint8_t)((shift >> 1) | (one ? 0x80 : 0));
+        if (++bitCount == 8) {
+            bitCount = 0;
+            receiveByte(shift);
+        }
+    }
+
+    bool holdsLow(uint64_t now) const { return now < holdUntil; }
+
+    bool present;                   // false: no presence pulse, never answers
+    bool corrupt;                   // Scratchpad reads go out with a flipped bit
+    unsigned long convertCommands;  // Convert T commands received
+
+private:
+    enum Mode { ASLEEP, ROM_COMMAND, MATCH, SEARCH, FUNCTION, WRITE_SCRATCHPAD, READ_SCRATCHPAD, CONVERTING };
+
+    bool romBit(uint8_t bit) const { return (rom[bit / 8] >> (bit % 8)) & 1; }
+
+    // The bit this device sends in a slot starting now, or -1 if it listens
+    int transmitBit(uint64_t now) {
+        switch (mode) {
+            case SEARCH:
+                if (searchPhase == 2) {
+                    return -1;
+                }
+                return romBit(index) ^ (searchPhase++ == 1);
+            case READ_SCRATCHPAD:
+                if (index >= 72) {
+                    return 1;
+                }
+                index++;
+                return (sent[(index - 1) / 8] >> ((index - 1) % 8)) & 1;
+            case CONVERTING:
+                return now >= convertEnd ? 1 : 0;
+            default:
+                return -1;
+        }
+    }
+
+    void receiveByte(uint8_t value) {
+        switch (mode) {
+            case ROM_COMMAND:
+                index = 0;
+                searchPhase = 0;
+                matched = true;
+                mode = value == 0xCC ? FUNCTION : (value == 0x55 ? MATCH : (value == 0xF0 ? SEARCH : ASLEEP));  // Skip, Match, Search ROM
+                break;
+            case MATCH:
+                matched = matched && value == rom[index];
+                if (++index == 8) {
+                    mode = matched ? FUNCTION : ASLEEP;
+                }
+                break;
+            case FUNCTION:
+                index = 0;
+                if (value == 0x44) {  // Convert T
+                    convertCommands++;
+                    converting = true;
+                    convertEnd = simNowMicros() + (750000UL >> (12 - resolution()));
+                    mode = CONVERTING;
+                } else if (value == 0xBE) {  // Read Scratchpad
+                    memcpy(sent, scratchpad, 8);
+                    sent[8] = crc8(sent, 8);
+                    if (corrupt) {
+                        sent[0] ^= 0x01;
+                    }
+                    mode = READ_SCRATCHPAD;
+                } else {
+                    mode = value == 0x4E ? WRITE_SCRATCHPAD : ASLEEP;
+                }
+                break;
+            case WRITE_SCRATCHPAD:  // TH, TL, config
+                scratchpad[2 + index] = index == 2 ? (uint8_t)((value & 0x60) | 0x1F) : value;
+                mode = ++index == 3 ? ASLEEP : WRITE_SCRATCHPAD;
+                break;
+            default:
+                mode = ASLEEP;
+                break;
+        }
+    }
+
+    // Latches the measurement once a conversion's time is up, quantised
+    // to the resolution
+    void finish(uint64_t now) {
+        if (!converting || now < convertEnd) {
+            return;
+        }
+        converting = false;
+        double clamped = celsius < -55.0 ? -55.0 : (celsius > 125.0 ? 125.0 : celsius);
+        int step = 1 << (12 - resolution());
+        int raw = (int)floor(clamped * 16.0 / step + 0.5) * step;
+        scratchpad[0] = (uint8_t)(raw & 0xFF);
+        scratchpad[1] = (uint8_t)((raw >> 8) & 0xFF);
+    }
+
+    double celsius;
+    uint8_t rom[8];
+    uint8_t scratchpad[9];  // Byte 8 (CRC) is computed when read
+    uint8_t sent[9];        // The scratchpad being read out
+    Mode mode;
+    uint8_t bitCount, shift;  // Received bits of the current byte
+    uint8_t index;            // Byte (match, write), bit (search, read) under way
+    uint8_t searchPhase;      // 0: send the bit, 1: its complement, 2: hear the master's
+    bool matched;
+    bool converting;
+    uint64_t convertEnd;
+    bool receiving;           // The current slot is the master's
+    uint64_t holdUntil;       // Line held low until then
+};
+
+// The line on one pin: low while the firmware drives it (DDR set, latch
+// low) or any device holds it. A low pulse of 480 µs or more is a reset,
+// answered by a presence pulse 20..140 µs after it if any device is
+// present. connect() makes this bus the line hook and the pin reader.
+class SimOneWireBus {
+public:
+    static const uint8_t MAX_DEVICES = 8;
+
+    explicit SimOneWireBus(uint8_t linePin)
+        : resets(0), pin(linePin), deviceCount(0), masterLow(false), fallTime(0), presenceStart(0), presenceEnd(0) {}
+    ~SimOneWireBus() {
+        if (active() == this) {
+            simSetLineHook(0);
+            simSetPinReader(0);
+            active() = 0;
+        }
+    }
+
+    void attach(SimDs18b20* device) {
+        if (deviceCount < MAX_DEVICES) {
+            devices[deviceCount++] = device;
+        }
+    }
+
+    void connect() {
+        active() = this;
+        simSetLineHook(lineChanged);
+        simSetPinReader(readLine);
+    }
+
+    unsigned long resets;  // Reset pulses seen
+
+private:
+    static SimOneWireBus*& active() {
+        static SimOneWireBus* bus = 0;
+        return bus;
+    }
+
+    static void lineChanged() { active()->update(); }
+    static int readLine(uint8_t pin) { return pin == active()->pin ? active()->level() : HIGH; }
+
+    bool driven() const {
+        uint8_t bit = pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14);
+        uint8_t ddr = pin < 8 ? DDRD : (pin < 14 ? DDRB : DDRC);
+        return (ddr & _BV(bit)) && simPinLevel(pin) == LOW;
+    }
+
+    void update() {
+        bool low = driven();
+        if (low == masterLow) {
+            return;
+        }
+        masterLow = low;
+        uint64_t now = simNowMicros();
+        if (low) {
+            fallTime = now;
+            for (uint8_t i = 0; i < deviceCount; i++) {
+                devices[i]->slotStart(now);
+            }
+            return;
+        }
+        if (now - fallTime >= 480) {
+            resets++;
+            bool any = false;
+            for (uint8_t i = 0; i < deviceCount; i++) {
+                devices[i]->reset(now);
+                any = any || devices[i]->present;
+            }
+            presenceStart = any ? now + 20 : 0;
+            presenceEnd = any ? now + 140 : 0;
+            return;
+        }
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            devices[i]->slotEnd(now - fallTime < 15);
+        }
+    }
+
+    int level() const {
+        uint64_t now = simNowMicros();
+        if (masterLow || (now >= presenceStart && now < presenceEnd)) {
+            return LOW;
+        }
+        for (uint8_t i = 0; i < deviceCount; i++) {
+            if (devices[i]->holdsLow(now)) {
+                return LOW;
+            }
+        }
+        return HIGH;
+    }
+
+    uint8_t pin;
+    SimDs18b20* devices[MAX_DEVICES];
+    uint8_t deviceCount;
+    bool masterLow;
+    uint64_t fallTime;
+    uint64_t presenceStart, presenceEnd;
+};
+
+
+// ====== USART0 ON AN RS-485 LINE ======
+// The UART's receiver and transmitter in virtual time, on a half-duplex
+// line whose other end is the harness. receive() queues a byte to arrive
+// at a given instant; it sets UDR0 and runs USART_RX_vect() then, if the
+// receiver and its interrupt are on. A byte written to UDR0 takes one
+// character time in the shift register with one more waiting in the data
+// register; USART_UDRE_vect() runs while the data register is empty and
+// UDRIE0 is set, and USART_TX_vect() once the shift register runs dry
+// with TXCIE0 set. Every byte sent is logged with its end time and
+// checked against the transceiver's driver enable pin, which must be
+// high for the whole byte; it is checked low again right after the
+// transmit-complete interrupt. advance() moves the clock, running each
+// event at its own instant.
+class SimUart {
+public:
+    SimUart(unsigned long baud, uint8_t driverEnablePin, uint8_t bitsPerChar = 11)
+        : charMicros((bitsPerChar * 1000000UL + baud / 2) / baud), driverErrors(0), lateReleases(0),
+          enablePin(driverEnablePin), shifting(false), buffered(false), shiftByte(0), bufferByte(0), shiftEnd(0) {}
+
+    // Bytes back to back from at (default: after the last one queued)
+    void receive(const std::vector<uint8_t>& bytes, uint64_t at = 0) {
+        uint64_t next = at ? at : (arrivals.empty() ? simNowMicros() : arrivals.back().at);
+        for (size_t i = 0; i < bytes.size(); i++) {
+            next += charMicros;
+            Arrival arrival = {next, bytes[i]};
+            arrivals.push_back(arrival);
+        }
+    }
+    bool receiving() const { return !arrivals.empty(); }
+    uint64_t lastArrival() const { return arrivals.empty() ? simNowMicros() : arrivals.back().at; }
+
+    void advance(uint64_t us) {
+        uint64_t end = simNowMicros() + us;
+        for (;;) {
+            transmit();
+            uint64_t now = simNowMicros();
+            uint64_t next = end;
+            if (!arrivals.empty() && arrivals.front().at < next) {
+                next = arrivals.front().at;
+            }
+            if (shifting && shiftEnd < next) {
+                next = shiftEnd;
+            }
+            if (next > now) {
+                simAdvanceMicros(next - now);
+                now = next;
+            }
+            bool progressed = false;
+            if (shifting && shiftEnd <= now) {
+                shifted(now);
+                progressed = true;
+            }
+            if (!arrivals.empty() && arrivals.front().at <= now) {
+                deliver(arrivals.front().value);
+                arrivals.pop_front();
+                progressed = true;
+            }
+            if (!progressed && now >= end) {
+                transmit();
+                return;
+            }
+        }
+    }
+
+    const unsigned long charMicros;
+    std::vector<uint8_t> sent;      // Bytes the firmware transmitted
+    std::vector<uint64_t> sentAt;   // When each one's stop bit ended
+    unsigned long driverErrors;     // Bytes sent with the driver disabled
+    unsigned long lateReleases;     // Transmissions that kept the driver on after the last byte
+
+private:
+    struct Arrival {
+        uint64_t at;
+        uint8_t value;
+    };
+
+    bool driverOn() const { return simPinLevel(enablePin) == HIGH; }
+
+    void deliver(uint8_t value) {
+        if (!(UCSR0B & _BV(RXEN0))) {
+            return;
+        }
+        UDR0.received = value;
+        UCSR0A = (UCSR0A & ~(_BV(FE0) | _BV(DOR0) | _BV(UPE0))) | _BV(RXC0);
+        if (UCSR0B & _BV(RXCIE0)) {
+            USART_RX_vect();
+            UCSR0A = UCSR0A & ~_BV(RXC0);
+        }
+    }
+
+    // Takes what the firmware wrote to UDR0, and asks for more while the
+    // data register is empty
+    void transmit() {
+        for (int guard = 0; guard < 4; guard++) {
+            if (UDR0.written) {
+                UDR0.written = false;
+                if (!shifting) {
+                    startShift(UDR0.transmit);
+                } else {
+                    bufferByte = UDR0.transmit;
+                    buffered = true;
+                }
+            }
+            UCSR0A = buffered ? (UCSR0A & ~_BV(UDRE0)) : (UCSR0A | _BV(UDRE0));
+            if (buffered || !(UCSR0B & _BV(TXEN0)) || !(UCSR0B & _BV(UDRIE0))) {
+                return;
+            }
+            USART_UDRE_vect();
+        }
+    }
+
+    void startShift(uint8_t value) {
+        driverErrors += driverOn() ? 0 : 1;
+        shifting = true;
+        shiftByte = value;
+        shiftEnd = simNowMicros() + charMicros;
+    }
+
+    void shifted(uint64_t now) {
+        driverErrors += driverOn() ? 0 : 1;
+        sent.push_back(shiftByte);
+        sentAt.push_back(now);
+        shifting = false;
+        if (buffered) {
+            buffered = false;
+            startShift(bufferByte);
+            return;
+        }
+        UCSR0A = UCSR0A | _BV(TXC0);
+        if (UCSR0B & _BV(TXCIE0)) {
+            UCSR0A = UCSR0A & ~_BV(TXC0);  // Cleared by running the vector
+            USART_TX_vect();
+        }
+        lateReleases += driverOn() ? 1 : 0;
+    }
+
+    uint8_t enablePin;
+    std::deque<Arrival> arrivals;
+    bool shifting, buffered;
+    uint8_t shiftByte, bufferByte;
+    uint64_t shiftEnd;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SIM_THERMAL_PLANT_H
+#define SIM_THERMAL_PLANT_H
+
+// ====== THERMAL PLANT MODEL ======
+// Two lumped thermal masses: the heater element, and the load the sensor
+// is attached to. Heat flows heater -> load -> ambient, so the load lags
+// the heater and keeps rising after the heater switches off, which is what
+// produces overshoot on the bench. The sensor itself adds a first-order
+// lag (package and mounting). Integrated with forward Euler in small
+// sub-steps; all quantities are SI (W, J/K, W/K, s, °C).
+
+#include <math.h>
+
+struct PlantParameters {
+    double heaterPower;        // W dissipated while the heater pin is high
+    double heaterCapacity;     // J/K, heater element
+    double loadCapacity;       // J/K, load and sensor mounting
+    double heaterToLoad;       // W/K, conductance heater -> load
+    double loadToAmbient;      // W/K, losses load -> ambient
+    double sensorTimeConstant; // s, sensor lag behind the load
+    double ambient;            // °C
+};
+
+// A small block heated by a 12 W element: about 0.05 °C/s when heating,
+// about 85 °C if the heater were left on for good
+static PlantParameters defaultPlant() {
+    PlantParameters p;
+    p.heaterPower = 12.0;
+    p.heaterCapacity = 15.0;
+    p.loadCapacity = 180.0;
+    p.heaterToLoad = 1.2;
+    p.loadToAmbient = 0.2;
+    p.sensorTimeConstant = 3.0;
+    p.ambient = 22.0;
+    return p;
+}
+
+class ThermalPlant {
+public:
+    explicit ThermalPlant(const PlantParameters& parameters) : p(parameters), disturbance(0.0) { reset(); }
+
+    void reset() {
+        heater = load = sensor = p.ambient;
+    }
+
+    // Advances the model by dt seconds with the heater on or off
+    void step(double dt, bool heaterOn) {
+        const double maxStep = 0.05;
+        int steps = (int)ceil(dt / maxStep);
+        double h = dt / steps;
+        for (int i = 0; i < steps; i++) {
+            double toLoad = (heater - load) * p.heaterToLoad;
+            double toAmbient = (load - p.ambient) * p.loadToAmbient;
+            heater += h * ((heaterOn ? p.heaterPower : 0.0) - toLoad) / p.heaterCapacity;
+            load += h * (toLoad - toAmbient + disturbance) / p.loadCapacity;
+            sensor += h * (load - sensor) / p.sensorTimeConstant;
+        }
+    }
+
+    double heaterTemperature() const { return heater; }
+    double loadTemperature() const { return load; }
+    double sensorTemperature() const { return sensor; }
+
+    PlantParameters p;
+    double disturbance;  // Extra W into the load (e.g. a neighbouring heat source)
+
+private:
+    double heater, load, sensor;
+};
+
+#endif
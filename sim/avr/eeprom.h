@@ -0,0 +1,22 @@
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+// ====== HOST MOCK OF <avr/eeprom.h> ======
+// 1 KB of EEPROM (erased: 0xFF) with the part's timing: a byte write
+// takes 3.4 ms of virtual time, and like avr-libc every call waits for a
+// write still in progress. The harness can read the wear counters and
+// whether the firmware ever had to wait (see SimHardware.h).
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x3FF
+
+bool simEepromReady();
+#define eeprom_is_ready() simEepromReady()
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+void eeprom_update_byte(uint8_t* address, uint8_t value);
+void eeprom_read_block(void* destination, const void* source, size_t length);
+
+#endif
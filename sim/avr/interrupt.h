@@ -0,0 +1,10 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+// ====== HOST MOCK OF <avr/interrupt.h> ======
+// ISRs become ordinary functions the harness calls to play the hardware.
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+// ====== HOST MOCK OF <avr/io.h> ======
+// ATmega328P registers as plain variables (defined in SimArduino.cpp) and
+// the bit numbers the firmware uses.
+
+#include <stdint.h>
+
+#define SIM_REG8(name) extern volatile uint8_t name;
+#define SIM_REG16(name) extern volatile uint16_t name;
+
+// ADC
+SIM_REG8(ADCSRA) SIM_REG8(ADCSRB) SIM_REG8(ADMUX) SIM_REG8(DIDR0) SIM_REG16(ADC)
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
+
+// TWI
+SIM_REG8(TWBR) SIM_REG8(TWSR) SIM_REG8(TWDR) SIM_REG8(TWCR)
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+#define TWPS1 1
+#define TWPS0 0
+
+// External interrupts
+SIM_REG8(EICRA) SIM_REG8(EIMSK) SIM_REG8(EIFR)
+#define ISC11 3
+#define ISC10 2
+#define ISC01 1
+#define ISC00 0
+#define INT1 1
+#define INT0 0
+#define INTF1 1
+#define INTF0 0
+
+// Timer1. TIFR1 bits are cleared by writing a one, as on the part; the
+// emulation in SimArduino.cpp sets them.
+struct SimFlagRegister {
+    SimFlagRegister& operator=(uint8_t ones) {
+        value &= ~ones;
+        return *this;
+    }
+    operator uint8_t() const { return value; }
+
+    uint8_t value;
+};
+extern SimFlagRegister TIFR1;
+SIM_REG8(TCCR1A) SIM_REG8(TCCR1B) SIM_REG8(TIMSK1) SIM_REG16(TCNT1) SIM_REG16(OCR1A) SIM_REG16(OCR1B)
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1 0
+#define OCF1B 2
+#define OCF1A 1
+#define TOV1 0
+
+// USART0. UDR0 is two registers on the part: a write goes to the
+// transmitter (which SimUart in SimHardware.h picks up), a read returns
+// the last byte received.
+struct SimUsartData {
+    SimUsartData& operator=(uint8_t value) {
+        transmit = value;
+        written = true;
+        return *this;
+    }
+    operator uint8_t() const { return received; }
+
+    uint8_t transmit, received;
+    bool written;  // transmit not taken by the transmitter yet
+};
+extern SimUsartData UDR0;
+SIM_REG8(UCSR0A) SIM_REG8(UCSR0B) SIM_REG8(UCSR0C) SIM_REG16(UBRR0)
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UPM01 5
+#define UPM00 4
+#define USBS0 3
+#define UCSZ01 2
+#define UCSZ00 1
+
+// Analog comparator
+SIM_REG8(ACSR)
+#define ACD 7
+
+// Power reduction
+SIM_REG8(PRR)
+#define PRTWI 7
+#define PRTIM2 6
+#define PRTIM0 5
+#define PRTIM1 3
+#define PRSPI 2
+#define PRUSART0 1
+#define PRADC 0
+
+// Sleep mode control
+SIM_REG8(SMCR)
+#define SM2 3
+#define SM1 2
+#define SM0 1
+#define SE 0
+
+// Watchdog and reset cause
+SIM_REG8(WDTCSR) SIM_REG8(MCUSR)
+#define WDIF 7
+#define WDIE 6
+#define WDP3 5
+#define WDCE 4
+#define WDE 3
+#define WDP2 2
+#define WDP1 1
+#define WDP0 0
+#define WDRF 3
+#define BORF 2
+#define EXTRF 1
+#define PORF 0
+
+// Digital I/O. The output latches count level changes per bit, for
+// simPinToggles(); digitalWrite() in the mock core goes through them too.
+// The direction registers are the same type, and every write to either
+// tells the line emulation (simSetLineHook()). PINx reads back the
+// latches of outputs and the simPinReader() level of inputs.
+void simPortWritten();
+struct SimPort {
+    SimPort& operator=(uint8_t level) {
+        uint8_t changed = value ^ level;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            toggles[bit] += (changed >> bit) & 1;
+        }
+        value = level;
+        simPortWritten();
+        return *this;
+    }
+    SimPort& operator|=(uint8_t mask) { return *this = value | mask; }
+    SimPort& operator&=(uint8_t mask) { return *this = value & mask; }
+    operator uint8_t() const { return value; }
+
+    uint8_t value;
+    unsigned long toggles[8];
+};
+extern SimPort PORTB, PORTC, PORTD;
+extern SimPort DDRB, DDRC, DDRD;
+
+struct SimPinRegister {
+    operator uint8_t() const;
+    uint8_t firstPin;  // Uno pin number of bit 0
+};
+extern SimPinRegister PINB, PINC, PIND;
+
+// Status register
+SIM_REG8(SREG)
+
+#define _BV(b) (1 << (b))
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+// ====== HOST MOCK OF <avr/pgmspace.h> ======
+// There is one address space on the host, so flash reads are plain reads.
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+
+#endif
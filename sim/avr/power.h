@@ -0,0 +1,19 @@
+#ifndef SIM_AVR_POWER_H
+#define SIM_AVR_POWER_H
+
+// ====== HOST MOCK OF <avr/power.h> ======
+// The power reduction macros set and clear PRR bits, as on the part.
+#include "io.h"
+
+#define power_adc_disable() (PRR |= _BV(PRADC))
+#define power_adc_enable() (PRR &= ~_BV(PRADC))
+#define power_spi_disable() (PRR |= _BV(PRSPI))
+#define power_spi_enable() (PRR &= ~_BV(PRSPI))
+#define power_timer1_disable() (PRR |= _BV(PRTIM1))
+#define power_timer1_enable() (PRR &= ~_BV(PRTIM1))
+#define power_timer2_disable() (PRR |= _BV(PRTIM2))
+#define power_timer2_enable() (PRR &= ~_BV(PRTIM2))
+#define power_twi_disable() (PRR |= _BV(PRTWI))
+#define power_twi_enable() (PRR &= ~_BV(PRTWI))
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+// ====== HOST MOCK OF <avr/sleep.h> ======
+// The mode and enable bits land in SMCR; sleeping itself returns at once,
+// as if the next interrupt had already arrived.
+#include "io.h"
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE (_BV(SM0) | _BV(SM1))
+
+#define set_sleep_mode(mode) (SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode))
+#define sleep_enable() (SMCR |= _BV(SE))
+#define sleep_disable() (SMCR &= ~_BV(SE))
+#define sleep_cpu() ((void)0)
+
+#endif
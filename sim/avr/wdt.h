@@ -0,0 +1,23 @@
+#ifndef SIM_AVR_WDT_H
+#define SIM_AVR_WDT_H
+
+// ====== HOST MOCK OF <avr/wdt.h> ======
+// The timeout codes and wdt_reset(), which restarts the emulated
+// watchdog's count (SimArduino.cpp); the mode and prescaler are written
+// to WDTCSR directly, as on the part.
+#include "io.h"
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+void wdt_reset();
+
+#endif
@@ -0,0 +1,2255 @@
+// ====== HEATER CONTROLLER SIMULATION AND BENCHMARKS ======
+// Runs the shared HeaterController (common/) natively against the thermal
+// plant in ThermalPlant.h, in virtual time. The real sensor policies are
+// used: the TMP36 build reads through AdcSampler.h fed by the ADC
+// emulator, the LM75 build through TwiMaster.h talking to the emulated
+// LM75, the DS18B20 build through OneWireBus.h bit-banging the emulated
+// 1-Wire line. Every scenario is run for each control mode and reports
+//
+//   rise      time until the load first reaches the target
+//   settle    time after which the load stays within +-band of the target
+//   overshoot highest load temperature above the target (before any
+//             disturbance)
+//   error     mean load error over the last quarter of the run
+//   ripple    peak-to-peak load swing over the last quarter
+//   toggles   heater pin level changes (relay wear)
+//   ns/cycle  host time for one sample() + evaluate() + actuate()
+//
+// and checks the safety rules on every cycle: the heater may only be on
+// in a regulating state, never on a stale reading, and never while the
+// LM75's OS line is asserted (the INT0 ISR must have switched it off
+// before the controller next runs). The exit status is
+// non-zero if any rule or scenario expectation fails.
+//
+// The "settings" scenario exercises the EEPROM settings store: loading,
+// batched saves, wear levelling across slots, and recovery from a
+// corrupted or half-written record, all without the firmware ever waiting
+// on an EEPROM write.
+//
+// The "console" scenario sends commands through the serial mock to the
+// command console and checks the replies and their effect.
+//
+// The "filter" scenario checks the median and EMA stages against brute
+// force, then feeds a controller glitches and noise through a scripted
+// sensor, with and without the filter, and counts the state changes.
+//
+// The "history" scenario logs ten minutes of samples and state changes
+// into the history log, decodes the ring and its OVERHEAT copy in EEPROM,
+// and checks them against what was logged.
+//
+// The "zones" scenario runs 1, 2, 4 and 8 zones of LM75 + heater on one
+// controller, each zone with its own plant, and reports the cost of one
+// batched update() pass as the zone count grows.
+//
+// The "resolution" scenario decodes each LM75-compatible part, sets
+// per-zone TMP75 resolutions, and regulates through a 12-bit TMP75 on a
+// narrower band than the 9-bit LM75 can resolve.
+//
+// The "onewire" scenario runs the DS18B20 driver against several
+// emulated sensors: the ROM search, one shared conversion, CRC and
+// missing-sensor failures, and how long one step holds the CPU.
+//
+// The "fleet" scenario is the bus master of a two-zone Modbus RTU node
+// on an emulated UART: reads, single, multiple and broadcast writes,
+// exceptions, damaged frames, the RS-485 driver enable and the time one
+// poll takes on the bus.
+//
+// The "watchdog" scenario runs the watchdog supervisor over a scheduler
+// with a task that hangs, then one that starves another, against the
+// emulated watchdog: how soon the heater goes off and the part resets,
+// and what the .noinit reset record says after the reboot.
+//
+// Usage: heater_sim [--scenario step|overheat|sensor-fault|near-limit|settings|console|filter|sensor|clock|resolution|onewire|autotune|history|fleet|watchdog|zones|all]
+//                   [--mode bang|pid|all] [--minutes N] [--band C]
+//                   [--trace file.csv]
+
+#include "Arduino.h"
+#include "SimHardware.h"
+#include "ThermalPlant.h"
+
+#include "../common/HeaterController.h"
+#include "../common/Tmp36Sensor.h"
+#include "../common/Lm75Sensor.h"
+#include "../common/Ds18b20Sensor.h"
+#include "../common/OverheatInterrupt.h"
+#include "../common/SettingsStore.h"
+#include "../common/HeaterConsole.h"
+#include "../common/HistoryLog.h"
+#include "../common/Scheduler.h"
+#include "../common/Telemetry.h"
+#include "../common/LowPower.h"
+#include "../common/ModbusNode.h"
+#include "../common/Watchdog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// ====== CONFIGS ======
+// Thresholds of the two sketches; only the control mode varies
+const uint16_t PROJECT1_SAMPLE_RATE = 100;  // Hz, the sketches' sampleRate
+const uint16_t PROJECT2_SAMPLE_RATE = 20;
+typedef Lm75Sensor<0x48, 1, PROJECT2_SAMPLE_RATE> ClockedLm75;
+template <ControlMode Mode>
+struct Project1SimConfig : HeaterConfigDefaults {
+    static constexpr TempQ8 targetTemp = celsiusQ8(30.0);
+    static constexpr TempQ8 overheatTemp = celsiusQ8(40.0);
+    static constexpr TempQ8 hysteresis = celsiusQ8(2.0);
+    static constexpr TempQ8 startTemp = targetTemp;
+    static constexpr TempQ8 overheatReleaseTemp = targetTemp - celsiusQ8(5.0);
+    static constexpr unsigned long stabilizingTime = 30000;
+    static constexpr unsigned long maxSampleAge = 150;
+    static constexpr unsigned long overheatLookahead = 15000;
+    static constexpr uint8_t heaterPin = 8;
+    static constexpr ControlMode controlMode = Mode;
+    typedef FilterChain<MedianFilter<5>, EmaFilter<2> > SampleFilter;
+};
+
+template <ControlMode Mode>
+struct Project2SimConfig : HeaterConfigDefaults {
+    static constexpr TempQ8 targetTemp = celsiusQ8(40.0);
+    static constexpr TempQ8 hysteresis = celsiusQ8(2.0);
+    static constexpr TempQ8 overheatTemp = celsiusQ8(50.0);
+    static constexpr TempQ8 startTemp = targetTemp - hysteresis;
+    static constexpr TempQ8 overheatReleaseTemp = targetTemp;
+    static constexpr unsigned long stabilizingTime = 30000;
+    static constexpr unsigned long maxSampleAge = 150;
+    static constexpr unsigned long overheatLookahead = 15000;
+    static constexpr uint8_t heaterPin = 8;
+    static constexpr int8_t ledPin = 13;
+    static constexpr ControlMode controlMode = Mode;
+    typedef ThermostatOverheatInput<ClockedLm75, 2> OverheatInput;  // LM75 OS on INT0
+    typedef FilterChain<MedianFilter<3>, EmaFilter<2> > SampleFilter;
+};
+
+// Project 2 built with DS18B20_SENSOR: no thermostat line, a reading
+// every bus cycle, unfiltered (CRC-checked and 1/16 °C). The harness
+// takes one sample pass per control period, so a cycle takes about 1.9 s
+// here against about 0.85 s with the sketch's 5 ms sample task.
+template <ControlMode Mode>
+struct Project2Ds18b20SimConfig : Project2SimConfig<Mode> {
+    static constexpr unsigned long maxSampleAge = 3000;
+    typedef NoOverheatInput OverheatInput;
+    typedef NoFilter SampleFilter;
+};
+
+// ====== SENSOR FEEDS ======
+// Turn the plant's sensor temperature into what the firmware's sensor
+// policy reads from the hardware, once per control period
+
+// TMP36: 10 mV/°C with 500 mV offset, on the ADC. Timer1 triggers the
+// conversions while virtual time advances; they see the latest voltage.
+struct Tmp36Feed {
+    typedef Tmp36Sensor<A0, PROJECT1_SAMPLE_RATE> Sensor;
+    static const char* name() { return "TMP36"; }
+
+    Tmp36Feed() : lineTrips(0) {}
+    void update(double celsius) { adc.input = 0.5 + celsius / 100.0; }
+    void fail() { adc.stopped = true; }  // ADC stops converting
+    SimTwiBus* twiBus() { return 0; }
+    static const bool hasAlarmLine = false;
+    bool alarmLine() const { return false; }
+    unsigned long lineTrips;
+    template <class Config>
+    const char* checkSetup() const { return 0; }
+
+    SimAdc adc;
+};
+
+// LM75 at 0x48: the read started by the last poll completes on the bus.
+// Its OS output drives pin 2 (INT0); the falling edge runs the ISR at the
+// moment the sensor crosses Tos.
+const uint8_t OS_LINE_PIN = 2;
+static bool osLineLow = false;
+static int readOsLine(uint8_t pin) { return pin == OS_LINE_PIN && osLineLow ? LOW : HIGH; }
+
+struct Lm75Feed {
+    typedef ClockedLm75 Sensor;
+    static const char* name() { return "LM75"; }
+
+    Lm75Feed() : lineTrips(0), lm75(0x48) {
+        bus.attach(&lm75);
+        osLineLow = false;
+        simSetPinReader(readOsLine);
+    }
+    void update(double celsius) {
+        lm75.setTemperature(celsius);
+        bool falling = lm75.osAsserted() && !osLineLow;
+        osLineLow = lm75.osAsserted();
+        if (falling && (EIMSK & _BV(INT0))) {
+            lineTrips++;
+            INT0_vect();
+        }
+        bus.service();
+    }
+    void fail() { bus.stuck = true; }  // Slave holds the bus
+    SimTwiBus* twiBus() { return &bus; }
+    static const bool hasAlarmLine = true;
+    bool alarmLine() const { return osLineLow; }
+    unsigned long lineTrips;  // ISR runs
+
+    // The thermostat must hold the controller's thresholds, and the
+    // pointer must be back on the temperature register for the bursts
+    template <class Config>
+    const char* checkSetup() const {
+        if (lm75.thresholdTos() != (uint16_t)(Config::overheatTemp & 0xFF80)
+            || lm75.thresholdThyst() != (uint16_t)(Config::overheatReleaseTemp & 0xFF80)) {
+            return "LM75 thermostat thresholds not programmed";
+        }
+        if (lm75.configuration() != LM75_CONFIG_COMPARATOR || lm75.registerPointer() != LM75_REG_TEMPERATURE) {
+            return "LM75 left in the wrong mode after setup";
+        }
+        if (!(EIMSK & _BV(INT0))) {
+            return "OS interrupt not armed";
+        }
+        return 0;
+    }
+
+    SimLm75 lm75;
+    SimTwiBus bus;
+};
+
+// DS18B20 on the 1-Wire line on pin 7: each conversion measures the
+// temperature of the latest update
+const uint8_t ONE_WIRE_PIN = 7;
+
+struct Ds18b20Feed {
+    typedef Ds18b20Sensor<ONE_WIRE_PIN> Sensor;
+    static const char* name() { return "DS18B20"; }
+
+    Ds18b20Feed() : lineTrips(0), bus(ONE_WIRE_PIN), ds18b20(1) {
+        bus.attach(&ds18b20);
+        bus.connect();
+    }
+    void update(double celsius) { ds18b20.setTemperature(celsius); }
+    void fail() { ds18b20.present = false; }  // Wire cut
+    SimTwiBus* twiBus() { return 0; }
+    static const bool hasAlarmLine = false;
+    bool alarmLine() const { return false; }
+    unsigned long lineTrips;
+    template <class Config>
+    const char* checkSetup() const {
+        return Sensor::sensorCount() == 1 ? 0 : "DS18B20 not found by the ROM search";
+    }
+
+    SimOneWireBus bus;
+    SimDs18b20 ds18b20;
+};
+
+// ====== SCENARIOS ======
+struct Scenario {
+    const char* name;
+    double minutes;           // Run length
+    double disturbanceStart;  // Minutes; extra heat into the load from here...
+    double disturbanceEnd;    // ...to here
+    double disturbanceWatts;
+    double faultAt;           // Minutes; the sensor fails here (< 0: never)
+    bool expectOverheat;      // OVERHEAT must be entered and left again
+    double limitMargin;       // °C; > 0: the target is raised to this far below overheatTemp
+};
+
+static const Scenario scenarios[] = {
+    // Cold start to the target and hold
+    {"step", 30, 0, 0, 0, -1, false, 0},
+    // A neighbouring 15 W source pushes the load past the overheat limit
+    {"overheat", 60, 10, 15, 15.0, -1, true, 0},
+    // The sensor dies mid-run; the heater must drop out on the stale reading
+    {"sensor-fault", 20, 0, 0, 0, 10, false, 0},
+    // Target just under the limit: heat already on its way when the sensor
+    // reaches the target must not carry it into OVERHEAT
+    {"near-limit", 30, 0, 0, 0, -1, false, 1.0},
+};
+
+struct Options {
+    std::string scenario;
+    std::string mode;
+    double minutes;  // Overrides the scenario length if > 0
+    double band;
+    std::string trace;
+};
+
+// ====== METRICS ======
+struct Metrics {
+    double rise;        // s, -1 if the target was never reached
+    double settle;      // s, -1 if the load did not end inside the band
+    double overshoot;   // °C above target
+    double error;       // °C, mean load - target over the last quarter
+    double ripple;      // °C, peak-to-peak over the last quarter
+    unsigned long toggles;
+    unsigned long cycles;
+    double nsPerCycle;
+    double cyclesPerSecond;  // Whole simulation, plant included
+    bool overheatEntered, overheatLeft;
+    std::string failure;     // First safety or expectation failure
+};
+
+static void printRow(const char* scenario, const char* sensor, const char* mode, const Metrics& m) {
+    char rise[16], settle[16];
+    snprintf(rise, sizeof(rise), m.rise < 0 ? "never" : "%.0f", m.rise);
+    snprintf(settle, sizeof(settle), m.settle < 0 ? "never" : "%.0f", m.settle);
+    printf("%-13s %-7s %-9s %7s %8s %9.2f %7.2f %7.2f %8lu %9.1f %10.2f  %s\n", scenario, sensor, mode,
+           rise, settle, m.overshoot, m.error, m.ripple, m.toggles, m.nsPerCycle,
+           m.cyclesPerSecond / 1e6, m.failure.empty() ? "ok" : m.failure.c_str());
+}
+
+static double q8ToCelsius(TempQ8 t) { return t / 256.0; }
+
+// Runs controller.begin() with the bus serviced on every micros() call, so
+// the LM75 scan in setup finds the emulated devices
+static SimTwiBus* scanBus = 0;
+static void serviceScanBus() { scanBus->service(); }
+
+template <class Controller>
+void beginController(Controller& controller, SimTwiBus* bus) {
+    scanBus = bus;
+    simSetIdleHook(bus ? serviceScanBus : 0);
+    controller.begin();
+    simSetIdleHook(0);
+    scanBus = 0;
+}
+
+// ====== RUNNER ======
+template <class Feed, class Config>
+Metrics runScenario(const Scenario& s, const Options& options, FILE* trace) {
+    typedef std::chrono::steady_clock Clock;
+
+    simReset();
+    overheatLatch = false;
+    Feed feed;
+    ThermalPlant plant(defaultPlant());
+    std::mt19937 rng(1);
+    std::normal_distribution<double> sensorNoise(0.0, 0.05);
+    HeaterController<typename Feed::Sensor, Config> controller;
+
+    HeaterSettings settings = defaultSettings<Config>();
+    if (s.limitMargin > 0) {
+        settings.targetTemp = settings.overheatTemp - celsiusQ8(s.limitMargin);
+    }
+    const double target = q8ToCelsius(settings.targetTemp);
+    const double period = Config::controlPeriod / 1000.0;
+    const double minutes = options.minutes > 0 ? options.minutes : s.minutes;
+    const unsigned long cycles = (unsigned long)(minutes * 60.0 / period);
+    const unsigned long tailStart = cycles - cycles / 4;
+    const double staleLimit = (Config::maxSampleAge + Config::controlPeriod) / 1000.0;
+
+    Metrics m = Metrics();
+    m.rise = -1;
+    double lastOutside = 0;
+    double tailSum = 0, tailMin = 1e9, tailMax = -1e9;
+    Clock::duration controllerTime = Clock::duration::zero();
+    Clock::time_point wallStart = Clock::now();
+
+    // Power-up, then let the first conversions / I²C read complete
+    feed.update(plant.sensorTemperature());
+    beginController(controller, feed.twiBus());
+    controller.applySettings(settings);
+    feed.update(plant.sensorTemperature());
+    if (const char* setupFailure = feed.template checkSetup<Config>()) {
+        m.failure = setupFailure;
+    }
+
+    for (unsigned long i = 0; i < cycles; i++) {
+        double t = i * period;
+        double minute = t / 60.0;
+        if (s.faultAt >= 0 && minute >= s.faultAt) {
+            feed.fail();
+        }
+        plant.disturbance = (minute >= s.disturbanceStart && minute < s.disturbanceEnd) ? s.disturbanceWatts : 0.0;
+        feed.update(plant.sensorTemperature() + sensorNoise(rng));
+        if (m.failure.empty() && feed.alarmLine() && simPinLevel(Config::heaterPin) == HIGH) {
+            m.failure = "heater left on when the OS line asserted";
+        }
+
+        Clock::time_point start = Clock::now();
+        controller.sample();
+        controller.evaluate();
+        controller.actuate();
+        controllerTime += Clock::now() - start;
+
+        bool on = simPinLevel(Config::heaterPin) == HIGH;
+        HeaterState state = controller.state();
+        double load = plant.loadTemperature();
+
+        // Safety rules
+        if (m.failure.empty()) {
+            bool dead = s.faultAt >= 0 && t >= s.faultAt * 60.0;
+            if (on && (state == IDLE || state == OVERHEAT || state == SENSOR_FAULT)) {
+                m.failure = "heater on in IDLE/OVERHEAT/SENSOR_FAULT";
+            } else if (on && dead && t >= s.faultAt * 60.0 + staleLimit) {
+                m.failure = "heater on with a stale reading";
+            } else if (state == SENSOR_FAULT && !dead) {
+                m.failure = "SENSOR_FAULT with a working sensor";
+            } else if (state != SENSOR_FAULT && dead && t >= s.faultAt * 60.0 + staleLimit) {
+                m.failure = "dead sensor not reported as SENSOR_FAULT";
+            } else if (on && feed.alarmLine()) {
+                m.failure = "heater on with the OS line asserted";
+            } else if (on && Config::controlMode == BANG_BANG && state != HEATING) {
+                m.failure = "bang-bang heater on outside HEATING";
+            }
+        }
+        if (state == OVERHEAT) {
+            m.overheatEntered = true;
+        } else if (m.overheatEntered) {
+            m.overheatLeft = true;
+        }
+
+        // Response metrics
+        if (m.rise < 0 && load >= target) {
+            m.rise = t;
+        }
+        bool undisturbed = s.disturbanceWatts == 0.0 || minute < s.disturbanceStart;
+        if (m.rise >= 0 && undisturbed && load - target > m.overshoot) {
+            m.overshoot = load - target;
+        }
+        if (fabs(load - target) > options.band) {
+            lastOutside = t;
+        }
+        if (i >= tailStart) {
+            tailSum += load - target;
+            tailMin = load < tailMin ? load : tailMin;
+            tailMax = load > tailMax ? load : tailMax;
+        }
+        if (trace) {
+            fprintf(trace, "%s,%s,%.2f,%.3f,%.3f,%.3f,%.3f,%d,%u,%d\n", s.name,
+                    Config::controlMode == PID ? "pid" : "bang", t, plant.heaterTemperature(), load,
+                    plant.sensorTemperature(), q8ToCelsius(controller.temperature()), (int)state,
+                    controller.heaterDuty(), on ? 1 : 0);
+        }
+
+        plant.step(period, on);
+        simAdvanceMicros(Config::controlPeriod * 1000UL);
+    }
+
+    double wall = std::chrono::duration<double>(Clock::now() - wallStart).count();
+    double last = (cycles - 1) * period;
+    m.settle = (m.rise >= 0 && lastOutside < last) ? lastOutside : -1;
+    m.error = tailSum / (cycles - tailStart);
+    m.ripple = tailMax - tailMin;
+    m.toggles = simPinToggles(Config::heaterPin);
+    m.cycles = cycles;
+    m.nsPerCycle = std::chrono::duration<double, std::nano>(controllerTime).count() / cycles;
+    m.cyclesPerSecond = wall > 0 ? cycles / wall : 0;
+
+    if (m.failure.empty() && s.expectOverheat && !(m.overheatEntered && m.overheatLeft)) {
+        m.failure = m.overheatEntered ? "OVERHEAT never released" : "OVERHEAT never entered";
+    }
+    if (m.failure.empty() && s.expectOverheat && Feed::hasAlarmLine && feed.lineTrips == 0) {
+        m.failure = "OS line never tripped";
+    }
+    if (m.failure.empty() && !s.expectOverheat && m.overheatEntered) {
+        m.failure = "unexpected OVERHEAT";
+    }
+    if (m.failure.empty() && s.faultAt < 0 && m.rise < 0) {
+        m.failure = "target never reached";
+    }
+    return m;
+}
+
+// Runs one scenario on one board for the selected modes
+template <class Feed, template <ControlMode> class Config>
+bool runBoard(const Scenario& s, const Options& options, FILE* trace) {
+    bool ok = true;
+    if (options.mode == "all" || options.mode == "bang") {
+        Metrics m = runScenario<Feed, Config<BANG_BANG> >(s, options, trace);
+        printRow(s.name, Feed::name(), "BANG_BANG", m);
+        ok = ok && m.failure.empty();
+    }
+    if (options.mode == "all" || options.mode == "pid") {
+        Metrics m = runScenario<Feed, Config<PID> >(s, options, trace);
+        printRow(s.name, Feed::name(), "PID", m);
+        ok = ok && m.failure.empty();
+    }
+    return ok;
+}
+
+// ====== MULTI-ZONE ======
+// Project 2 thresholds on a rack board: heaters on pins 2.., no LED, no
+// OS line
+template <ControlMode Mode>
+struct RackSimConfig : Project2SimConfig<Mode> {
+    static constexpr uint8_t heaterPin = 2;
+    static constexpr int8_t ledPin = -1;
+    typedef NoOverheatInput OverheatInput;
+};
+
+// Runs Zones independent plants from one controller. The firmware's
+// sample task runs every 5 ms and collects one burst of all zones, which
+// a 400 kHz bus finishes well within that; update() runs every control
+// period.
+template <uint8_t Zones, ControlMode Mode>
+bool runZones(const Options& options) {
+    typedef RackSimConfig<Mode> Config;
+    typedef std::chrono::steady_clock Clock;
+    const unsigned long tick = 5;  // ms, the sketch's samplePeriod
+
+    simReset();
+    SimTwiBus bus;
+    SimLm75* sensors[Zones];
+    ThermalPlant* plants[Zones];
+    for (uint8_t zone = 0; zone < Zones; zone++) {
+        sensors[zone] = new SimLm75(0x48 + zone);
+        bus.attach(sensors[zone]);
+        PlantParameters p = defaultPlant();
+        p.heaterPower *= 1.0 + 0.1 * zone;  // Zones differ a little
+        plants[zone] = new ThermalPlant(p);
+    }
+    HeaterController<Lm75Sensor<0x48, Zones>, Config, Zones> controller;
+    beginController(controller, &bus);
+    if (Lm75Sensor<0x48, Zones>::sensorCount() != Zones) {
+        printf("%-5u scan found %u LM75s\n", Zones, Lm75Sensor<0x48, Zones>::sensorCount());
+        return false;
+    }
+
+    const double target = q8ToCelsius(Config::targetTemp);
+    const double minutes = options.minutes > 0 ? options.minutes : 30;
+    const unsigned long ticks = (unsigned long)(minutes * 60000.0 / tick);
+    const unsigned long ticksPerPass = Config::controlPeriod / tick;
+    double rise[Zones], overshoot[Zones];
+    for (uint8_t zone = 0; zone < Zones; zone++) {
+        rise[zone] = -1;
+        overshoot[zone] = 0;
+    }
+    std::string failure;
+    Clock::duration passTime = Clock::duration::zero();
+    unsigned long passes = 0;
+
+    for (unsigned long i = 0; i < ticks; i++) {
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            sensors[zone]->setTemperature(plants[zone]->sensorTemperature());
+        }
+        bus.service();
+        controller.sample();
+        if (i % ticksPerPass == 0) {
+            Clock::time_point start = Clock::now();
+            controller.update();
+            passTime += Clock::now() - start;
+            passes++;
+        }
+        double t = i * tick / 1000.0;
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            bool on = simPinLevel(Config::heaterPin + zone) == HIGH;
+            HeaterState state = controller.state(zone);
+            if (failure.empty() && on && (state == IDLE || state == OVERHEAT)) {
+                failure = "heater on in IDLE/OVERHEAT";
+            }
+            if (failure.empty() && state == OVERHEAT) {
+                failure = "unexpected OVERHEAT";
+            }
+            double load = plants[zone]->loadTemperature();
+            if (rise[zone] < 0 && load >= target) {
+                rise[zone] = t;
+            }
+            if (rise[zone] >= 0 && load - target > overshoot[zone]) {
+                overshoot[zone] = load - target;
+            }
+            plants[zone]->step(tick / 1000.0, on);
+        }
+        simAdvanceMicros(tick * 1000UL);
+    }
+
+    double worstRise = 0, worstOvershoot = 0;
+    unsigned long toggles = 0;
+    for (uint8_t zone = 0; zone < Zones; zone++) {
+        if (rise[zone] < 0 && failure.empty()) {
+            failure = "zone never reached target";
+        }
+        worstRise = rise[zone] > worstRise ? rise[zone] : worstRise;
+        worstOvershoot = overshoot[zone] > worstOvershoot ? overshoot[zone] : worstOvershoot;
+        toggles += simPinToggles(Config::heaterPin + zone);
+        if (sensors[zone]->pointerWrites != 1 && failure.empty()) {
+            failure = "LM75 pointer rewritten after the scan";
+        }
+        delete sensors[zone];
+        delete plants[zone];
+    }
+    double nsPerPass = std::chrono::duration<double, std::nano>(passTime).count() / passes;
+    printf("%-5u %-9s %7.0f %9.2f %8lu %9lu %10.1f %9.1f  %s\n", Zones, Mode == PID ? "PID" : "BANG_BANG",
+           worstRise, worstOvershoot, toggles, bus.transactions, nsPerPass, nsPerPass / Zones,
+           failure.empty() ? "ok" : failure.c_str());
+    return failure.empty();
+}
+
+template <ControlMode Mode>
+bool runZoneSweep(const Options& options) {
+    bool ok = runZones<1, Mode>(options);
+    ok = runZones<2, Mode>(options) && ok;
+    ok = runZones<4, Mode>(options) && ok;
+    return runZones<8, Mode>(options) && ok;
+}
+
+// ====== SETTINGS STORE ======
+typedef SettingsStore<> Store;
+
+static bool sameSettings(const HeaterSettings& a, const HeaterSettings& b) {
+    return a.stabilizingTime == b.stabilizingTime && a.targetTemp == b.targetTemp && a.hysteresis == b.hysteresis
+        && a.overheatTemp == b.overheatTemp && a.startTemp == b.startTemp
+        && a.overheatReleaseTemp == b.overheatReleaseTemp && a.pidKp == b.pidKp && a.pidKi == b.pidKi
+        && a.pidKd == b.pidKd;
+}
+
+// Runs the store's task at the sketches' 4 ms period for ms milliseconds
+static void serviceStore(Store& store, unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += 4) {
+        store.service();
+        simAdvanceMicros(4000);
+    }
+}
+
+// Saves and waits for the record to be written
+static void saveAndFlush(Store& store, const HeaterSettings& settings) {
+    store.save(settings);
+    serviceStore(store, SETTINGS_SAVE_DELAY + 500);
+}
+
+static bool checkResult(const char* name, bool passed) {
+    printf("%-60s %s\n", name, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+static bool runSettings() {
+    typedef Project2SimConfig<BANG_BANG> Config;
+    const HeaterSettings defaults = defaultSettings<Config>();
+    bool ok = true;
+    simReset();
+    simEepromErase();
+
+    HeaterSettings loaded = defaults;
+    Store blank;
+    ok = checkResult("blank EEPROM loads nothing", !blank.load(loaded) && sameSettings(loaded, defaults)) && ok;
+
+    HeaterSettings changed = defaults;
+    changed.targetTemp = celsiusQ8(45.0);
+    changed.startTemp = celsiusQ8(43.0);
+    changed.stabilizingTime = 20000;
+    saveAndFlush(blank, changed);
+    Store reloaded;
+    ok = checkResult("saved settings load after a reset",
+                     !blank.busy() && reloaded.load(loaded) && sameSettings(loaded, changed)) && ok;
+
+    // Five changes 100 ms apart are one record
+    uint16_t before = reloaded.sequence();
+    for (int i = 0; i < 5; i++) {
+        changed.hysteresis = celsiusQ8(1.0 + i * 0.5);
+        reloaded.save(changed);
+        serviceStore(reloaded, 100);
+    }
+    serviceStore(reloaded, SETTINGS_SAVE_DELAY + 500);
+    Store batched;
+    ok = checkResult("a burst of saves writes one record",
+                     batched.load(loaded) && batched.sequence() == before + 1 && sameSettings(loaded, changed)) && ok;
+
+    // 80 saves over 8 slots: about 10 write cycles per cell, not 80
+    for (int i = 0; i < 80; i++) {
+        changed.stabilizingTime = 10000 + i;
+        saveAndFlush(batched, changed);
+    }
+    unsigned long worstCell = 0;
+    for (uint16_t a = 0; a < 8 * sizeof(SettingsRecord); a++) {
+        worstCell = simEepromWrites(a) > worstCell ? simEepromWrites(a) : worstCell;
+    }
+    Store levelled;
+    ok = checkResult("saves are spread over the slots",
+                     worstCell <= 13 && levelled.load(loaded) && sameSettings(loaded, changed)) && ok;
+
+    // A flipped bit in the newest record falls back to the one before
+    uint16_t newest = levelled.sequence();
+    uint16_t newestSlot = (newest - 1) % 8;
+    uint16_t address = newestSlot * sizeof(SettingsRecord) + offsetof(SettingsRecord, settings);
+    simEepromPoke(address, simEepromByte(address) ^ 0x01);
+    Store recovered;
+    HeaterSettings previous = changed;
+    previous.stabilizingTime--;
+    ok = checkResult("a corrupt record falls back to the previous one",
+                     recovered.load(loaded) && recovered.sequence() == newest - 1 && sameSettings(loaded, previous))
+         && ok;
+
+    // Reset in the middle of a save: the half-written slot is skipped
+    changed.targetTemp = celsiusQ8(42.0);
+    changed.startTemp = celsiusQ8(40.0);
+    recovered.save(changed);
+    serviceStore(recovered, SETTINGS_SAVE_DELAY + 8);
+    Store interrupted;
+    ok = checkResult("a half-written record is skipped",
+                     recovered.busy() && interrupted.load(loaded) && sameSettings(loaded, previous)) && ok;
+
+    ok = checkResult("the firmware never waited on an EEPROM write", simEepromWaits() == 0) && ok;
+
+    // The controller starts on stored settings and rejects bad ones
+    HeaterController<Lm75Sensor<0x48>, RackSimConfig<BANG_BANG> > controller;
+    controller.begin(loaded);
+    HeaterSettings bad = loaded;
+    bad.overheatReleaseTemp = bad.overheatTemp;
+    bool applied = controller.applySettings(bad);
+    ok = checkResult("the controller runs on loaded settings and rejects bad ones",
+                     sameSettings(controller.settings(), loaded) && !applied) && ok;
+    return ok;
+}
+
+// ====== COMMAND CONSOLE ======
+// Collects console replies; always has room
+struct CaptureOut : Print {
+    size_t write(uint8_t c) {
+        if (c != '\r') {
+            text += (char)c;
+        }
+        return 1;
+    }
+    bool ready() const { return true; }
+    std::string text;
+};
+
+// Sends one command line and services the console until it has answered
+// in full; returns the reply
+template <class Console>
+static std::string command(Console& console, CaptureOut& out, const char* line) {
+    out.text.clear();
+    simSerialInput(line);
+    simSerialInput("\n");
+    for (int i = 0; i < 64; i++) {
+        console.service(Serial);
+    }
+    return out.text;
+}
+
+// ====== SAMPLE FILTER ======
+// A sensor that reads whatever the test sets
+static TempQ8 scriptedTemp = 0;
+static uint8_t scriptedStatus = SENSOR_OK;
+
+struct ScriptedSensor {
+    static void begin() {}
+    static SensorReading poll(uint8_t) { return sensorReading(scriptedStatus, scriptedTemp); }
+};
+
+template <class Filter>
+struct FilterSimConfig : Project1SimConfig<BANG_BANG> {
+    typedef Filter SampleFilter;
+    static constexpr TempQ8 maxSlewRate = 0;  // The filter alone, no plausibility check
+};
+
+// Median of the last n values, the slow way
+static TempQ8 bruteMedian(const std::vector<TempQ8>& values, size_t n) {
+    std::vector<TempQ8> window(values.end() - n, values.end());
+    std::sort(window.begin(), window.end());
+    return window[n / 2];
+}
+
+template <uint8_t Taps>
+static bool medianMatches(std::mt19937& random) {
+    std::uniform_int_distribution<int> value(-2000, 2000);
+    for (int run = 0; run < 200; run++) {
+        MedianFilter<Taps> median;
+        std::vector<TempQ8> values;
+        TempQ8 first = value(random);
+        values.assign(Taps - 1, first);  // The first sample fills the history
+        for (int i = 0; i < 50; i++) {
+            TempQ8 v = i == 0 ? first : value(random);
+            values.push_back(v);
+            if (median.add(v) != bruteMedian(values, Taps)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Runs control passes on a scripted input; returns the state changes and
+// how many passes entered OVERHEAT
+template <class Filter>
+struct FilterRun {
+    typedef HeaterController<ScriptedSensor, FilterSimConfig<Filter> > Controller;
+
+    FilterRun() : changes(0), overheats(0) {
+        simReset();
+        scriptedTemp = celsiusQ8(25.0);
+        scriptedStatus = SENSOR_OK;
+        controller.begin();
+    }
+    void pass(TempQ8 temp) {
+        HeaterState before = controller.state();
+        scriptedTemp = temp;
+        controller.sample();
+        controller.evaluate();
+        controller.actuate();
+        simAdvanceMicros(50000);
+        changes += controller.state() != before;
+        overheats += controller.state() == OVERHEAT && before != OVERHEAT;
+    }
+
+    Controller controller;
+    unsigned changes;
+    unsigned overheats;
+};
+
+typedef FilterChain<MedianFilter<5>, EmaFilter<2> > SketchFilter;
+
+static bool runFilter() {
+    bool ok = true;
+    std::mt19937 random(11);
+    ok = checkResult("3- and 5-tap medians match a sorted window", medianMatches<3>(random) && medianMatches<5>(random))
+         && ok;
+
+    EmaFilter<3> ema;
+    bool steady = true;
+    for (int i = 0; i < 100; i++) {
+        steady = ema.add(celsiusQ8(37.3)) == celsiusQ8(37.3) && steady;
+    }
+    int samples = 0;
+    while (ema.add(celsiusQ8(40.0)) < celsiusQ8(40.0) - 2 && samples < 1000) {
+        samples++;
+    }
+    ok = checkResult("the EMA holds a steady input and follows a step", steady && samples > 8 && samples < 60) && ok;
+
+    // Glitches at 35 °C (overheat is 40): a single read of 85 °C or of
+    // -40 °C every second
+    FilterRun<NoFilter> rawGlitch;
+    FilterRun<SketchFilter> filteredGlitch;
+    for (int i = 0; i < 2000; i++) {
+        TempQ8 temp = i % 20 == 7 ? celsiusQ8(85.0) : (i % 20 == 15 ? celsiusQ8(-40.0) : celsiusQ8(35.0));
+        rawGlitch.pass(temp);
+        filteredGlitch.pass(temp);
+    }
+    char name[80];
+    snprintf(name, sizeof(name), "single glitched reads never trip OVERHEAT (raw: %u trips)", rawGlitch.overheats);
+    ok = checkResult(name, rawGlitch.overheats > 0 && filteredGlitch.overheats == 0) && ok;
+
+    // The status frame carries the reading, not the filter output: the
+    // next glitch shows up in it
+    for (int i = 0; i < 8; i++) {
+        filteredGlitch.pass(i == 7 ? celsiusQ8(85.0) : celsiusQ8(35.0));
+    }
+    TelemetryLink<> link;
+    simSerialClear();
+    sendStatusRecord(link, filteredGlitch.controller);
+    link.drain(Serial);
+    const std::vector<uint8_t>& frame = simSerialOutput();
+    ok = checkResult("the status frame carries the raw reading, spikes included",
+                     frame.size() == 4 + 8 + 2 && frame[2] == TLM_STATUS
+                         && (TempQ8)(frame[8] | (frame[9] << 8)) == celsiusQ8(85.0)
+                         && filteredGlitch.controller.temperature() < celsiusQ8(40.0)) && ok;
+
+    // 1 °C rms of noise on a reading just under the target
+    FilterRun<NoFilter> rawNoise;
+    FilterRun<SketchFilter> filteredNoise;
+    std::normal_distribution<double> noise(0.0, 1.0);
+    for (int i = 0; i < 4000; i++) {
+        double celsius = i < 200 ? 30.5 : 29.0 + noise(random);
+        rawNoise.pass(celsiusQ8(celsius));
+        filteredNoise.pass(celsiusQ8(celsius));
+    }
+    snprintf(name, sizeof(name), "noise near the target switches states less (%u vs %u raw)", filteredNoise.changes,
+             rawNoise.changes);
+    ok = checkResult(name, filteredNoise.changes * 2 < rawNoise.changes) && ok;
+
+    // A real excursion still trips on the median, 2 samples late
+    FilterRun<SketchFilter> step;
+    for (int i = 0; i < 20; i++) {
+        step.pass(celsiusQ8(35.0));
+    }
+    int late = 0;
+    for (int i = 0; i < 10 && step.controller.state() != OVERHEAT; i++) {
+        step.pass(celsiusQ8(45.0));
+        late = i;
+    }
+    ok = checkResult("a real overheat trips after the median delay, not the EMA's",
+                     step.controller.state() == OVERHEAT && late == 2) && ok;
+    return ok;
+}
+
+// ====== SENSOR FAULTS ======
+// The sketch's config on the scripted sensor, one control pass per call
+struct SensorRun {
+    typedef HeaterController<ScriptedSensor, Project1SimConfig<BANG_BANG> > Controller;
+
+    SensorRun() {
+        simReset();
+        scriptedTemp = celsiusQ8(25.0);
+        scriptedStatus = SENSOR_OK;
+        controller.begin();
+    }
+    void pass(uint8_t status, TempQ8 temp) {
+        scriptedStatus = status;
+        scriptedTemp = temp;
+        controller.sample();
+        controller.evaluate();
+        controller.actuate();
+        simAdvanceMicros(50000);
+    }
+    // Passes until the zone faults; returns how many it took (0: never)
+    unsigned untilFault(uint8_t status, TempQ8 temp, unsigned limit) {
+        for (unsigned i = 1; i <= limit; i++) {
+            pass(status, temp);
+            if (controller.state() == SENSOR_FAULT) {
+                return i;
+            }
+        }
+        return 0;
+    }
+    bool safe() const { return controller.state() == SENSOR_FAULT && !controller.heaterOn(); }
+
+    Controller controller;
+};
+
+// A TMP36 controller on an input pinned at volts: the part cannot output 0 or 5 V
+static bool tmp36OutOfRange(double volts) {
+    simReset();
+    HeaterController<Tmp36Feed::Sensor, Project1SimConfig<BANG_BANG> > controller;
+    SimAdc adc;
+    adc.dither = false;
+    adc.input = volts;
+    controller.begin();
+    for (int i = 0; i < 10; i++) {
+        controller.sample();
+        controller.evaluate();
+        controller.actuate();
+        simAdvanceMicros(50000);
+    }
+    return controller.state() == SENSOR_FAULT && controller.faultCause() == SENSOR_OUT_OF_RANGE
+           && simPinLevel(Project1SimConfig<BANG_BANG>::heaterPin) == LOW;
+}
+
+static bool runSensor() {
+    bool ok = true;
+    const TempQ8 cold = celsiusQ8(25.0);
+
+    SensorRun failing;
+    failing.pass(SENSOR_OK, cold);
+    bool heating = failing.controller.heaterOn();
+    failing.pass(SENSOR_READ_FAILED, cold);
+    failing.pass(SENSOR_READ_FAILED, cold);
+    bool tolerated = failing.controller.state() == HEATING;
+    failing.pass(SENSOR_READ_FAILED, cold);
+    ok = checkResult("three failed reads in a row fault the zone, heater off",
+                     heating && tolerated && failing.safe() && failing.controller.faultCause() == SENSOR_READ_FAILED)
+         && ok;
+
+    for (int i = 0; i < 19; i++) {
+        failing.pass(SENSOR_OK, cold);
+    }
+    bool held = failing.safe();
+    failing.pass(SENSOR_OK, cold);
+    failing.pass(SENSOR_OK, cold);
+    ok = checkResult("20 good readings in a row recover through IDLE",
+                     held && failing.controller.state() == HEATING && failing.controller.heaterOn()) && ok;
+
+    SensorRun missing;
+    ok = checkResult("a missing device faults the zone",
+                     missing.untilFault(SENSOR_NOT_FOUND, cold, 10) == 3 && missing.safe()) && ok;
+
+    // LM75s on an empty bus: both zones fault as not found, and polling
+    // them for minutes counts no read errors
+    typedef Lm75Sensor<0x48, 2> EmptyLm75s;
+    simReset();
+    SimTwiBus emptyBus;
+    HeaterController<EmptyLm75s, Project1SimConfig<BANG_BANG>, 2> empty;
+    beginController(empty, &emptyBus);
+    unsigned int errorsBefore = EmptyLm75s::readErrors;
+    for (int i = 0; i < 60000; i++) {
+        emptyBus.service();
+        EmptyLm75s::poll(i % 2);
+        if (i % 10 == 0) {
+            empty.update();
+        }
+        simAdvanceMicros(5000);
+    }
+    ok = checkResult("an empty LM75 bus counts no read errors, zones not found",
+                     EmptyLm75s::readErrors == errorsBefore && empty.state(0) == SENSOR_FAULT
+                         && empty.faultCause(1) == SENSOR_NOT_FOUND) && ok;
+
+    SensorRun silent;
+    silent.pass(SENSOR_OK, cold);
+    unsigned passes = silent.untilFault(SENSOR_NO_SAMPLE, cold, 20);
+    ok = checkResult("no sample for maxSampleAge faults the zone at once",
+                     passes > 0 && passes * 50 <= Project1SimConfig<BANG_BANG>::maxSampleAge + 50 && silent.safe()
+                         && silent.controller.faultCause() == SENSOR_STALE) && ok;
+
+    // 2.5 °C allowed per 50 ms pass: a one-read 20 °C spike is dropped, a
+    // jump that stays there faults
+    SensorRun spiky;
+    for (int i = 0; i < 10; i++) {
+        spiky.pass(SENSOR_OK, cold);
+    }
+    spiky.pass(SENSOR_OK, celsiusQ8(45.0));
+    spiky.pass(SENSOR_OK, cold);
+    bool dropped = spiky.controller.state() == HEATING && spiky.controller.temperature() == cold;
+    for (int i = 0; i < 3; i++) {
+        spiky.pass(SENSOR_OK, celsiusQ8(45.0));
+    }
+    ok = checkResult("an implausible jump is dropped, one that stays faults",
+                     dropped && spiky.safe() && spiky.controller.faultCause() == SENSOR_IMPLAUSIBLE) && ok;
+
+    SensorRun ramp;
+    bool followed = true;
+    for (int i = 0; i < 400; i++) {
+        ramp.pass(SENSOR_OK, cold + (TempQ8)(i * 20));  // 20 counts per pass, 1.6 °C/s
+        followed = ramp.controller.state() != SENSOR_FAULT && followed;
+    }
+    ok = checkResult("a fast but physical ramp is not a fault", followed) && ok;
+
+    SensorRun stuck;
+    unsigned stuckPasses = stuck.untilFault(SENSOR_OK, cold, 1000);
+    bool stuckHeld = true;
+    for (int i = 0; i < 40; i++) {
+        stuck.pass(SENSOR_OK, cold);
+        stuckHeld = stuck.safe() && stuckHeld;
+    }
+    unsigned long stuckTime = Project1SimConfig<BANG_BANG>::sensorStuckTime;
+    ok = checkResult("a reading frozen at full heat faults after sensorStuckTime",
+                     stuckPasses * 50 >= stuckTime && stuckPasses * 50 <= stuckTime + 200 && stuckHeld
+                         && stuck.controller.faultCause() == SENSOR_STUCK) && ok;
+
+    ok = checkResult("a TMP36 input at 0 V or 5 V is out of range", tmp36OutOfRange(0.0) && tmp36OutOfRange(5.0))
+         && ok;
+    return ok;
+}
+
+// ====== SAMPLING CLOCK ======
+// Runs the sample task for ms milliseconds at random gaps of 1..maxGap ms,
+// with the LM75 bus (if any) serviced every millisecond
+template <class Controller>
+void sampleIrregularly(Controller& controller, SimTwiBus* bus, unsigned long ms, unsigned long maxGap,
+                                std::mt19937& random) {
+    std::uniform_int_distribution<unsigned long> gap(1, maxGap);
+    unsigned long next = 0;
+    for (unsigned long t = 0; t < ms; t++) {
+        if (bus) {
+            bus->service();
+        }
+        if (t >= next) {
+            controller.sample();
+            controller.evaluate();
+            controller.actuate();
+            next = t + gap(random);
+        }
+        simAdvanceMicros(1000);
+    }
+}
+
+static bool runClock() {
+    bool ok = true;
+    std::mt19937 random(7);
+    char name[96];
+
+    // TMP36: the conversions come from Timer1, whatever the task timing
+    simReset();
+    Tmp36Feed tmp36;
+    tmp36.update(25.0);
+    HeaterController<Tmp36Feed::Sensor, Project1SimConfig<BANG_BANG> > project1;
+    project1.begin();
+    lowPowerBegin(LOW_POWER_KEEP_ADC | LOW_POWER_KEEP_TIMER1);
+    sampleIrregularly(project1, 0, 10000, 80, random);
+    SampleClockStats adcClock = sampleClockStats();
+    snprintf(name, sizeof(name), "TMP36 at %u Hz from Timer1, random task gaps (jitter %lu us)", adcClock.rate,
+             adcClock.jitter());
+    ok = checkResult(name, adcClock.rate == PROJECT1_SAMPLE_RATE && adcClock.samples >= 999 && adcClock.samples <= 1000
+                               && simTimer1Matches() == 10000UL * PROJECT1_SAMPLE_RATE * ADC_OVERSAMPLE / 1000
+                               && adcClock.jitter() <= 20 && adcClock.missed == 0
+                               && project1.state() != SENSOR_FAULT) && ok;
+
+    // Gating Timer1 off (the old lowPowerBegin()) stops the samples: a fault, heater off
+    simReset();
+    Tmp36Feed gated;
+    gated.update(25.0);
+    HeaterController<Tmp36Feed::Sensor, Project1SimConfig<BANG_BANG> > stopped;
+    stopped.begin();
+    lowPowerBegin(LOW_POWER_KEEP_ADC);
+    sampleIrregularly(stopped, 0, 1000, 50, random);
+    ok = checkResult("a Timer1 left gated off shows as a stale sensor",
+                     stopped.state() == SENSOR_FAULT && stopped.faultCause() == SENSOR_STALE && !stopped.heaterOn())
+         && ok;
+
+    // LM75: one burst per tick, collected within the sample task's gap
+    simReset();
+    Lm75Feed lm75;
+    lm75.lm75.setTemperature(25.0);
+    HeaterController<Lm75Feed::Sensor, Project2SimConfig<BANG_BANG> > project2;
+    beginController(project2, lm75.twiBus());
+    lowPowerBegin(LOW_POWER_KEEP_TWI | LOW_POWER_KEEP_TIMER1);
+    unsigned long transactions = lm75.bus.transactions;
+    sampleIrregularly(project2, lm75.twiBus(), 10000, 10, random);
+    SampleClockStats busClock = sampleClockStats();
+    unsigned long bursts = lm75.bus.transactions - transactions;
+    snprintf(name, sizeof(name), "LM75 bursts at %u Hz from Timer1 (%lu in 10 s, jitter %lu us)", busClock.rate,
+             bursts, busClock.jitter());
+    ok = checkResult(name, busClock.rate == PROJECT2_SAMPLE_RATE && bursts >= 199 && bursts <= 201
+                               && busClock.jitter() <= 20 && busClock.missed == 0
+                               && project2.state() != SENSOR_FAULT) && ok;
+
+    // A stalled sample task skips ticks instead of bunching reads up later
+    for (int i = 0; i < 120; i++) {
+        lm75.bus.service();
+        simAdvanceMicros(1000);
+    }
+    sampleIrregularly(project2, lm75.twiBus(), 1000, 5, random);
+    busClock = sampleClockStats();
+    ok = checkResult("a 120 ms stall skips ticks and counts them as missed",
+                     busClock.missed >= 1 && busClock.missed <= 3 && busClock.samples >= 218
+                         && busClock.longest >= 100000 && busClock.longest <= 150000) && ok;
+    return ok;
+}
+
+// ====== SENSOR RESOLUTION ======
+// Runs Sensor::begin() with the bus serviced, like beginController()
+template <class Sensor>
+static void beginSensor(SimTwiBus& bus) {
+    scanBus = &bus;
+    simSetIdleHook(serviceScanBus);
+    Sensor::begin();
+    simSetIdleHook(0);
+    scanBus = 0;
+}
+
+// What zone's sensor reads once the device reports celsius
+template <class Sensor>
+static TempQ8 readAt(SimTwiBus& bus, SimLm75& device, uint8_t zone, double celsius) {
+    device.setTemperature(celsius);
+    SensorReading reading = sensorReading(SENSOR_NO_SAMPLE);
+    for (uint8_t i = 0; i < 4 && !reading.ok(); i++) {
+        bus.service();
+        reading = Sensor::poll(zone);
+    }
+    return reading.ok() ? reading.value : TEMP_Q8_MIN;
+}
+
+// Reads +-celsius from a lone part converting at bits
+template <class Part>
+static bool decodes(uint8_t bits, double celsius, double expected) {
+    typedef Lm75Sensor<0x48, 1, 0, Part> Sensor;
+    simReset();
+    SimTwiBus bus;
+    SimLm75 device(0x48, Part::minBits == Part::maxBits ? bits : 0);
+    bus.attach(&device);
+    beginSensor<Sensor>(bus);
+    return device.resolution() == bits && Sensor::resolutionBits(0) == bits
+        && readAt<Sensor>(bus, device, 0, celsius) == celsiusQ8(expected)
+        && readAt<Sensor>(bus, device, 0, -celsius) == celsiusQ8(-expected);
+}
+
+// Bang-bang regulation of one plant through a part at its default
+// resolution; the load's peak-to-peak swing over the second half of 40
+// minutes and the relay toggles
+template <class Part>
+static void regulate(TempQ8 hysteresis, double& swing, unsigned long& toggles) {
+    typedef RackSimConfig<BANG_BANG> Config;
+    typedef Lm75Sensor<0x48, 1, 0, Part> Sensor;
+    simReset();
+    SimTwiBus bus;
+    SimLm75 device(0x48, Part::minBits == Part::maxBits ? Part::minBits : 0);
+    bus.attach(&device);
+    ThermalPlant plant(defaultPlant());
+    HeaterController<Sensor, Config> controller;
+    HeaterSettings settings = defaultSettings<Config>();
+    settings.hysteresis = hysteresis;
+    settings.startTemp = settings.targetTemp - hysteresis;
+    scanBus = &bus;
+    simSetIdleHook(serviceScanBus);
+    controller.begin(settings);
+    simSetIdleHook(0);
+    scanBus = 0;
+
+    const unsigned long tick = 5, ticks = 40UL * 60 * 1000 / tick;
+    double high = -100, low = 200;
+    unsigned long togglesBefore = 0;
+    for (unsigned long i = 0; i < ticks; i++) {
+        device.setTemperature(plant.sensorTemperature());
+        bus.service();
+        controller.sample();
+        if (i % (Config::controlPeriod / tick) == 0) {
+            controller.update();
+        }
+        if (i == ticks / 2) {
+            togglesBefore = simPinToggles(Config::heaterPin);
+        }
+        if (i >= ticks / 2) {
+            high = std::max(high, plant.loadTemperature());
+            low = std::min(low, plant.loadTemperature());
+        }
+        plant.step(tick / 1000.0, simPinLevel(Config::heaterPin) == HIGH);
+        simAdvanceMicros(tick * 1000UL);
+    }
+    swing = high - low;
+    toggles = simPinToggles(Config::heaterPin) - togglesBefore;
+}
+
+static bool runResolution() {
+    bool ok = true;
+    ok = checkResult("LM75, LM75B and TMP75 decode 1/2, 1/8 and 1/16 degree steps",
+                     decodes<Lm75Part>(9, 25.3, 25.5) && decodes<Lm75bPart>(11, 25.3, 25.25)
+                         && decodes<Tmp75Part<> >(12, 25.3, 25.3125) && decodes<Tmp75Part<10> >(10, 25.3, 25.25))
+         && ok;
+
+    // Two TMP75s: zone 0 traded down to 9 bits for its 27 ms conversions
+    typedef Lm75Sensor<0x48, 2, 0, Tmp75Part<> > Pair;
+    simReset();
+    SimTwiBus bus;
+    SimLm75 coarse(0x48, 0), fine(0x49, 0);
+    bus.attach(&coarse);
+    bus.attach(&fine);
+    beginSensor<Pair>(bus);
+    scanBus = &bus;  // The setup-time writes below block on the bus too
+    simSetIdleHook(serviceScanBus);
+    bool started = coarse.configuration() == 0x60 && fine.configuration() == 0x60
+                && coarse.registerPointer() == LM75_REG_TEMPERATURE && Pair::conversionMillis(1) == 220;
+    bool set = Pair::setResolution(0, 8) && Pair::resolutionBits(0) == 9 && Pair::conversionMillis(0) == 27
+            && Pair::setResolution(1, 13) && Pair::resolutionBits(1) == 12;
+    bool alarm = Pair::programAlarm(celsiusQ8(50.0625), celsiusQ8(40.0));
+    simSetIdleHook(0);
+    scanBus = 0;
+    ok = checkResult("a TMP75 starts at 12 bits, each zone sets its own",
+                     started && set && coarse.configuration() == LM75_CONFIG_COMPARATOR
+                         && fine.configuration() == 0x60) && ok;
+    ok = checkResult("programAlarm keeps the resolution and 12-bit limits",
+                     alarm && fine.configuration() == 0x60 && fine.thresholdTos() == celsiusQ8(50.0625)
+                         && fine.registerPointer() == LM75_REG_TEMPERATURE && readAt<Pair>(bus, coarse, 0, 30.2)
+                             == celsiusQ8(30.0) && readAt<Pair>(bus, fine, 1, 30.2) == celsiusQ8(30.1875)) && ok;
+
+    // New limits at run time (applySettings()): no idle hook, so a wait
+    // for the bus would never return; one write per poll between bursts
+    Pair::requestAlarm(celsiusQ8(60.0), celsiusQ8(45.5));
+    unsigned polls = 0;
+    while (Pair::alarmBusy() && polls < 100) {
+        bus.service();
+        Pair::poll(0);
+        polls++;
+    }
+    ok = checkResult("new limits go out between bursts, one write a poll",
+                     !Pair::alarmBusy() && Pair::alarmWritten() && polls >= 8
+                         && coarse.thresholdTos() == celsiusQ8(60.0) && fine.thresholdThyst() == celsiusQ8(45.5)
+                         && coarse.configuration() == LM75_CONFIG_COMPARATOR && fine.configuration() == 0x60
+                         && fine.registerPointer() == LM75_REG_TEMPERATURE
+                         && readAt<Pair>(bus, fine, 1, 30.2) == celsiusQ8(30.1875)) && ok;
+
+    // The point of the finer part: a narrower band it can actually resolve
+    double lm75Swing = 0, tmp75Swing = 0;
+    unsigned long lm75Toggles = 0, tmp75Toggles = 0;
+    regulate<Lm75Part>(celsiusQ8(2.0), lm75Swing, lm75Toggles);
+    regulate<Tmp75Part<> >(celsiusQ8(0.5), tmp75Swing, tmp75Toggles);
+    char name[80];
+    snprintf(name, sizeof(name), "TMP75 0.5 C band: %.2f C, %lu toggles; LM75 2 C: %.2f, %lu", tmp75Swing,
+             tmp75Toggles, lm75Swing, lm75Toggles);
+    ok = checkResult(name, tmp75Swing < lm75Swing / 2) && ok;
+    return ok;
+}
+
+// ====== 1-WIRE ======
+// Polls every zone of Sensor every 5 ms (the sketch's sample task) for
+// ms milliseconds. Counts fresh readings and failures per zone, keeps the
+// last reading, and the longest any one pass held the CPU (µs).
+template <class Sensor, uint8_t Zones>
+struct OneWirePolls {
+    OneWirePolls() : longestPass(0) {
+        for (uint8_t zone = 0; zone < Zones; zone++) {
+            fresh[zone] = failed[zone] = notFound[zone] = 0;
+            firstFresh[zone] = 0;
+            last[zone] = 0;
+        }
+    }
+
+    void run(unsigned long ms) {
+        for (unsigned long t = 0; t < ms; t += 5) {
+            uint64_t start = simNowMicros();
+            for (uint8_t zone = 0; zone < Zones; zone++) {
+                SensorReading reading = Sensor::poll(zone);
+                if (reading.ok()) {
+                    firstFresh[zone] = fresh[zone]++ == 0 ? millis() : firstFresh[zone];
+                    last[zone] = reading.value;
+                } else if (reading.status == SENSOR_READ_FAILED) {
+                    failed[zone]++;
+                } else if (reading.status == SENSOR_NOT_FOUND) {
+                    notFound[zone]++;
+                }
+            }
+            uint64_t spent = simNowMicros() - start;
+            longestPass = spent > longestPass ? spent : longestPass;
+            simAdvanceMicros(5000 - (spent < 5000 ? spent : 0));
+        }
+    }
+
+    unsigned long fresh[Zones], failed[Zones], notFound[Zones];
+    unsigned long firstFresh[Zones];  // millis() of the first good reading
+    TempQ8 last[Zones];
+    uint64_t longestPass;
+};
+
+static bool sameRom(const uint8_t* a, const uint8_t* b) { return memcmp(a, b, ONE_WIRE_ROM_SIZE) == 0; }
+
+static bool runOneWire() {
+    bool ok = true;
+
+    // Three sensors for four zones
+    typedef Ds18b20Sensor<ONE_WIRE_PIN, 4> Sensor;
+    simReset();
+    SimOneWireBus bus(ONE_WIRE_PIN);
+    SimDs18b20 first(0x01), second(0x02), third(0x13);
+    SimDs18b20* devices[] = {&first, &second, &third};
+    for (uint8_t i = 0; i < 3; i++) {
+        bus.attach(devices[i]);
+    }
+    bus.connect();
+    first.setTemperature(30.0625);
+    second.setTemperature(-10.5);
+    third.setTemperature(45.2);
+    Sensor::begin();
+    bool everyRom = Sensor::sensorCount() == 3;
+    for (uint8_t i = 0; i < 3 && everyRom; i++) {
+        bool listed = false;
+        for (uint8_t zone = 0; zone < 3; zone++) {
+            listed = listed || sameRom(Sensor::rom(zone), devices[i]->romId());
+        }
+        everyRom = listed;
+    }
+    ok = checkResult("the ROM search finds every DS18B20 on the line", everyRom) && ok;
+
+    unsigned long start = millis();
+    OneWirePolls<Sensor, 4> polls;
+    polls.run(3000);
+    bool allRead = true, exact = true;
+    for (uint8_t zone = 0; zone < 3; zone++) {
+        allRead = allRead && polls.fresh[zone] >= 2 && polls.firstFresh[zone] - start < 1100;
+        double expected = sameRom(Sensor::rom(zone), first.romId()) ? 30.0625
+                        : (sameRom(Sensor::rom(zone), second.romId()) ? -10.5 : 45.1875);
+        exact = exact && polls.last[zone] == celsiusQ8(expected);
+    }
+    bool shared = first.convertCommands == second.convertCommands && first.convertCommands == third.convertCommands
+               && first.convertCommands == polls.fresh[0] + 1;
+    ok = checkResult("one Convert T serves all three; all read within 1.1 s", allRead && exact && shared) && ok;
+    char name[80];
+    snprintf(name, sizeof(name), "no sample pass holds the CPU over 1.1 ms (%lu us)", (unsigned long)polls.longestPass);
+    ok = checkResult(name, polls.longestPass <= 1100) && ok;
+
+    // Zones follow the search order, so find them by ROM
+    second.corrupt = true;
+    third.present = false;
+    OneWirePolls<Sensor, 4>().run(1500);  // Whatever was read before
+    OneWirePolls<Sensor, 4> faults;
+    faults.run(3000);
+    bool isolated = true;
+    for (uint8_t zone = 0; zone < 3; zone++) {
+        bool working = sameRom(Sensor::rom(zone), first.romId());
+        isolated = isolated && (working ? faults.fresh[zone] >= 2 && faults.failed[zone] == 0
+                                        : faults.fresh[zone] == 0 && faults.failed[zone] >= 2);
+    }
+    ok = checkResult("a bad CRC or a lost sensor fails its zone only", isolated) && ok;
+    ok = checkResult("a zone with no sensor reports SENSOR_NOT_FOUND",
+                     polls.notFound[3] == 600 && faults.notFound[3] == 600) && ok;
+
+    // A DS18S20 (family 0x10) comes first in the search but takes no zone
+    typedef Ds18b20Sensor<ONE_WIRE_PIN, 2> Pair;
+    simReset();
+    SimOneWireBus mixedBus(ONE_WIRE_PIN);
+    SimDs18b20 older(0x31, 0x10), upper(0x32), lower(0x33);
+    mixedBus.attach(&older);
+    mixedBus.attach(&upper);
+    mixedBus.attach(&lower);
+    mixedBus.connect();
+    Pair::begin();
+    ok = checkResult("another family on the line leaves every zone a DS18B20",
+                     Pair::sensorCount() == 2 && sameRom(Pair::rom(0), upper.romId())
+                         && sameRom(Pair::rom(1), lower.romId())) && ok;
+
+    // A 9-bit build: every sensor set over Skip ROM, 94 ms conversions
+    typedef Ds18b20Sensor<ONE_WIRE_PIN, 2, 9> Coarse;
+    simReset();
+    SimOneWireBus coarseBus(ONE_WIRE_PIN);
+    SimDs18b20 left(0x21), right(0x22);
+    coarseBus.attach(&left);
+    coarseBus.attach(&right);
+    coarseBus.connect();
+    left.setTemperature(30.3);
+    right.setTemperature(30.3);
+    Coarse::begin();
+    OneWirePolls<Coarse, 2> coarse;
+    coarse.run(3000);
+    ok = checkResult("a 9-bit build reads 0.5 C steps three times a second",
+                     left.resolution() == 9 && right.resolution() == 9 && coarse.last[0] == celsiusQ8(30.5)
+                         && coarse.last[1] == celsiusQ8(30.5) && coarse.fresh[0] >= 9 && coarse.fresh[1] >= 9) && ok;
+    return ok;
+}
+
+// ====== RELAY AUTOTUNE ======
+// Project 1 in PID mode on the plant and a noisy TMP36, one control
+// period per pass
+struct AutotuneRun {
+    typedef Project1SimConfig<PID> Config;
+    typedef HeaterController<Tmp36Feed::Sensor, Config> Controller;
+
+    AutotuneRun() : plant(defaultPlant()), rng(1), noise(0.0, 0.05), overheated(false), unsafe(false) {
+        simReset();
+        feed.update(plant.sensorTemperature());
+        beginController(controller, 0);
+        feed.update(plant.sensorTemperature());
+    }
+    void pass() {
+        feed.update(plant.sensorTemperature() + noise(rng));
+        controller.sample();
+        controller.evaluate();
+        controller.actuate();
+        bool on = simPinLevel(Config::heaterPin) == HIGH;
+        HeaterState state = controller.state();
+        overheated = state == OVERHEAT || overheated;
+        unsafe = (on && (state == IDLE || state == OVERHEAT || state == SENSOR_FAULT)) || unsafe;
+        plant.step(Config::controlPeriod / 1000.0, on);
+        simAdvanceMicros(Config::controlPeriod * 1000UL);
+    }
+    // Passes until the tune ends; returns the simulated minutes (-1: still running)
+    double untilTuned(double limitMinutes) {
+        unsigned long limit = (unsigned long)(limitMinutes * 60000.0 / Config::controlPeriod);
+        for (unsigned long i = 1; i <= limit; i++) {
+            pass();
+            if (!controller.autotuning()) {
+                return i * Config::controlPeriod / 60000.0;
+            }
+        }
+        return -1;
+    }
+
+    Tmp36Feed feed;
+    ThermalPlant plant;
+    std::mt19937 rng;
+    std::normal_distribution<double> noise;
+    Controller controller;
+    bool overheated, unsafe;
+};
+
+static bool runAutotune() {
+    typedef AutotuneRun::Config Config;
+    bool ok = true;
+
+    AutotuneRun tune;
+    bool started = tune.controller.startAutotune() && tune.controller.state() == AUTOTUNE;
+    bool refused = !tune.controller.startAutotune();
+    double minutes = tune.untilTuned(120);
+    AutotuneStatus outcome = tune.controller.takeAutotuneOutcome();
+    const AutotuneResult& result = tune.controller.autotuneResult();
+    const HeaterSettings& tuned = tune.controller.settings();
+    char name[96];
+    snprintf(name, sizeof(name), "tuned in %.0f min: Tu %lu s, a %.2f C, Kp %.1f Ki %.2f Kd %.1f", minutes,
+             (unsigned long)result.period / 1000, q8ToCelsius(result.amplitude), tuned.pidKp / 256.0,
+             tuned.pidKi / 256.0, tuned.pidKd / 256.0);
+    ok = checkResult(name, started && refused && minutes > 0 && outcome == AUTOTUNE_DONE
+                               && tune.controller.state() == IDLE && tune.controller.takeAutotuneOutcome() == AUTOTUNE_OFF
+                               && !tune.overheated && !tune.unsafe) && ok;
+    ok = checkResult("the tuned gains and timing replace the settings",
+                     tuned.pidKp == result.kp && tuned.pidKi == result.ki && tuned.pidKd == result.kd
+                         && tuned.pidKp > 0 && tuned.pidKi > 0 && tuned.pidKd > 0 && tuned.pidKd < 0x7FFF
+                         && tuned.pidKd == (int16_t)((int32_t)tuned.pidKp * ((result.period + 500) / 1000) / 180)
+                         && tuned.hysteresis == result.hysteresis
+                         && tuned.stabilizingTime == result.period) && ok;
+
+    // The tuned loop from a cold start: to the target without OVERHEAT
+    // and holding it within a degree
+    AutotuneRun run;
+    run.controller.applySettings(tuned);
+    double target = q8ToCelsius(tuned.targetTemp);
+    bool reached = false;
+    double worst = 0;
+    for (unsigned long i = 0; i < 30UL * 60000 / Config::controlPeriod; i++) {
+        run.pass();
+        double load = run.plant.loadTemperature();
+        reached = load >= target || reached;
+        if (i >= 20UL * 60000 / Config::controlPeriod) {
+            worst = fabs(load - target) > worst ? fabs(load - target) : worst;
+        }
+    }
+    snprintf(name, sizeof(name), "PID on the tuned gains reaches and holds the target (+-%.2f C)", worst);
+    ok = checkResult(name, reached && worst < 1.0 && !run.overheated && !run.unsafe) && ok;
+
+    // Anything that leaves AUTOTUNE early fails the tune, heater off
+    AutotuneRun aborted;
+    aborted.controller.startAutotune();
+    for (int i = 0; i < 200; i++) {
+        aborted.pass();
+    }
+    bool heating = aborted.controller.heaterOn();
+    aborted.feed.fail();
+    for (int i = 0; i < 20; i++) {
+        aborted.pass();
+    }
+    ok = checkResult("a sensor fault aborts the tune, heater off",
+                     heating && aborted.controller.state() == SENSOR_FAULT && !aborted.controller.heaterOn()
+                         && aborted.controller.takeAutotuneOutcome() == AUTOTUNE_FAILED
+                         && aborted.controller.settings().pidKp == Config::pidKp) && ok;
+    return ok;
+}
+
+// ====== HISTORY LOG ======
+// The log the console and history tests feed through Config::TransitionLog
+static HistoryLog<> simHistory;
+
+struct SimHistoryTransitions {
+    static void record(uint8_t zone, HeaterState from, HeaterState to) { simHistory.transition(zone, from, to); }
+};
+
+template <ControlMode Mode>
+struct LoggedSimConfig : Project1SimConfig<Mode> {
+    typedef SimHistoryTransitions TransitionLog;
+};
+
+// One decoded record; samples have zone 0xFF
+struct HistoryEvent {
+    unsigned long time;
+    int16_t counts;
+    uint8_t zone, from, to;
+
+    bool operator==(const HistoryEvent& other) const {
+        return time == other.time && counts == other.counts && zone == other.zone && from == other.from
+            && to == other.to;
+    }
+};
+
+static HistoryEvent historySample(unsigned long time, int16_t counts) {
+    HistoryEvent e = {time, counts, 0xFF, 0, 0};
+    return e;
+}
+
+// Decodes whole blocks as laid out in HistoryLog.h (the C++ twin of
+// decode_history() in tools/telemetry_decode.py)
+static std::vector<HistoryEvent> decodeHistory(const std::vector<uint8_t>& data) {
+    std::vector<HistoryEvent> events;
+    for (size_t start = 0; start + HISTORY_BLOCK_SIZE <= data.size(); start += HISTORY_BLOCK_SIZE) {
+        const uint8_t* block = &data[start];
+        unsigned long time = block[0] | (unsigned long)block[1] << 8 | (unsigned long)block[2] << 16
+                           | (unsigned long)block[3] << 24;
+        int16_t counts = (int16_t)(block[4] | block[5] << 8);
+        uint8_t used = block[6];
+        uint8_t pos = 0;
+        auto take = [&](uint8_t n) {
+            uint16_t value = 0;
+            while (n--) {
+                value = value << 1 | ((block[HISTORY_HEADER_SIZE + (pos >> 3)] >> (7 - (pos & 7))) & 1);
+                pos++;
+            }
+            return value;
+        };
+        bool repeat = false;
+        for (size_t i = events.size(); i-- > 0;) {
+            if (events[i].zone == 0xFF) {
+                repeat = events[i].time == time;
+                break;
+            }
+        }
+        if (!repeat) {
+            events.push_back(historySample(time, counts));
+        }
+        while (pos < used) {
+            if (take(1) == 0) {
+            } else if (take(1) == 0) {
+                counts += take(1) ? -1 : 1;
+            } else if (take(1) == 0) {
+                uint16_t raw = take(12);
+                counts = (int16_t)(raw & 0x800 ? raw - 0x1000 : raw);
+            } else {
+                HistoryEvent e;
+                e.zone = take(3);
+                e.from = take(3);
+                e.to = take(3);
+                e.time = time + take(7);
+                e.counts = 0;
+                events.push_back(e);
+                continue;
+            }
+            time += HISTORY_SAMPLE_PERIOD;
+            events.push_back(historySample(time, counts));
+        }
+    }
+    return events;
+}
+
+// The logged truth ends with the decoded events
+static bool endsWith(const std::vector<HistoryEvent>& logged, const std::vector<HistoryEvent>& decoded) {
+    return !decoded.empty() && decoded.size() <= logged.size()
+        && std::equal(decoded.begin(), decoded.end(), logged.end() - decoded.size());
+}
+
+template <class Log>
+static std::vector<uint8_t> ringBytes(const Log& log) {
+    std::vector<uint8_t> bytes;
+    for (uint16_t i = 0; i < log.size(); i++) {
+        bytes.push_back(log.byteAt(i, log.oldestBlock()));
+    }
+    return bytes;
+}
+
+static double historyMinutes(const std::vector<HistoryEvent>& events) {
+    return events.empty() ? 0 : (events.back().time - events.front().time) / 60000.0;
+}
+
+static bool runHistory() {
+    bool ok = true;
+    simReset();
+    simEepromErase();
+    HistoryLog<> log;
+    std::vector<HistoryEvent> logged;
+
+    // Ten minutes at 10 Hz: a 3 minute ramp from 25 to 45 °C, then a
+    // steady hold, and a state change now and then 37 ms after a sample.
+    // Ends on an OVERHEAT, which starts the EEPROM copy.
+    HeaterState state = IDLE;
+    const unsigned long samples = 10 * 60 * 10;
+    for (unsigned long i = 0; i < samples; i++) {
+        TempQ8 temp = celsiusQ8(i < 1800 ? 25.0 + 20.0 * i / 1800 : 45.0);
+        log.sample(temp);
+        logged.push_back(historySample(millis(), temp >> 4));
+        if (i % 900 == 450 || i == samples - 1) {
+            HeaterState next = i == samples - 1 ? OVERHEAT : (HeaterState)((state + 1) % OVERHEAT);
+            simAdvanceMicros(37000);
+            log.transition(0, state, next);
+            HistoryEvent e = {millis(), 0, 0, (uint8_t)state, (uint8_t)next};
+            logged.push_back(e);
+            state = next;
+            simAdvanceMicros(63000);
+        } else {
+            simAdvanceMicros(100000);
+        }
+    }
+    std::vector<uint8_t> atTrip = ringBytes(log);
+    std::vector<HistoryEvent> decoded = decodeHistory(atTrip);
+    ok = checkResult("the ring decodes to the newest samples and state changes", endsWith(logged, decoded)) && ok;
+    char name[64];
+    double minutes = historyMinutes(decoded);
+    snprintf(name, sizeof(name), "%u bytes keep 4 minutes of a steady reading (%.1f)", (unsigned)log.size(), minutes);
+    ok = checkResult(name, minutes >= 4.0) && ok;
+
+    // The copy to EEPROM runs in the storage task while logging goes on;
+    // the copy ends with whatever the newest block gained meanwhile
+    bool savingAfterTrip = log.saving();
+    for (int i = 0; i < 1000 && log.saving(); i++) {
+        log.service();
+        if (i % 25 == 0) {
+            log.sample(celsiusQ8(45.0));
+        }
+        simAdvanceMicros(4000);
+    }
+    std::vector<uint8_t> saved;
+    for (uint16_t i = 0; i < log.savedSize(); i++) {
+        saved.push_back(log.savedByte(i));
+    }
+    std::vector<HistoryEvent> savedEvents = decodeHistory(saved);
+    ok = checkResult("OVERHEAT copies the log to EEPROM",
+                     savingAfterTrip && !log.saving() && savedEvents.size() > decoded.size()
+                         && std::equal(decoded.begin(), decoded.end(), savedEvents.begin())) && ok;
+
+    // A reading flickering between two counts on every sample is the
+    // worst steady case
+    HistoryLog<> flicker;
+    for (unsigned long i = 0; i < samples; i++) {
+        flicker.sample(celsiusQ8(45.0) + (i & 1 ? 16 : 0));
+        simAdvanceMicros(100000);
+    }
+    minutes = historyMinutes(decodeHistory(ringBytes(flicker)));
+    snprintf(name, sizeof(name), "and 1.5 minutes of one flickering every sample (%.1f)", minutes);
+    ok = checkResult(name, minutes >= 1.5) && ok;
+
+    // Reset partway through a copy: the old copy is gone, not half-read
+    flicker.saveToEeprom();
+    for (int i = 0; i < 40; i++) {
+        flicker.service();
+        simAdvanceMicros(4000);
+    }
+    HistoryLog<> afterReset;
+    ok = checkResult("a torn copy reads back as empty", flicker.saving() && afterReset.savedSize() == 0) && ok;
+    ok = checkResult("the log never waited on an EEPROM write", simEepromWaits() == 0) && ok;
+
+    // State changes come in through Config::TransitionLog, and the
+    // console dump decodes to the same log
+    typedef HeaterController<Tmp36Feed::Sensor, LoggedSimConfig<BANG_BANG> > Controller;
+    typedef Scheduler<2> Sched;
+    simReset();
+    simHistory = HistoryLog<>();
+    Tmp36Feed feed;
+    Controller controller;
+    SettingsStore<> store;
+    Sched scheduler;
+    CaptureOut out;
+    HeaterConsole<Controller, SettingsStore<>, HistoryLog<>, Sched, CaptureOut> console(controller, store, simHistory,
+                                                                                     scheduler, out);
+    feed.update(25.0);
+    beginController(controller, 0);
+    for (int i = 0; i < 20; i++) {
+        simHistory.sample(controller.temperature());
+        simAdvanceMicros(100000);
+    }
+    controller.changeState(0, HEATING);
+    std::string dump = command(console, out, "log");
+    std::vector<uint8_t> bytes;
+    bool framed = dump.compare(0, 8, "log ram ") == 0 && dump.size() > 8 && dump.find("log end\n") != std::string::npos;
+    for (size_t at = dump.find("h "); at != std::string::npos; at = dump.find("h ", at)) {
+        at += 2;
+        for (; at + 1 < dump.size() && dump[at] != '\n'; at += 2) {
+            bytes.push_back((uint8_t)strtoul(dump.substr(at, 2).c_str(), 0, 16));
+        }
+    }
+    std::vector<HistoryEvent> events = decodeHistory(bytes);
+    ok = checkResult("the console dumps the log, state changes included",
+                     framed && bytes.size() == simHistory.size() && !events.empty() && events.back().zone == 0
+                         && events.back().from == IDLE && events.back().to == HEATING) && ok;
+    simHistory.saveToEeprom();
+    ok = checkResult("log saved refuses to read while the copy is written",
+                     command(console, out, "log saved") == "err busy\n") && ok;
+    return ok;
+}
+
+static bool runConsole() {
+    typedef Project1SimConfig<BANG_BANG> Config;
+    typedef HeaterController<Tmp36Feed::Sensor, Config> Controller;
+    typedef Scheduler<2> Sched;
+    bool ok = true;
+    simReset();
+    simEepromErase();
+    Tmp36Feed feed;
+    Controller controller;
+    SettingsStore<> store;
+    HistoryLog<> log;
+    Sched scheduler;
+    CaptureOut out;
+    HeaterConsole<Controller, SettingsStore<>, HistoryLog<>, Sched, CaptureOut> console(controller, store, log,
+                                                                                     scheduler, out);
+    feed.update(25.0);
+    beginController(controller, 0);
+    feed.update(25.0);
+    controller.sample();
+    controller.evaluate();
+
+    ok = checkResult("set changes a threshold and queues a save",
+                     command(console, out, "set target 32.5") == "ok\n"
+                         && controller.settings().targetTemp == celsiusQ8(32.5) && store.busy()) && ok;
+    ok = checkResult("get prints it back",
+                     command(console, out, "GET target") == "target 32.50\n") && ok;
+    ok = checkResult("get lists every setting",
+                     command(console, out, "get").find("stab 30000\nkp 40.000\nki 0.500\nkd 1.000\n")
+                         != std::string::npos) && ok;
+    ok = checkResult("gains up to the Q8.8 ceiling round-trip through get",
+                     command(console, out, "set kd 127.996") == "ok\n" && controller.settings().pidKd == 0x7FFF
+                         && command(console, out, "get kd") == "kd 127.996\n"
+                         && command(console, out, "set kp 0.004") == "ok\n" && controller.settings().pidKp == 1
+                         && command(console, out, "set kd 128") == "err value\n"
+                         && command(console, out, "set ki -1") == "err value\n") && ok;
+    ok = checkResult("inconsistent thresholds are refused",
+                     command(console, out, "set release 45") == "err range\n"
+                         && controller.settings().overheatReleaseTemp == Config::overheatReleaseTemp) && ok;
+    ok = checkResult("bad names and values are refused",
+                     command(console, out, "set colour 3") == "err name\n"
+                         && command(console, out, "set hyst 1.x") == "err value\n") && ok;
+    ok = checkResult("state forces a state",
+                     command(console, out, "state overheat") == "ok\n" && controller.state() == OVERHEAT) && ok;
+    ok = checkResult("reset clears OVERHEAT once below the limit",
+                     command(console, out, "reset") == "ok\n" && controller.state() == IDLE
+                         && command(console, out, "reset") == "err not overheat\n") && ok;
+    ok = checkResult("tune starts once, stop reports the tune failed",
+                     command(console, out, "tune") == "ok\n" && controller.state() == AUTOTUNE
+                         && command(console, out, "tune 0") == "err busy\n"
+                         && command(console, out, "tune stop") == "ok\ntune failed\n" && controller.state() == IDLE)
+         && ok;
+    ok = checkResult("over-long lines are dropped",
+                     command(console, out, "set target 30.000000000000000000") == "err too long\n") && ok;
+    std::string stats = command(console, out, "stats");
+    ok = checkResult("stats shows the sampling clock and ends with the zone line",
+                     stats.find("clock 100 jitter ") != std::string::npos && stats.find("idle\n") != std::string::npos)
+         && ok;
+
+    // One call takes no more than CONSOLE_BYTES_PER_CALL bytes
+    simSerialInput("get target\nget hyst\n");
+    int before = Serial.available();
+    console.service(Serial);
+    ok = checkResult("one call takes a bounded number of bytes",
+                     before - Serial.available() <= CONSOLE_BYTES_PER_CALL) && ok;
+    command(console, out, "");
+
+    // Binary builds: replies become TLM_TEXT frames on the telemetry link
+    TelemetryLink<> link;
+    TelemetryTextPrint<TelemetryLink<> > text(link);
+    simSerialClear();
+    text.println("ok");
+    link.drain(Serial);
+    const std::vector<uint8_t>& sent = simSerialOutput();
+    ok = checkResult("replies travel as TLM_TEXT frames",
+                     sent.size() == 8 && sent[2] == TLM_TEXT && sent[3] == 2 && sent[4] == 'o' && sent[5] == 'k')
+         && ok;
+    return ok;
+}
+
+// ====== MODBUS FLEET NODE ======
+// A two-zone node at address 1, 38400 baud, with the harness as the bus
+// master on the other end of the line: scripted zone temperatures, the
+// node's serial task every 2 ms, the store's every 4 ms and a control
+// pass every 50 ms, as in the sketch
+const uint8_t FLEET_ADDRESS = 1;
+const unsigned long FLEET_BAUD = 38400;
+const uint8_t FLEET_ENABLE_PIN = 4;
+static TempQ8 fleetTemps[2];
+
+struct FleetSensor {
+    static void begin() {}
+    static SensorReading poll(uint8_t zone) { return sensorReading(SENSOR_OK, fleetTemps[zone]); }
+};
+
+struct FleetSimConfig : Project1SimConfig<BANG_BANG> {
+    typedef NoFilter SampleFilter;
+};
+
+struct FleetRun {
+    typedef HeaterController<FleetSensor, FleetSimConfig, 2> Controller;
+
+    FleetRun() : uart(FLEET_BAUD, FLEET_ENABLE_PIN), node(controller, store, FLEET_ADDRESS), ticks(0), roundTrip(0) {
+        simReset();
+        simEepromErase();
+        fleetTemps[0] = celsiusQ8(25.0);
+        fleetTemps[1] = celsiusQ8(31.5);
+        controller.begin();
+        node.begin(FLEET_BAUD, FLEET_ENABLE_PIN);
+        run(100);
+    }
+
+    void run(unsigned long ms) {
+        for (unsigned long i = 0; i < ms; i++) {
+            uart.advance(1000);
+            ticks++;
+            if (ticks % 2 == 0) {
+                node.service();
+            }
+            if (ticks % 4 == 0) {
+                store.service();
+            }
+            if (ticks % 50 == 0) {
+                controller.update();
+            }
+        }
+    }
+
+    // Sends a request, with its CRC appended unless it has one, gives the
+    // node 30 ms and returns what it sent back (nothing, for no reply)
+    std::vector<uint8_t> transact(std::vector<uint8_t> request, bool withCrc = false) {
+        if (!withCrc) {
+            uint16_t crc = modbusCrc(request.data(), (uint8_t)request.size());
+            request.push_back(lowByte(crc));
+            request.push_back(highByte(crc));
+        }
+        uint64_t start = uart.lastArrival();
+        size_t first = uart.sent.size();
+        uart.receive(request);
+        run(30);
+        std::vector<uint8_t> reply(uart.sent.begin() + first, uart.sent.end());
+        roundTrip = reply.empty() ? 0 : uart.sentAt.back() - start;
+        return reply;
+    }
+
+    Controller controller;
+    SettingsStore<> store;
+    SimUart uart;
+    ModbusNode<Controller, SettingsStore<> > node;
+    unsigned long ticks;
+    uint64_t roundTrip;  // µs from the request's first start bit to the reply's last stop bit
+};
+
+static std::vector<uint8_t> modbusRequest(uint8_t address, uint8_t function, uint16_t first, uint16_t second) {
+    return std::vector<uint8_t>{address, function, highByte(first), lowByte(first), highByte(second), lowByte(second)};
+}
+
+static std::vector<uint8_t> modbusWrite(uint8_t address, uint16_t start, const std::vector<uint16_t>& values) {
+    std::vector<uint8_t> frame = modbusRequest(address, MODBUS_WRITE_MULTIPLE, start, (uint16_t)values.size());
+    frame.push_back((uint8_t)(2 * values.size()));
+    for (size_t i = 0; i < values.size(); i++) {
+        frame.push_back(highByte(values[i]));
+        frame.push_back(lowByte(values[i]));
+    }
+    return frame;
+}
+
+// A well-formed read reply of count registers
+static bool readReply(const std::vector<uint8_t>& reply, uint8_t function, size_t count) {
+    return reply.size() == 5 + 2 * count && reply[0] == FLEET_ADDRESS && reply[1] == function
+        && reply[2] == 2 * count && modbusCrc(reply.data(), (uint8_t)reply.size()) == 0;
+}
+
+static uint16_t replyWord(const std::vector<uint8_t>& reply, size_t index) {
+    return (uint16_t)((reply[3 + 2 * index] << 8) | reply[4 + 2 * index]);
+}
+
+static bool exceptionReply(const std::vector<uint8_t>& reply, uint8_t function, uint8_t code) {
+    return reply.size() == 5 && reply[1] == (function | MODBUS_EXCEPTION) && reply[2] == code
+        && modbusCrc(reply.data(), 5) == 0;
+}
+
+static bool runFleet() {
+    bool ok = true;
+    char name[96];
+    FleetRun fleet;
+    const FleetRun::Controller& controller = fleet.controller;
+
+    // The example frame from the Modbus application protocol spec
+    std::vector<uint8_t> reply = fleet.transact(std::vector<uint8_t>{0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD}, true);
+    const HeaterSettings& settings = controller.settings();
+    ok = checkResult("the spec's example request reads every threshold (FC 03)",
+                     readReply(reply, MODBUS_READ_HOLDING, 10) && replyWord(reply, 0) == (uint16_t)settings.targetTemp
+                         && replyWord(reply, 4) == (uint16_t)settings.overheatReleaseTemp
+                         && replyWord(reply, 5) == 0 && replyWord(reply, 6) == settings.stabilizingTime
+                         && replyWord(reply, 9) == (uint16_t)settings.pidKd) && ok;
+
+    reply = fleet.transact(modbusRequest(FLEET_ADDRESS, MODBUS_READ_INPUT, 0, 13));
+    ok = checkResult("input registers carry each zone's temperature and state",
+                     readReply(reply, MODBUS_READ_INPUT, 13) && replyWord(reply, 0) == (uint16_t)fleetTemps[0]
+                         && replyWord(reply, 1) == HEATING && replyWord(reply, 2) == controller.heaterDuty(0)
+                         && replyWord(reply, 3) == MODBUS_FLAG_HEATER && replyWord(reply, 8) == (uint16_t)fleetTemps[1]
+                         && replyWord(reply, 9) == IDLE && replyWord(reply, 11) == 0) && ok;
+
+    reply = fleet.transact(modbusRequest(FLEET_ADDRESS, MODBUS_READ_INPUT, MODBUS_NODE_BASE, 5));
+    ok = checkResult("the node block has the zone count, uptime and errors",
+                     readReply(reply, MODBUS_READ_INPUT, 5) && replyWord(reply, 0) == 2 && replyWord(reply, 1) == 0
+                         && replyWord(reply, 2) == millis() / 1000 && replyWord(reply, 4) == 0) && ok;
+
+    std::vector<uint8_t> request = modbusRequest(FLEET_ADDRESS, MODBUS_WRITE_SINGLE, 0, (uint16_t)celsiusQ8(35.0));
+    reply = fleet.transact(request);
+    ok = checkResult("a single write (FC 06) changes a threshold and saves it",
+                     reply.size() == 8 && std::equal(request.begin(), request.end(), reply.begin())
+                         && controller.settings().targetTemp == celsiusQ8(35.0) && fleet.store.busy()) && ok;
+
+    reply = fleet.transact(modbusWrite(FLEET_ADDRESS, 3, std::vector<uint16_t>{(uint16_t)celsiusQ8(30.0),
+                                                                                (uint16_t)celsiusQ8(45.0)}));
+    ok = checkResult("writes that fail valid() get exception 3, nothing changes",
+                     exceptionReply(reply, MODBUS_WRITE_MULTIPLE, MODBUS_ILLEGAL_VALUE)
+                         && controller.settings().startTemp == FleetSimConfig::startTemp
+                         && controller.settings().overheatReleaseTemp == FleetSimConfig::overheatReleaseTemp) && ok;
+
+    ok = checkResult("unknown functions and registers get exceptions 1 and 2",
+                     exceptionReply(fleet.transact(modbusRequest(FLEET_ADDRESS, 0x05, 0, 0xFF00)), 0x05,
+                                    MODBUS_ILLEGAL_FUNCTION)
+                         && exceptionReply(fleet.transact(modbusRequest(FLEET_ADDRESS, MODBUS_READ_HOLDING, 9, 2)),
+                                           MODBUS_READ_HOLDING, MODBUS_ILLEGAL_ADDRESS)
+                         && exceptionReply(fleet.transact(modbusRequest(FLEET_ADDRESS, MODBUS_READ_INPUT, 16, 1)),
+                                           MODBUS_READ_INPUT, MODBUS_ILLEGAL_ADDRESS)) && ok;
+
+    // Setpoints for every node at once
+    std::vector<uint8_t> broadcast = modbusWrite(MODBUS_BROADCAST, 0, std::vector<uint16_t>{
+        (uint16_t)celsiusQ8(33.0), (uint16_t)celsiusQ8(1.5)});
+    reply = fleet.transact(broadcast);
+    ok = checkResult("a broadcast write (FC 16 to 0) is applied, not answered",
+                     reply.empty() && controller.settings().targetTemp == celsiusQ8(33.0)
+                         && controller.settings().hysteresis == celsiusQ8(1.5)) && ok;
+    fleet.run(SETTINGS_SAVE_DELAY + 500);
+    bool flushed = !fleet.store.busy();
+    reply = fleet.transact(broadcast);
+    ok = checkResult("repeating the broadcast queues no EEPROM write",
+                     flushed && reply.empty() && !fleet.store.busy()) && ok;
+
+    // A request with a bad CRC, one broken by a 1 ms gap, one for node 2
+    request = modbusRequest(FLEET_ADDRESS, MODBUS_READ_INPUT, 0, 1);
+    std::vector<uint8_t> damaged = request;
+    damaged.push_back(0x12);
+    damaged.push_back(0x34);
+    bool silent = fleet.transact(damaged, true).empty();
+    uint16_t crc = modbusCrc(request.data(), (uint8_t)request.size());
+    fleet.uart.receive(std::vector<uint8_t>(request.begin(), request.begin() + 3));
+    std::vector<uint8_t> rest(request.begin() + 3, request.end());
+    rest.push_back(lowByte(crc));
+    rest.push_back(highByte(crc));
+    fleet.uart.receive(rest, fleet.uart.lastArrival() + 1000);
+    size_t sent = fleet.uart.sent.size();
+    fleet.run(30);
+    silent = silent && fleet.uart.sent.size() == sent;
+    silent = silent && fleet.transact(modbusRequest(2, MODBUS_READ_INPUT, 0, 1)).empty();
+    reply = fleet.transact(modbusRequest(FLEET_ADDRESS, MODBUS_READ_INPUT, MODBUS_NODE_BASE + MODBUS_NODE_DROPPED, 1));
+    ok = checkResult("bad CRCs, split frames and other nodes' frames get no reply",
+                     silent && readReply(reply, MODBUS_READ_INPUT, 1) && replyWord(reply, 0) == 2
+                         && fleet.node.droppedFrames() == 2) && ok;
+
+    ok = checkResult("the driver is on for exactly the replies",
+                     fleet.uart.sent.size() > 100 && fleet.uart.driverErrors == 0 && fleet.uart.lateReleases == 0
+                         && simPinLevel(FLEET_ENABLE_PIN) == LOW) && ok;
+
+    // One zone's status registers, as a master polling the fleet reads them
+    reply = fleet.transact(modbusRequest(FLEET_ADDRESS, MODBUS_READ_INPUT, 0, 5));
+    double pollMs = fleet.roundTrip / 1000.0;
+    snprintf(name, sizeof(name), "a 5-register poll takes %.1f ms: %d polls/s on one bus", pollMs,
+             (int)(1000.0 / pollMs));
+    ok = checkResult(name, readReply(reply, MODBUS_READ_INPUT, 5) && pollMs * 32 < 1000.0) && ok;
+    return ok;
+}
+
+// ====== WATCHDOG SUPERVISOR ======
+// Three tasks as in the sketches: a control pass every 50 ms, a "work"
+// task every 10 ms that a test can make hang or hog the CPU, and a peer
+// every 5 ms that it starves. The loop runs every millisecond with the
+// supervisor's check after it; heater on pin 8 is PB0.
+enum WorkMode { WORK_NORMAL, WORK_HANG, WORK_HOG, WORK_STALL };
+const uint8_t WATCHDOG_WORK_TASK = 1;
+const uint8_t WATCHDOG_PEER_TASK = 2;
+static WorkMode watchdogWork = WORK_NORMAL;
+static uint64_t watchdogHeaterOffAt = 0;  // simClock the hung task saw the heater go off
+static uint64_t watchdogResetAt = 0;      // ... and the watchdog reset the part
+
+static void watchdogWorkTask() {
+    if (watchdogWork == WORK_HANG) {
+        // Never returns on the part: spins until the reset
+        watchdogWork = WORK_NORMAL;
+        for (int ms = 0; ms < 1000 && !watchdogResetAt; ms++) {
+            simAdvanceMicros(1000);
+            if (!watchdogHeaterOffAt && simPinLevel(8) == LOW) {
+                watchdogHeaterOffAt = simNowMicros();
+            }
+            if (simWatchdogResets() > 0) {
+                watchdogResetAt = simNowMicros();
+            }
+        }
+    } else if (watchdogWork == WORK_HOG) {
+        simAdvanceMicros(12000);
+    } else if (watchdogWork == WORK_STALL) {
+        watchdogWork = WORK_NORMAL;
+        simAdvanceMicros(100000);
+    }
+}
+static void watchdogPeerTask() {}
+
+struct WatchdogRun {
+    typedef HeaterController<ScriptedSensor, Project1SimConfig<BANG_BANG> > Controller;
+    typedef Scheduler<3> Sched;
+
+    // Boots as after a reset with the given MCUSR, heating from 20 °C
+    explicit WatchdogRun(uint8_t cause) : supervisor(scheduler, controller) {
+        simReset();
+        PORTB |= _BV(0);  // Whatever the heater pin was left at
+        MCUSR = cause;
+        watchdogBoot(Project1SimConfig<BANG_BANG>::heaterPin, 1);
+        bootHeaterOff = (DDRB & _BV(0)) && simPinLevel(8) == LOW && WDTCSR == 0;
+        watchdogWork = WORK_NORMAL;
+        watchdogHeaterOffAt = watchdogResetAt = 0;
+        scriptedTemp = celsiusQ8(20.0);
+        scriptedStatus = SENSOR_OK;
+        controller.begin();
+        scheduler.add(controlTask, 50, 10);
+        scheduler.add(watchdogWorkTask, 10, 2);
+        scheduler.add(watchdogPeerTask, 5, 2);
+        running = this;
+        supervisor.begin();
+    }
+    ~WatchdogRun() { running = 0; }
+
+    void run(unsigned long ms) {
+        for (unsigned long i = 0; i < ms; i++) {
+            simAdvanceMicros(1000);
+            scheduler.run();
+            supervisor.check();
+        }
+    }
+
+    static void controlTask() { running->controller.update(); }
+
+    Controller controller;
+    Sched scheduler;
+    WatchdogSupervisor<Sched, Controller> supervisor;
+    bool bootHeaterOff;
+    static WatchdogRun* running;
+};
+WatchdogRun* WatchdogRun::running = 0;
+
+static std::string resetLine(const ResetRecord& record) {
+    CaptureOut out;
+    printResetRecord(out, record);
+    return out.text;
+}
+
+static bool runWatchdog() {
+    bool ok = true;
+    memset(&watchdogRecord, 0x5A, sizeof(watchdogRecord));  // RAM after power-up
+    {
+        WatchdogRun power(RESET_POWER_ON);
+        ok = checkResult("boot drives the heater low and stops the watchdog", power.bootHeaterOff) && ok;
+        ok = checkResult("after power-up there is no record, only the cause",
+                         resetLine(watchdogLastReset) == "reset power-on resets 0\n") && ok;
+        power.run(10000);
+        ok = checkResult("a healthy loop is never reset",
+                         simWatchdogResets() == 0 && !watchdogRecord.stalled && power.controller.state() == HEATING
+                             && simPinLevel(8) == HIGH) && ok;
+        watchdogWork = WORK_STALL;
+        power.run(2000);
+        ok = checkResult("a 100 ms stall, under the timeout, is not reset",
+                         simWatchdogResets() == 0 && !watchdogRecord.stalled) && ok;
+
+        // The work task hangs while the heater is on
+        uint64_t hungAt = simNowMicros();
+        watchdogWork = WORK_HANG;
+        power.run(20);
+        double offMs = (watchdogHeaterOffAt - hungAt) / 1000.0;
+        double resetMs = (watchdogResetAt - hungAt) / 1000.0;
+        char name[64];
+        snprintf(name, sizeof(name), "a hung task: heater off after %.0f ms, reset after %.0f ms", offMs,
+                 resetMs);
+        ok = checkResult(name, watchdogHeaterOffAt && watchdogResetAt && offMs <= 270 && resetMs <= 530
+                                   && watchdogRecord.stalled && watchdogRecord.task == WATCHDOG_WORK_TASK) && ok;
+        unsigned long toggles = simPinToggles(8);
+        power.run(100);
+        ok = checkResult("no task runs between the warning and the reset",
+                         simPinToggles(8) == toggles && simPinLevel(8) == LOW && !power.scheduler.due()) && ok;
+    }
+    {
+        WatchdogRun hung(_BV(WDRF));
+        ok = checkResult("the record names the hung task and the last state",
+                         resetLine(watchdogLastReset) == "reset watchdog resets 0 task 1 overdue 0 states HEATING\n"
+                             && hung.bootHeaterOff) && ok;
+
+        // The work task hogs the CPU, so the peer never starts in time
+        hung.run(1000);
+        watchdogWork = WORK_HOG;
+        hung.run(1000);
+        ok = checkResult("a task always started late stops the feeding",
+                         simWatchdogResets() == 1 && watchdogRecord.stalled
+                             && (watchdogRecord.overdue & _BV(WATCHDOG_PEER_TASK))) && ok;
+    }
+    {
+        // Optiboot clears MCUSR before the sketch runs
+        WatchdogRun starved(0);
+        ok = checkResult("a cleared MCUSR still reads back as a watchdog reset",
+                         (watchdogLastReset.cause & RESET_WATCHDOG) && watchdogLastReset.stalled
+                             && watchdogLastReset.resets == 1
+                             && (watchdogLastReset.overdue & _BV(WATCHDOG_PEER_TASK))) && ok;
+        starved.run(100);
+        ((uint8_t*)&watchdogRecord)[3] ^= 0x01;
+    }
+    {
+        WatchdogRun damaged(_BV(EXTRF));
+        ok = checkResult("a damaged record is dropped, the cause kept",
+                         resetLine(watchdogLastReset) == "reset external resets 0\n") && ok;
+    }
+    return ok;
+}
+
+// ====== MAIN ======
+static void usage() {
+    fprintf(stderr, "usage: heater_sim [--scenario step|overheat|sensor-fault|near-limit|settings|console|filter|sensor|clock|resolution|onewire|\n"
+                    "                   autotune|history|fleet|watchdog|zones|all]\n"
+                    "                  [--mode bang|pid|all]\n"
+                    "                  [--minutes N] [--band C] [--trace file.csv]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    options.scenario = "all";
+    options.mode = "all";
+    options.minutes = 0;
+    options.band = 1.0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+        }
+        if (arg == "--scenario") {
+            options.scenario = argv[++i];
+        } else if (arg == "--mode") {
+            options.mode = argv[++i];
+        } else if (arg == "--minutes") {
+            options.minutes = atof(argv[++i]);
+        } else if (arg == "--band") {
+            options.band = atof(argv[++i]);
+        } else if (arg == "--trace") {
+            options.trace = argv[++i];
+        } else {
+            usage();
+        }
+    }
+
+    FILE* trace = 0;
+    if (!options.trace.empty()) {
+        trace = fopen(options.trace.c_str(), "w");
+        if (!trace) {
+            perror(options.trace.c_str());
+            return 2;
+        }
+        fprintf(trace, "scenario,mode,time_s,heater_c,load_c,sensor_c,reading_c,state,duty,pin\n");
+    }
+
+    bool ok = true;
+    bool matched = false;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        const Scenario& s = scenarios[i];
+        if (options.scenario != "all" && options.scenario != s.name) {
+            continue;
+        }
+        if (!matched) {
+            printf("%-13s %-7s %-9s %7s %8s %9s %7s %7s %8s %9s %10s  %s\n", "scenario", "sensor", "mode",
+                   "rise(s)", "settle(s)", "overshoot", "error", "ripple", "toggles", "ns/cycle", "Mcycles/s",
+                   "result");
+        }
+        matched = true;
+        ok = runBoard<Tmp36Feed, Project1SimConfig>(s, options, trace) && ok;
+        ok = runBoard<Lm75Feed, Project2SimConfig>(s, options, trace) && ok;
+        ok = runBoard<Ds18b20Feed, Project2Ds18b20SimConfig>(s, options, trace) && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "settings") {
+        printf("\n%-60s %s\n", "settings store", "result");
+        matched = true;
+        ok = runSettings() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "console") {
+        printf("\n%-60s %s\n", "command console", "result");
+        matched = true;
+        ok = runConsole() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "filter") {
+        printf("\n%-60s %s\n", "sample filter", "result");
+        matched = true;
+        ok = runFilter() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "sensor") {
+        printf("\n%-60s %s\n", "sensor faults", "result");
+        matched = true;
+        ok = runSensor() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "clock") {
+        printf("\n%-60s %s\n", "sampling clock", "result");
+        matched = true;
+        ok = runClock() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "resolution") {
+        printf("\n%-60s %s\n", "sensor resolution", "result");
+        matched = true;
+        ok = runResolution() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "onewire") {
+        printf("\n%-60s %s\n", "1-wire DS18B20", "result");
+        matched = true;
+        ok = runOneWire() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "autotune") {
+        printf("\n%-60s %s\n", "relay autotune", "result");
+        matched = true;
+        ok = runAutotune() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "history") {
+        printf("\n%-60s %s\n", "history log", "result");
+        matched = true;
+        ok = runHistory() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "fleet") {
+        printf("\n%-60s %s\n", "modbus fleet node", "result");
+        matched = true;
+        ok = runFleet() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "watchdog") {
+        printf("\n%-60s %s\n", "watchdog supervisor", "result");
+        matched = true;
+        ok = runWatchdog() && ok;
+    }
+    if (options.scenario == "all" || options.scenario == "zones") {
+        printf("\n%-5s %-9s %7s %9s %8s %9s %10s %9s  %s\n", "zones", "mode", "rise(s)", "overshoot",
+               "toggles", "bursts", "ns/pass", "ns/zone", "result");
+        matched = true;
+        if (options.mode == "all" || options.mode == "bang") {
+            ok = runZoneSweep<BANG_BANG>(options) && ok;
+        }
+        if (options.mode == "all" || options.mode == "pid") {
+            ok = runZoneSweep<PID>(options) && ok;
+        }
+    }
+    if (trace) {
+        fclose(trace);
+    }
+    if (!matched) {
+        usage();
+    }
+    return ok ? 0 : 1;
+}
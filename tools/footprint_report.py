@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Flash and SRAM usage of a sketch build, per source module.
+
+Reads the symbol table of the .elf the Arduino build leaves behind (built
+with debug info, which the Arduino builds always have) and charges each
+symbol to the file it is defined in:
+
+    flash   code, PROGMEM tables and strings, and the initial values of
+            initialized data (copied to SRAM at boot)
+    sram    initialized data and zeroed data (.data + .bss)
+
+Stack and heap are not symbols: free SRAM at run time is the SRAM total
+less this, less the deepest stack. All code in common/ is header-only, so
+a header's row is what this sketch instantiated from it; string literals
+left outside PROGMEM show up as .data, i.e. in both columns.
+
+Usage:
+    footprint_report.py build/Sourcecode2.ino.elf
+    footprint_report.py --symbols 5 build/Sourcecode2.ino.elf   # largest symbols per module
+    footprint_report.py --nm nm --size size heater_sim           # any toolchain's binutils
+
+The .elf comes from e.g. arduino-cli compile -b arduino:avr:uno
+--output-dir build <sketch>, or the Arduino IDE's build folder.
+"""
+
+import argparse
+import collections
+import os
+import subprocess
+import sys
+
+FLASH_SIZE = 32256  # Uno: 32 KB less the 512-byte bootloader
+SRAM_SIZE = 2048
+AVR_DATA_START = 0x800000  # avr-gcc's offset for SRAM addresses in the .elf
+
+
+def symbols(nm, elf):
+    """Yields (module, name, type, address, size) for every sized symbol."""
+    out = subprocess.run([nm, "--defined-only", "-S", "-l", "-C", elf],
+                         check=True, capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        text, _, location = line.partition("\t")
+        fields = text.split(None, 3)
+        if len(fields) < 4:
+            continue  # No size: labels, section and linker symbols
+        address, size, kind, name = fields
+        path = location.rsplit(":", 1)[0] if location else ""
+        module = os.path.basename(path) if path else "(no line info)"
+        yield module, name, kind, int(address, 16), int(size, 16)
+
+
+def charge(kind, address, size):
+    """(flash, sram) bytes of one symbol."""
+    kind = kind.lower()
+    if kind in "bs":
+        return 0, size
+    if kind in "dg":
+        return size, size
+    if kind in "uvw":  # Weak or unique: template statics and inline functions
+        return (0, size) if address >= AVR_DATA_START else (size, 0)
+    return size, 0  # t, r, and PROGMEM data (in .text on AVR)
+
+
+def totals(size, elf):
+    """(text, data, bss) of the whole image, from size in Berkeley format."""
+    out = subprocess.run([size, "-B", elf], check=True, capture_output=True, text=True).stdout
+    text, data, bss = out.splitlines()[1].split()[:3]
+    return int(text), int(data), int(bss)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf")
+    parser.add_argument("--nm", default="avr-nm")
+    parser.add_argument("--size", default="avr-size")
+    parser.add_argument("--symbols", type=int, default=0, metavar="N",
+                        help="also list the N largest symbols of each module")
+    args = parser.parse_args()
+
+    flash = collections.Counter()
+    sram = collections.Counter()
+    largest = collections.defaultdict(list)
+    for module, name, kind, address, size in symbols(args.nm, args.elf):
+        f, s = charge(kind, address, size)
+        flash[module] += f
+        sram[module] += s
+        largest[module].append((max(f, s), kind, name))
+
+    print("%-28s %8s %8s" % ("module", "flash", "sram"))
+    for module in sorted(flash, key=lambda m: (-flash[m], -sram[m], m)):
+        print("%-28s %8d %8d" % (module, flash[module], sram[module]))
+        for size, kind, name in sorted(largest[module], reverse=True)[:args.symbols]:
+            print("    %6d %s %s" % (size, kind, name))
+
+    text, data, bss = totals(args.size, args.elf)
+    print("%-28s %8d %8d" % ("total (size)", text + data, data + bss))
+    print("of %d flash (%.0f%%) and %d SRAM (%.0f%%), %d SRAM left for the stack"
+          % (FLASH_SIZE, 100.0 * (text + data) / FLASH_SIZE, SRAM_SIZE,
+             100.0 * (data + bss) / SRAM_SIZE, SRAM_SIZE - data - bss))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+"""Host-side decoder for the heater controllers' binary telemetry.
+
+Frame layout (see common/Telemetry.h):
+
+    0xA5 0x5A | type | length | payload | CRC16 (little-endian)
+
+The CRC is CRC-16/CCITT-FALSE over type, length and payload.
+
+The temperature in STATUS and ZONE_STATUS records is the sensor's raw
+reading, before the firmware's median + moving-average filter, so spikes
+the controller ignores still show here.
+
+Usage:
+    telemetry_decode.py capture.bin            # decode a raw capture
+    telemetry_decode.py --port /dev/ttyACM0    # live, needs pyserial
+    cat /dev/ttyACM0 | telemetry_decode.py     # live from stdin
+
+With --port, --command sends a console command line (repeatable, e.g.
+--command "set target 42.5" --command get); the replies arrive as TEXT
+records. --profile is short for --command profile (firmware built with
+HEATER_PROFILING). See common/HeaterConsole.h for the commands.
+
+A history log dump (--command log, or --command "log saved" for the copy
+taken at the last OVERHEAT) is decoded into one line per sample and state
+change once its "log end" line arrives; see common/HistoryLog.h.
+"""
+
+import argparse
+import struct
+import sys
+
+SYNC1 = 0xA5
+SYNC2 = 0x5A
+MAX_PAYLOAD = 32
+
+STATE_NAMES = ["IDLE", "HEATING", "STABILIZING", "TARGET_REACHED", "OVERHEAT", "SENSOR_FAULT", "AUTOTUNE"]
+PROFILE_STAGES = ["SAMPLE", "FSM", "ACTUATE", "TELEMETRY", "SERIAL", "LATENCY", "MEDIAN", "EMA"]
+PROFILE_BUCKETS = ["<8", "<16", "<32", "<64", "<128", "<256", "<512", ">=512"]
+HISTORY_BLOCK_SIZE = 32
+HISTORY_HEADER_SIZE = 7
+HISTORY_SAMPLE_PERIOD = 100  # ms
+
+
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def q88(raw):
+    return raw / 256.0
+
+
+def state_name(index):
+    return STATE_NAMES[index] if index < len(STATE_NAMES) else "STATE_%d" % index
+
+
+def decode_status(payload):
+    timestamp, temp, state, duty = struct.unpack("<IhBB", payload)
+    return "t=%10d ms  reading=%7.2f C  state=%-14s  duty=%3d%%" % (
+        timestamp, q88(temp), state_name(state), round(duty * 100 / 255))
+
+
+def decode_zone_status(payload):
+    timestamp, zone, temp, state, duty = struct.unpack("<IBhBB", payload)
+    return "t=%10d ms  zone=%d  reading=%7.2f C  state=%-14s  duty=%3d%%" % (
+        timestamp, zone, q88(temp), state_name(state), round(duty * 100 / 255))
+
+
+def decode_profile(payload):
+    fields = struct.unpack("<BIHHH8H", payload)
+    stage, count, lo, hi, mean = fields[:5]
+    name = PROFILE_STAGES[stage] if stage < len(PROFILE_STAGES) else "STAGE_%d" % stage
+    hist = " ".join("%s:%d" % (b, n) for b, n in zip(PROFILE_BUCKETS, fields[5:]) if n)
+    return "%-9s n=%d min=%d max=%d mean=%d us  [%s]" % (name, count, lo, hi, mean, hist)
+
+
+def decode_text(payload):
+    return payload.decode("ascii", errors="replace")
+
+
+def decode_history(data, scale):
+    """Yields one text line per sample and state change in a log dump
+    (scale: temperature counts per degree)."""
+    last_time = None
+    for start in range(0, len(data) - HISTORY_BLOCK_SIZE + 1, HISTORY_BLOCK_SIZE):
+        block = data[start:start + HISTORY_BLOCK_SIZE]
+        time, counts, used = struct.unpack("<IhB", block[:HISTORY_HEADER_SIZE])
+        payload = block[HISTORY_HEADER_SIZE:]
+        bits = "".join("{:08b}".format(b) for b in payload)[:used]
+        pos = 0
+
+        def take(n):
+            nonlocal pos
+            value = int(bits[pos:pos + n], 2)
+            pos += n
+            return value
+
+        # The keyframe repeats the last sample when a transition opened the block
+        if time != last_time:
+            yield "t=%10d ms  temp=%7.2f C" % (time, counts / scale)
+        sample_time = time
+        while pos < used:
+            if take(1) == 0:
+                sample = True
+            elif take(1) == 0:
+                counts += -1 if take(1) else 1
+                sample = True
+            elif take(1) == 0:
+                counts = take(12)
+                counts -= 0x1000 if counts & 0x800 else 0
+                sample = True
+            else:
+                zone, old, new, offset = take(3), take(3), take(3), take(7)
+                yield "t=%10d ms  zone=%d  %s -> %s" % (
+                    sample_time + offset, zone, state_name(old), state_name(new))
+                sample = False
+            if sample:
+                sample_time += HISTORY_SAMPLE_PERIOD
+                yield "t=%10d ms  temp=%7.2f C" % (sample_time, counts / scale)
+        last_time = sample_time
+
+
+class HistoryDump:
+    """Collects the TEXT lines of a console log dump."""
+
+    def __init__(self):
+        self.data = None
+        self.scale = 16
+
+    def feed(self, line):
+        """Returns the decoded lines once the dump is complete, else None."""
+        if line.startswith("log ram ") or line.startswith("log saved "):
+            self.data = bytearray()
+            words = line.split()
+            self.scale = int(words[3]) if len(words) > 3 else 16
+        elif self.data is not None and line.startswith("h "):
+            self.data.extend(bytes.fromhex(line[2:].strip()))
+        elif self.data is not None and line.startswith("log end"):
+            data, self.data = bytes(self.data), None
+            return list(decode_history(data, self.scale))
+        return None
+
+
+# Record type -> (name, decoder)
+DECODERS = {
+    0x01: ("STATUS", decode_status),
+    0x02: ("PROFILE", decode_profile),
+    0x03: ("ZONE", decode_zone_status),
+    0x04: ("TEXT", decode_text),
+}
+
+
+def frames(stream, live=False):
+    """Yields (type, payload) for every frame with a valid CRC."""
+    buf = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            if live:
+                continue  # Read timeout on a serial port
+            return
+        buf.extend(chunk)
+        while True:
+            start = buf.find(bytes([SYNC1, SYNC2]))
+            if start < 0:
+                del buf[:-1]  # Keep a trailing SYNC1
+                break
+            del buf[:start]
+            if len(buf) < 4:
+                break
+            ftype, length = buf[2], buf[3]
+            if length > MAX_PAYLOAD:
+                del buf[:2]  # Not a real header; resync
+                continue
+            total = 4 + length + 2
+            if len(buf) < total:
+                break
+            body = bytes(buf[2:4 + length])
+            (crc,) = struct.unpack("<H", buf[4 + length:total])
+            if crc16(body) == crc:
+                yield ftype, body[2:]
+                del buf[:total]
+            else:
+                del buf[:2]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file", nargs="?", help="raw capture (default: stdin)")
+    parser.add_argument("--port", help="serial port to read live")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--command", action="append", default=[],
+                        help="console command to send (needs --port)")
+    parser.add_argument("--profile", action="store_true",
+                        help="request a profiling report (needs --port)")
+    args = parser.parse_args()
+
+    live = bool(args.port)
+    if live:
+        import serial  # pyserial
+        stream = serial.Serial(args.port, args.baud, timeout=1)
+        commands = args.command + (["profile"] if args.profile else [])
+        for line in commands:
+            stream.write(line.encode("ascii") + b"\n")
+    elif args.file:
+        stream = open(args.file, "rb")
+    else:
+        stream = sys.stdin.buffer
+
+    dump = HistoryDump()
+    for ftype, payload in frames(stream, live):
+        name, decoder = DECODERS.get(ftype, ("TYPE_0x%02X" % ftype, None))
+        try:
+            text = decoder(payload) if decoder else payload.hex()
+        except struct.error:
+            text = "malformed: " + payload.hex()
+        print("%-8s %s" % (name, text), flush=True)
+        history = dump.feed(text) if name == "TEXT" else None
+        for line in history or []:
+            print("%-8s %s" % ("HISTORY", line), flush=True)
+
+
+if __name__ == "__main__":
+    main()